@@ -0,0 +1,89 @@
+#include "change_detector.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SLITSCAN_SSE2 1
+#endif
+
+namespace slitscan {
+
+// Sum of absolute differences of two blocks of rows, stopping early once it
+// exceeds limit (the answer is only compared against it)
+static uint32_t block_sad(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride,
+                          int bytes, int rows, uint32_t limit)
+{
+    uint32_t sum = 0;
+    for (int y = 0; y < rows && sum <= limit; y++, a += a_stride, b += b_stride) {
+        int i = 0;
+#ifdef SLITSCAN_SSE2
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= bytes; i += 16) {
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+                                                  _mm_loadu_si128((const __m128i*)(b + i))));
+        }
+        sum += (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#endif
+        for (; i < bytes; i++) {
+            sum += abs(a[i] - b[i]);
+        }
+    }
+    return sum;
+}
+
+ChangeDetector::ChangeDetector(int width, int height, float threshold) :
+    width(width),
+    height(height),
+    tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+    threshold(threshold),
+    has_reference(false),
+    reference((size_t)width * height * 2),
+    dirty(tiles_x * tiles_y)
+{
+    resetStats();
+}
+
+void ChangeDetector::resetStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+int ChangeDetector::update(const uint8_t* yuyv, int stride)
+{
+    const int row_bytes = width * 2;
+    int dirty_tiles = 0;
+    for (int ty = 0; ty < tiles_y; ty++) {
+        int y = ty * TILE_SIZE;
+        int rows = height - y < TILE_SIZE ? height - y : TILE_SIZE;
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x = tx * TILE_SIZE;
+            int bytes = (width - x < TILE_SIZE ? width - x : TILE_SIZE) * 2;
+            const uint8_t* src = yuyv + (size_t)y * stride + x * 2;
+            uint8_t* ref = &reference[(size_t)y * row_bytes + x * 2];
+
+            uint32_t limit = (uint32_t)(threshold * bytes * rows);
+            bool changed = !has_reference || block_sad(src, stride, ref, row_bytes, bytes, rows, limit) > limit;
+            dirty[ty * tiles_x + tx] = changed;
+            if (changed) {
+                for (int r = 0; r < rows; r++) {
+                    memcpy(ref + (size_t)r * row_bytes, src + (size_t)r * stride, bytes);
+                }
+                dirty_tiles++;
+                stats.pixels_dirty += bytes / 2 * rows;
+            } else {
+                stats.pixels_clean += bytes / 2 * rows;
+            }
+        }
+    }
+    has_reference = true;
+    stats.frames++;
+    if (dirty_tiles == 0) {
+        stats.static_frames++;
+    }
+    return dirty_tiles;
+}
+
+} // namespace
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace slitscan {
+
+// Finds the parts of a YUYV frame that changed, for skipping work on static
+// scenes. The frame is split into TILE_SIZE square tiles, and each one is
+// compared (sum of absolute differences, SSE2 where available) against a
+// reference: the tile as it was when it last counted as changed. Comparing
+// against that instead of the previous frame means slow drift below the
+// threshold still adds up and gets noticed.
+class ChangeDetector
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    struct Stats {
+        uint64_t frames;
+        uint64_t static_frames;     // no tile changed
+        uint64_t pixels_dirty;
+        uint64_t pixels_clean;
+    };
+
+    // threshold: mean absolute difference per YUYV byte above which a tile has changed
+    ChangeDetector(int width, int height, float threshold);
+
+    // Compares frame against the reference, marks the tiles that changed and
+    // takes them into the reference. Returns the number of dirty tiles; the
+    // first frame is all dirty.
+    int update(const uint8_t* yuyv, int stride);
+    // Makes the next update() mark every tile, e.g. after the consumer lost its copy
+    void invalidate() { has_reference = false; }
+
+    bool isDirty(int tx, int ty) const { return dirty[ty * tiles_x + tx] != 0; }
+    int getTilesX() const { return tiles_x; }
+    int getTilesY() const { return tiles_y; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    float getThreshold() const { return threshold; }
+    void setThreshold(float val) { threshold = val; }
+    const Stats& getStats() const { return stats; }
+    void resetStats();
+
+private:
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    float threshold;
+    bool has_reference;
+    std::vector<uint8_t> reference;     // YUYV, width * 2 per row
+    std::vector<uint8_t> dirty;         // per tile, row by row
+    Stats stats;
+};
+
+} // namespace
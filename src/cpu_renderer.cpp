@@ -0,0 +1,420 @@
+#include "cpu_renderer.h"
+
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SLITSCAN_SSE2 1
+#endif
+
+namespace slitscan {
+
+static const int TILE_SIZE = 64;
+
+// Texture coordinate -> texel index pair and 8-bit weight, like GL_LINEAR + GL_REPEAT
+static inline void linear_texel(float coord, int size, int& i0, int& i1, int& w)
+{
+    float f = coord * size - 0.5f;
+    float fl = std::floor(f);
+    w = (int)((f - fl) * 256.0f + 0.5f);
+    int i = (int)fl % size;
+    if (i < 0) i += size;
+    i0 = i;
+    i1 = (i + 1 == size) ? 0 : i + 1;
+}
+
+// Texture coordinate -> texel index, like GL_NEAREST + GL_REPEAT
+static inline int nearest_texel(float coord, int size)
+{
+    int i = (int)std::floor(coord * size) % size;
+    return i < 0 ? i + size : i;
+}
+
+#ifdef SLITSCAN_SSE2
+// two RGB texels widened to 16 bits: [a.r a.g a.b x | b.r b.g b.b x]
+static inline __m128i load_texel_pair(const uint8_t* a, const uint8_t* b)
+{
+    uint32_t va, vb;
+    memcpy(&va, a, 4);
+    memcpy(&vb, b, 4);
+    __m128i v = _mm_unpacklo_epi32(_mm_cvtsi32_si128(va), _mm_cvtsi32_si128(vb));
+    return _mm_unpacklo_epi8(v, _mm_setzero_si128());
+}
+
+// (a * (256 - w) + b * w) >> 8, w in [0, 256]; the sum never exceeds 16 bits
+static inline __m128i lerp_epu16(__m128i a, __m128i b, __m128i w)
+{
+    __m128i iw = _mm_sub_epi16(_mm_set1_epi16(256), w);
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, iw), _mm_mullo_epi16(b, w)), 8);
+}
+#endif
+
+static inline int lerp_u8(int a, int b, int w)
+{
+    return (a * (256 - w) + b * w) >> 8;
+}
+
+// Trilinear blend into one RGBA pixel of the texels at (x0, y0), (x1, y0),
+// (x0, y1) and (x1, y1) of two layers a and b; 8-bit weights
+static inline void blend_texels(const uint8_t* const* a, const uint8_t* const* b, int wx, int wy, int wz, uint8_t* out)
+{
+#ifdef SLITSCAN_SSE2
+    __m128i wy_v = _mm_set1_epi16((short)wy);
+    __m128i la = lerp_epu16(load_texel_pair(a[0], a[1]), load_texel_pair(a[2], a[3]), wy_v);
+    __m128i lb = lerp_epu16(load_texel_pair(b[0], b[1]), load_texel_pair(b[2], b[3]), wy_v);
+    __m128i c = lerp_epu16(la, lb, _mm_set1_epi16((short)wz));
+    __m128i d = lerp_epu16(c, _mm_unpackhi_epi64(c, c), _mm_set1_epi16((short)wx));
+    __m128i px = _mm_or_si128(_mm_packus_epi16(d, d), _mm_set1_epi32((int)0xff000000));
+    uint32_t rgba = (uint32_t)_mm_cvtsi128_si32(px);
+    memcpy(out, &rgba, 4);
+#else
+    for (int ch = 0; ch < 3; ch++) {
+        int a0 = lerp_u8(a[0][ch], a[2][ch], wy);
+        int a1 = lerp_u8(a[1][ch], a[3][ch], wy);
+        int b0 = lerp_u8(b[0][ch], b[2][ch], wy);
+        int b1 = lerp_u8(b[1][ch], b[3][ch], wy);
+        out[ch] = (uint8_t)lerp_u8(lerp_u8(a0, b0, wz), lerp_u8(a1, b1, wz), wx);
+    }
+    out[3] = 0xff;
+#endif
+}
+
+CpuRenderer::CpuRenderer(int threads, Filter filter) :
+    filter(filter),
+    next_tile(0),
+    tiles_done(0),
+    busy_workers(0),
+    generation(0),
+    exit_signaled(false)
+{
+    memset(&stats, 0, sizeof(stats));
+    memset(&job, 0, sizeof(job));
+
+    if (threads <= 0) {
+        threads = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+    // the calling thread also renders tiles
+    for (int i = 1; i < threads; i++) {
+        workers.push_back(std::thread(&CpuRenderer::workerThreadFunc, this));
+    }
+}
+
+CpuRenderer::~CpuRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exit_signaled = true;
+    }
+    work_condition.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void CpuRenderer::render(const FrameHistory& history, const float* time_table, float offset,
+                         uint8_t* dst, int dst_width, int dst_height, int dst_stride)
+{
+    start(&history, NULL, NULL, time_table, offset, dst, dst_width, dst_height, dst_stride);
+}
+
+void CpuRenderer::renderPyramid(const FrameHistory& history, const TemporalPyramid& pyramid, const float* time_table,
+                                float offset, uint8_t* dst, int dst_width, int dst_height, int dst_stride)
+{
+    start(&history, &pyramid, NULL, time_table, offset, dst, dst_width, dst_height, dst_stride);
+}
+
+void CpuRenderer::renderTiered(const TieredHistory& history, const float* time_table, float offset,
+                               uint8_t* dst, int dst_width, int dst_height, int dst_stride)
+{
+    start(NULL, NULL, &history, time_table, offset, dst, dst_width, dst_height, dst_stride);
+}
+
+void CpuRenderer::start(const FrameHistory* history, const TemporalPyramid* pyramid, const TieredHistory* tiered,
+                        const float* time_table, float offset, uint8_t* dst, int dst_width, int dst_height, int dst_stride)
+{
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    const int width = history ? history->getWidth() : tiered->getWidth();
+
+    // horizontal sampling doesn't depend on time, so compute it once per render
+    col_x0.resize(dst_width);
+    col_x1.resize(dst_width);
+    col_wx.resize(dst_width);
+    for (int x = 0; x < dst_width; x++) {
+        float t = (x + 0.5f) / dst_width;
+        if (filter == FILTER_TRILINEAR) {
+            int w;
+            linear_texel(t, width, col_x0[x], col_x1[x], w);
+            col_wx[x] = (uint16_t)w;
+        } else {
+            col_x0[x] = col_x1[x] = nearest_texel(t, width);
+            col_wx[x] = 0;
+        }
+    }
+
+    int tiles_x = (dst_width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (dst_height + TILE_SIZE - 1) / TILE_SIZE;
+    {
+        // a worker that woke up late for the last render may still be looking
+        // for tiles; it must not find this render's with the last one's job
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [this] () { return busy_workers == 0; });
+        job.history = history;
+        job.pyramid = pyramid;
+        job.tiered = tiered;
+        job.time_table = time_table;
+        job.offset = offset;
+        job.dst = dst;
+        job.dst_width = dst_width;
+        job.dst_height = dst_height;
+        job.dst_stride = dst_stride;
+        job.tiles_x = tiles_x;
+        job.tile_count = tiles_x * tiles_y;
+        tiles_done = 0;
+        next_tile = 0;
+        generation++;
+    }
+    work_condition.notify_all();
+
+    runTiles(job);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [this] () { return tiles_done >= job.tile_count; });
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    double mps = (dst_width * (double)dst_height) / (ms * 1000.0);
+    stats.last_render_ms = ms;
+    stats.megapixels_per_second = stats.frames_rendered == 0 ? mps : stats.megapixels_per_second * 0.9 + mps * 0.1;
+    stats.frames_rendered++;
+}
+
+void CpuRenderer::workerThreadFunc()
+{
+    uint64_t seen_generation = 0;
+    for (;;) {
+        Job snapshot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_condition.wait(lock, [&] () { return exit_signaled || generation != seen_generation; });
+            if (exit_signaled) {
+                return;
+            }
+            seen_generation = generation;
+            snapshot = job;
+            busy_workers++;
+        }
+        runTiles(snapshot);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+        }
+        done_condition.notify_all();
+    }
+}
+
+void CpuRenderer::runTiles(const Job& job)
+{
+    int done = 0;
+    for (;;) {
+        int tile = next_tile++;
+        if (tile >= job.tile_count) {
+            break;
+        }
+        renderTile(job, tile % job.tiles_x, tile / job.tiles_x);
+        done++;
+    }
+
+    if (done > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles_done += done;
+        if (tiles_done >= job.tile_count) {
+            done_condition.notify_all();
+        }
+    }
+}
+
+inline const FrameHistory& CpuRenderer::locate(const Job& job, float time, float& z) const
+{
+    if (!job.pyramid) {
+        z = time + job.offset;
+        return *job.history;
+    }
+    int level = job.pyramid->getLayout().locate(time, job.offset, z);
+    return level ? job.pyramid->getLevel(level) : *job.history;
+}
+
+void CpuRenderer::renderTile(const Job& job, int tx, int ty)
+{
+    if (job.tiered) {
+        renderTieredTile(job, tx, ty);
+        return;
+    }
+
+    // all pyramid levels share the history's size and frame count
+    const FrameHistory& history = *job.history;
+    const int width = history.getWidth();
+    const int height = history.getHeight();
+    const int frames = history.getFrames();
+    const int row_bytes = width * 3;
+
+    int x_begin = tx * TILE_SIZE;
+    int x_end = (std::min)(x_begin + TILE_SIZE, job.dst_width);
+    int y_begin = ty * TILE_SIZE;
+    int y_end = (std::min)(y_begin + TILE_SIZE, job.dst_height);
+
+    for (int y = y_begin; y < y_end; y++) {
+        float u = (y + 0.5f) / job.dst_height;
+        uint8_t* out = job.dst + (size_t)y * job.dst_stride + x_begin * 4;
+        const float* times = job.time_table + (size_t)y * job.dst_width;
+
+        if (filter == FILTER_NEAREST) {
+            int row = nearest_texel(u, height) * row_bytes;
+            for (int x = x_begin; x < x_end; x++, out += 4) {
+                float t;
+                const FrameHistory& level = locate(job, times[x], t);
+                const uint8_t* src = level.getLayer(nearest_texel(t, frames)) + row + col_x0[x] * 3;
+                out[0] = src[0];
+                out[1] = src[1];
+                out[2] = src[2];
+                out[3] = 0xff;
+            }
+            continue;
+        }
+
+        int y0, y1, wy;
+        linear_texel(u, height, y0, y1, wy);
+        y0 *= row_bytes;
+        y1 *= row_bytes;
+        for (int x = x_begin; x < x_end; x++, out += 4) {
+            float t;
+            const FrameHistory& level = locate(job, times[x], t);
+            int z0, z1, wz;
+            linear_texel(t, frames, z0, z1, wz);
+
+            const uint8_t* l0 = level.getLayer(z0);
+            const uint8_t* l1 = level.getLayer(z1);
+            int cx0 = col_x0[x] * 3;
+            int cx1 = col_x1[x] * 3;
+            const uint8_t* a[4] = { l0 + y0 + cx0, l0 + y0 + cx1, l0 + y1 + cx0, l0 + y1 + cx1 };
+            const uint8_t* b[4] = { l1 + y0 + cx0, l1 + y0 + cx1, l1 + y1 + cx0, l1 + y1 + cx1 };
+            blend_texels(a, b, col_wx[x], wy, wz, out);
+        }
+    }
+}
+
+// Texels of a TieredHistory layer: raw layers directly, cold ones through the
+// history's tile cache. The last few tiles are kept here so most pixels don't
+// touch the (locked) cache at all.
+class TieredSampler
+{
+public:
+    explicit TieredSampler(const TieredHistory& history) : history(history)
+    {
+        for (int i = 0; i < MEMO_SIZE; i++) {
+            memo[i].layer = -1;
+        }
+    }
+
+    // the texels at (x, y), (x1, y), (x, y1) and (x1, y1) of layer z, where x1
+    // and y1 are the next texels right and down, wrapping around; row and
+    // col are the byte offsets of y and x in a raw layer
+    void quad(int z, int x, int y, int col, int row, int col1, int row1, const uint8_t** texels)
+    {
+        const uint8_t* raw = history.getRawLayer(z);
+        if (raw) {
+            texels[0] = raw + row + col;
+            texels[1] = raw + row + col1;
+            texels[2] = raw + row1 + col;
+            texels[3] = raw + row1 + col1;
+            return;
+        }
+        // the tile's apron holds the right and lower neighbours
+        const int stride = TieredHistory::getTileStride();
+        const uint8_t* p = tile(z, x / TieredHistory::TILE_SIZE, y / TieredHistory::TILE_SIZE)
+                         + (y % TieredHistory::TILE_SIZE) * stride + (x % TieredHistory::TILE_SIZE) * 3;
+        texels[0] = p;
+        texels[1] = p + 3;
+        texels[2] = p + stride;
+        texels[3] = p + stride + 3;
+    }
+
+private:
+    static const int MEMO_SIZE = 64;
+
+    struct Entry {
+        int layer, tx, ty;
+        TieredHistory::Tile tile;
+    };
+
+    const uint8_t* tile(int z, int tx, int ty)
+    {
+        Entry& entry = memo[(z * 7 + tx * 3 + ty) & (MEMO_SIZE - 1)];
+        if (entry.layer != z || entry.tx != tx || entry.ty != ty) {
+            entry.layer = z;
+            entry.tx = tx;
+            entry.ty = ty;
+            entry.tile = history.getTile(z, tx, ty);
+        }
+        // black rather than crash if a tile failed to decode
+        static const uint8_t black[(TieredHistory::TILE_SIZE + 1) * (TieredHistory::TILE_SIZE + 1) * 3 + 4] = { 0 };
+        return entry.tile ? &(*entry.tile)[0] : black;
+    }
+
+    const TieredHistory& history;
+    Entry memo[MEMO_SIZE];
+};
+
+void CpuRenderer::renderTieredTile(const Job& job, int tx, int ty)
+{
+    const TieredHistory& history = *job.tiered;
+    const int height = history.getHeight();
+    const int frames = history.getFrames();
+    const int row_bytes = history.getWidth() * 3;
+    TieredSampler sampler(history);
+
+    int x_begin = tx * TILE_SIZE;
+    int x_end = (std::min)(x_begin + TILE_SIZE, job.dst_width);
+    int y_begin = ty * TILE_SIZE;
+    int y_end = (std::min)(y_begin + TILE_SIZE, job.dst_height);
+
+    for (int y = y_begin; y < y_end; y++) {
+        float u = (y + 0.5f) / job.dst_height;
+        uint8_t* out = job.dst + (size_t)y * job.dst_stride + x_begin * 4;
+        const float* times = job.time_table + (size_t)y * job.dst_width;
+
+        if (filter == FILTER_NEAREST) {
+            int row = nearest_texel(u, height);
+            for (int x = x_begin; x < x_end; x++, out += 4) {
+                const uint8_t* src[4];
+                sampler.quad(nearest_texel(times[x] + job.offset, frames), col_x0[x], row,
+                             col_x0[x] * 3, row * row_bytes, 0, 0, src);
+                out[0] = src[0][0];
+                out[1] = src[0][1];
+                out[2] = src[0][2];
+                out[3] = 0xff;
+            }
+            continue;
+        }
+
+        int y0, y1, wy;
+        linear_texel(u, height, y0, y1, wy);
+        for (int x = x_begin; x < x_end; x++, out += 4) {
+            int z0, z1, wz;
+            linear_texel(times[x] + job.offset, frames, z0, z1, wz);
+
+            int cx0 = col_x0[x] * 3;
+            int cx1 = col_x1[x] * 3;
+            const uint8_t* a[4];
+            const uint8_t* b[4];
+            sampler.quad(z0, col_x0[x], y0, cx0, y0 * row_bytes, cx1, y1 * row_bytes, a);
+            sampler.quad(z1, col_x0[x], y0, cx0, y0 * row_bytes, cx1, y1 * row_bytes, b);
+            blend_texels(a, b, col_wx[x], wy, wz, out);
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "frame_history.h"
+#include "temporal_pyramid.h"
+#include "tiered_history.h"
+
+namespace slitscan {
+
+// Pure-CPU equivalent of the GL draw in ofApp::draw(): samples a FrameHistory
+// through a time table (see TimeMapCache) into an RGBA image. Work is split into tiles
+// which are picked up by a small pool of worker threads.
+class CpuRenderer
+{
+public:
+    enum Filter {
+        FILTER_NEAREST,     // GL_NEAREST
+        FILTER_TRILINEAR    // GL_LINEAR on a 3D texture
+    };
+
+    struct Stats {
+        double last_render_ms;
+        double megapixels_per_second;   // output pixels, averaged over recent renders
+        uint64_t frames_rendered;
+    };
+
+    // threads = 0 uses std::thread::hardware_concurrency()
+    explicit CpuRenderer(int threads = 0, Filter filter = FILTER_TRILINEAR);
+    ~CpuRenderer();
+
+    // Render history into dst (packed RGBA, dst_stride bytes per row).
+    // time_table holds dst_width*dst_height time coordinates relative to offset,
+    // which is normally FrameHistory::getNewestOffset().
+    void render(const FrameHistory& history, const float* time_table, float offset,
+                uint8_t* dst, int dst_width, int dst_height, int dst_stride);
+    // Same through a temporal pyramid over history: the time table spans the
+    // whole pyramid, and each pixel samples the level PyramidLayout::locate() picks
+    void renderPyramid(const FrameHistory& history, const TemporalPyramid& pyramid, const float* time_table,
+                       float offset, uint8_t* dst, int dst_width, int dst_height, int dst_stride);
+    // Same from a TieredHistory, decoding its cold tiles as they are needed;
+    // offset is normally TieredHistory::getNewestOffset()
+    void renderTiered(const TieredHistory& history, const float* time_table, float offset,
+                      uint8_t* dst, int dst_width, int dst_height, int dst_stride);
+
+    Filter getFilter() const { return filter; }
+    void setFilter(Filter val) { filter = val; }
+    int getThreadCount() const { return (int)workers.size() + 1; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    CpuRenderer(const CpuRenderer&);
+    void operator=(const CpuRenderer&);
+
+    struct Job {
+        const FrameHistory* history;
+        const TemporalPyramid* pyramid;     // NULL samples history alone
+        const TieredHistory* tiered;        // instead of history
+        const float* time_table;
+        float offset;
+        uint8_t* dst;
+        int dst_width;
+        int dst_height;
+        int dst_stride;
+        int tiles_x;
+        int tile_count;
+    };
+
+    void start(const FrameHistory* history, const TemporalPyramid* pyramid, const TieredHistory* tiered,
+               const float* time_table, float offset, uint8_t* dst, int dst_width, int dst_height, int dst_stride);
+    // history layer and z texture coordinate that a pixel's time samples
+    inline const FrameHistory& locate(const Job& job, float time, float& z) const;
+    void workerThreadFunc();
+    // workers render from a copy of job taken under the mutex
+    void runTiles(const Job& job);
+    void renderTile(const Job& job, int tx, int ty);
+    void renderTieredTile(const Job& job, int tx, int ty);
+
+    Filter filter;
+    Stats stats;
+
+    // per-render column lookup, shared by all rows since x is not time dependent
+    std::vector<int> col_x0, col_x1;
+    std::vector<uint16_t> col_wx;
+
+    Job job;
+    std::atomic_int next_tile;
+    int tiles_done;
+    int busy_workers;       // between taking a job and leaving runTiles()
+    uint64_t generation;
+    bool exit_signaled;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_condition;
+    std::condition_variable done_condition;
+};
+
+} // namespace
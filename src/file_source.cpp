@@ -0,0 +1,278 @@
+#include "file_source.h"
+#include "raw_stream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace slitscan {
+
+FileSource::FileSource() :
+    data(NULL),
+    size(0),
+    pacing(PACE_FILE_RATE),
+    fixed_fps(0),
+    loop(true),
+    streaming(false),
+    next_frame(0),
+    frame_timestamp(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+FileSource::~FileSource()
+{
+    close();
+}
+
+bool FileSource::map(const std::string& path)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    // frames are read front to back
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    data = (const uint8_t*)mapping;
+    size = st.st_size;
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    fallback_data.resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    bool ok = !fallback_data.empty() && fread(&fallback_data[0], 1, fallback_data.size(), file) == fallback_data.size();
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+    data = &fallback_data[0];
+    size = fallback_data.size();
+#endif
+    return true;
+}
+
+bool FileSource::open(const std::string& path)
+{
+    if (!map(path)) {
+        return false;
+    }
+
+    if (size >= sizeof(RAW_STREAM_MAGIC) && memcmp(data, RAW_STREAM_MAGIC, sizeof(RAW_STREAM_MAGIC)) == 0) {
+        if (!indexRawStream()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    const char* text = (const char*)data;
+    const char* end = (const char*)memchr(text, '\n', size);
+    // frames are served as YUYV, which has no odd widths
+    if (!end || !format.parseY4MHeader(std::string(text, end)) || format.width % 2) {
+        close();
+        return false;
+    }
+
+    // index the frames once; every frame is "FRAME[ params]\n" followed by the samples
+    size_t frame_size = format.getFrameSize();
+    size_t pos = end - text + 1;
+    while (pos + 5 < size && memcmp(data + pos, "FRAME", 5) == 0) {
+        const uint8_t* eol = (const uint8_t*)memchr(data + pos, '\n', size - pos);
+        if (!eol) {
+            break;
+        }
+        pos = eol - data + 1;
+        if (pos + frame_size > size) {
+            break;
+        }
+        frame_offsets.push_back(pos);
+        pos += frame_size;
+    }
+    if (frame_offsets.empty()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool FileSource::indexRawStream()
+{
+    RawStreamHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    format.width = header.width;
+    format.height = header.height;
+    format.fps_num = header.fps_num;
+    format.fps_den = header.fps_den ? header.fps_den : 1;
+    format.pixel_format = VideoFormat::YUYV;
+    size_t frame_size = format.getFrameSize();
+    if (header.width % 2 || header.row_bytes != header.width * 2 || header.record_size < sizeof(RawStreamRecord) + frame_size) {
+        return false;
+    }
+
+    // stop at the first incomplete or damaged record, e.g. after a crash
+    for (size_t pos = header.header_size; pos + header.record_size <= size; pos += header.record_size) {
+        RawStreamRecord record;
+        memcpy(&record, data + pos, sizeof(record));
+        if (record.magic != RAW_RECORD_MAGIC || record.payload_size != frame_size) {
+            break;
+        }
+        frame_offsets.push_back(pos + sizeof(record));
+        frame_times.push_back(record.timestamp);
+    }
+    return !frame_offsets.empty();
+}
+
+bool FileSource::openRaw(const std::string& path, int width, int height, int fps_num, int fps_den)
+{
+    if (width % 2 || !map(path)) {
+        return false;
+    }
+    format.width = width;
+    format.height = height;
+    format.fps_num = fps_num;
+    format.fps_den = fps_den;
+    format.pixel_format = VideoFormat::YUYV;
+
+    size_t frame_size = format.getFrameSize();
+    for (size_t pos = 0; pos + frame_size <= size; pos += frame_size) {
+        frame_offsets.push_back(pos);
+    }
+    if (frame_offsets.empty()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void FileSource::close()
+{
+    stop();
+#ifndef _WIN32
+    if (data) {
+        munmap((void*)data, size);
+    }
+#endif
+    fallback_data.clear();
+    data = NULL;
+    size = 0;
+    frame_offsets.clear();
+    frame_times.clear();
+    next_frame = 0;
+}
+
+void FileSource::setPacing(Pacing val, double fps)
+{
+    pacing = val;
+    fixed_fps = fps;
+    next_deadline = std::chrono::steady_clock::now();
+}
+
+double FileSource::getFrameRate() const
+{
+    return pacing == PACE_FIXED_RATE ? fixed_fps : format.getFrameRate();
+}
+
+bool FileSource::start()
+{
+    if (frame_offsets.empty()) {
+        return false;
+    }
+    streaming = true;
+    next_deadline = std::chrono::steady_clock::now();
+    return true;
+}
+
+void FileSource::stop()
+{
+    streaming = false;
+}
+
+const uint8_t* FileSource::nextFrame()
+{
+    if (!streaming) {
+        return NULL;
+    }
+    if (next_frame >= frame_offsets.size()) {
+        if (!loop) {
+            return NULL;
+        }
+        next_frame = 0;
+    }
+
+    // pace like a camera would: block until the frame is due
+    double fps = getFrameRate();
+    if (pacing != PACE_UNTHROTTLED && fps > 0) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next_deadline > now) {
+            std::this_thread::sleep_until(next_deadline);
+        } else if (now - next_deadline > std::chrono::seconds(1)) {
+            // the consumer stalled; don't try to catch up with a burst of frames
+            next_deadline = now;
+        }
+        double interval = 1.0 / fps;
+        if (pacing == PACE_FILE_RATE && !frame_times.empty() && next_frame + 1 < frame_times.size()) {
+            // replay the recorded jitter and gaps, but not pauses longer than a second
+            interval = std::max(0.0, std::min(1.0, frame_times[next_frame + 1] - frame_times[next_frame]));
+        }
+        next_deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+    }
+
+    frame_timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    stats.frames_served++;
+    return data + frame_offsets[next_frame++];
+}
+
+uint8_t* FileSource::getFrame()
+{
+    const uint8_t* frame = nextFrame();
+    if (!frame) {
+        return NULL;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint8_t* copy = (uint8_t*)malloc(getRowBytes() * format.height);
+    format.toYUYV(frame, copy);
+    stats.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return copy;
+}
+
+const uint8_t* FileSource::acquireFrame()
+{
+    const uint8_t* frame = nextFrame();
+    if (!frame || format.pixel_format == VideoFormat::YUYV) {
+        return frame;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    converted.resize(getRowBytes() * format.height);
+    format.toYUYV(frame, &converted[0]);
+    stats.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return &converted[0];
+}
+
+} // namespace
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "frame_source.h"
+#include "y4m.h"
+
+namespace slitscan {
+
+// FrameSource that plays back a Y4M, raw YUYV or raw stream (see raw_stream.h) file. The file is memory-mapped,
+// so acquireFrame() serves YUYV frames without any copy (planar Y4M costs one
+// repacking to YUYV) and no read syscalls. Useful for reproducible benchmarks and soak tests on
+// machines without cameras.
+class FileSource : public FrameSource
+{
+public:
+    enum Pacing {
+        PACE_FILE_RATE,     // frame rate from the Y4M header (or the one given for raw files);
+                            // raw streams replay their recorded capture times
+        PACE_FIXED_RATE,    // frame rate passed to setPacing()
+        PACE_UNTHROTTLED    // as fast as the consumer asks
+    };
+
+    struct Stats {
+        uint64_t frames_served;
+        double busy_seconds;    // time spent copying/converting, excluding pacing sleeps
+    };
+
+    FileSource();
+    ~FileSource();
+
+    // frames are served as YUYV, so both fail on odd widths
+    bool open(const std::string& path);
+    bool openRaw(const std::string& path, int width, int height, int fps_num, int fps_den = 1);
+    void close();
+
+    void setPacing(Pacing pacing, double fps = 0);
+    // Loop back to the first frame at the end of the file (default), else getFrame() returns NULL
+    void setLoop(bool val) { loop = val; }
+
+    bool start();
+    void stop();
+    uint8_t* getFrame();
+    // YUYV files are served straight from the mapping, without any copy
+    const uint8_t* acquireFrame();
+    void releaseFrame() {}
+    double getFrameTimestamp() const { return frame_timestamp; }
+    uint64_t getFrameSequence() const { return stats.frames_served; }
+
+    uint32_t getWidth() const { return format.width; }
+    uint32_t getHeight() const { return format.height; }
+    uint32_t getRowBytes() const { return format.width * 2; }
+    double getFrameRate() const;
+
+    const VideoFormat& getFormat() const { return format; }
+    size_t getFrameCount() const { return frame_offsets.size(); }
+    const Stats& getStats() const { return stats; }
+
+private:
+    FileSource(const FileSource&);
+    void operator=(const FileSource&);
+
+    bool map(const std::string& path);
+    bool indexRawStream();
+    // paces, advances and returns the next frame in the file's own format, or NULL
+    const uint8_t* nextFrame();
+
+    VideoFormat format;
+    const uint8_t* data;
+    size_t size;
+    std::vector<uint8_t> fallback_data;  // platforms without mmap read the file instead
+    std::vector<size_t> frame_offsets;
+    std::vector<double> frame_times;    // capture times, for raw streams only
+
+    Pacing pacing;
+    double fixed_fps;
+    bool loop;
+    bool streaming;
+    size_t next_frame;
+    std::chrono::steady_clock::time_point next_deadline;
+    double frame_timestamp;
+    std::vector<uint8_t> converted;     // acquireFrame() buffer for planar files
+    Stats stats;
+};
+
+} // namespace
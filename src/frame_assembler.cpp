@@ -0,0 +1,151 @@
+#include "frame_assembler.h"
+#include "ps3eye.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace ps3eye {
+
+void FrameAssembler::frame_add(enum gspca_packet_type packet_type, const uint8_t *data, int len)
+{
+    if (packet_type == FIRST_PACKET) 
+    {
+        cur_frame_data_len = 0;
+        cur_frame_timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    } 
+    else
+    {
+        switch(last_packet_type)  // ignore warning.
+        {
+            case DISCARD_PACKET:
+                if (packet_type == LAST_PACKET) {
+                    last_packet_type = packet_type;
+                    cur_frame_data_len = 0;
+                }
+                return;
+            case LAST_PACKET:
+                return;
+            default:
+                break;
+        }
+    }
+
+    /* append the packet to the frame buffer */
+    if (len > 0)
+    {
+        if(cur_frame_data_len + len > frame_size)
+        {
+            stats.frames_discarded++;
+            stats.payloads_size_mismatch++;
+            packet_type = DISCARD_PACKET;
+            cur_frame_data_len = 0;
+        } else {
+            memcpy(cur_frame_start+cur_frame_data_len, data, len);
+            cur_frame_data_len += len;
+        }
+    }
+
+    last_packet_type = packet_type;
+
+    if (packet_type == LAST_PACKET) {        
+		cur_frame_data_len = 0;
+		uint64_t sequence = stats.frames_completed + 1;
+		uint8_t* next_frame_start = frame_queue->Enqueue(cur_frame_timestamp, sequence);
+		if (next_frame_start == cur_frame_start)
+		{
+			// the queue was full, this frame will be overwritten by the next
+			stats.frames_overwritten++;
+		}
+		cur_frame_start = next_frame_start;
+		stats.frames_completed = sequence;
+		// events after this belong to the next frame, which gets the next sequence number
+		SLITSCAN_PROFILE_FRAME(sequence + 1);
+        //debug("frame completed %d\n", frame_complete_ind);
+    }
+}
+
+void FrameAssembler::pkt_scan(const uint8_t *data, int len)
+{
+    uint32_t this_pts;
+    uint16_t this_fid;
+    int remaining_len = len;
+    int payload_len;
+
+    payload_len = 2048; // bulk type
+    stats.bytes_scanned += len;
+    do {
+		len = (std::min)(remaining_len, payload_len);
+
+        /* Payloads are prefixed with a UVC-style header.  We
+           consider a frame to start when the FID toggles, or the PTS
+           changes.  A frame ends when EOF is set, and we've received
+           the correct number of bytes. */
+
+        /* Verify UVC header.  Header length is always 12 */
+        if (data[0] != 12 || len < 12) {
+            debug("bad header\n");
+            stats.payloads_bad_header++;
+            goto discard;
+        }
+
+        /* Check errors */
+        if (data[1] & UVC_STREAM_ERR) {
+            debug("payload error\n");
+            stats.payloads_stream_error++;
+            goto discard;
+        }
+
+        /* Extract PTS and FID */
+        if (!(data[1] & UVC_STREAM_PTS)) {
+            debug("PTS not present\n");
+            stats.payloads_missing_pts++;
+            goto discard;
+        }
+
+        this_pts = (data[5] << 24) | (data[4] << 16) | (data[3] << 8) | data[2];
+        this_fid = (data[1] & UVC_STREAM_FID) ? 1 : 0;
+
+        /* If PTS or FID has changed, start a new frame. */
+        if (this_pts != last_pts || this_fid != last_fid) {
+            if (last_packet_type == INTER_PACKET)
+            {
+                // no EOF seen: queued as it is, missing its tail
+                stats.frames_incomplete++;
+                frame_add(LAST_PACKET, NULL, 0);
+            }
+            last_pts = this_pts;
+            last_fid = this_fid;
+            frame_add(FIRST_PACKET, data + 12, len - 12);
+        } /* If this packet is marked as EOF, end the frame */
+        else if (data[1] & UVC_STREAM_EOF) 
+        {
+            last_pts = 0;
+            if(cur_frame_data_len + len - 12 != frame_size)
+            {
+                stats.payloads_size_mismatch++;
+                goto discard;
+            }
+            frame_add(LAST_PACKET, data + 12, len - 12);
+        } else {
+            /* Add the data from this payload */
+            frame_add(INTER_PACKET, data + 12, len - 12);
+        }
+
+
+        /* Done this payload */
+        goto scan_next;
+
+discard:
+        /* Discard data until a new frame starts. */
+        if (last_packet_type == FIRST_PACKET || last_packet_type == INTER_PACKET)
+        {
+            stats.frames_discarded++;
+        }
+        frame_add(DISCARD_PACKET, NULL, 0);
+scan_next:
+        remaining_len -= len;
+        data += len;
+    } while (remaining_len > 0);
+}
+
+} // namespace
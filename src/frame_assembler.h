@@ -0,0 +1,245 @@
+#ifndef PS3EYE_FRAME_ASSEMBLER_H
+#define PS3EYE_FRAME_ASSEMBLER_H
+
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <vector>
+
+#include "profiler.h"
+
+// Frame assembly half of the PS3 Eye driver: parses the UVC-style bulk payloads
+// and queues the completed frames. Kept apart from the USB half so it can be
+// driven with synthetic payloads (tools/slitscan_bench) without libusb.
+
+namespace ps3eye {
+
+/* Values for bmHeaderInfo (Video and Still Image Payload Headers, 2.4.3.3) */
+#define UVC_STREAM_EOH	(1 << 7)
+#define UVC_STREAM_ERR	(1 << 6)
+#define UVC_STREAM_STI	(1 << 5)
+#define UVC_STREAM_RES	(1 << 4)
+#define UVC_STREAM_SCR	(1 << 3)
+#define UVC_STREAM_PTS	(1 << 2)
+#define UVC_STREAM_EOF	(1 << 1)
+#define UVC_STREAM_FID	(1 << 0)
+
+/* packet types when moving from iso buf to frame buf */
+enum gspca_packet_type {
+    DISCARD_PACKET,
+    FIRST_PACKET,
+    INTER_PACKET,
+    LAST_PACKET
+};
+
+class FrameQueue
+{
+public:
+	FrameQueue(uint32_t frame_size) :
+		frame_size			(frame_size),
+		num_frames			(2),
+		frame_buffer		((uint8_t*)malloc(frame_size * num_frames)),
+		timestamps			(num_frames, 0.0),
+		sequences			(num_frames, 0),
+		head				(0),
+		tail				(0),
+		available			(0)
+	{
+	}
+
+	~FrameQueue()
+	{
+		free(frame_buffer);
+	}
+
+	uint8_t* GetFrameBufferStart()
+	{
+		return frame_buffer;
+	}
+
+	// timestamp: host time (steady_clock seconds) of the frame's first USB packet
+	// sequence: the assembler's count of completed frames, this one included
+	uint8_t* Enqueue(double timestamp, uint64_t sequence)
+	{
+		uint8_t* new_frame = NULL;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		timestamps[head] = timestamp;
+		sequences[head] = sequence;
+
+		// Unlike traditional producer/consumer, we don't block the producer if the buffer is full (ie. the consumer is not reading data fast enough).
+		// Instead, if the buffer is full, we simply return the current frame pointer, causing the producer to overwrite the previous frame.
+		// This allows performance to degrade gracefully: if the consumer is not fast enough (< Camera FPS), it will miss frames, but if it is fast enough (>= Camera FPS), it will see everything.
+		//
+		// Note that because the the producer is writing directly to the ring buffer, we can only ever be a maximum of num_frames-1 ahead of the consumer, 
+		// otherwise the producer could overwrite the frame the consumer is currently reading (in case of a slow consumer)
+		if (available >= num_frames - 1)
+		{
+			return frame_buffer + head * frame_size;
+		}
+
+		// Note: we don't need to copy any data to the buffer since the USB packets are directly written to the frame buffer.
+		// We just need to update head and available count to signal to the consumer that a new frame is available
+		head = (head + 1) % num_frames;
+		available++;
+
+		// Determine the next frame pointer that the producer should write to
+		new_frame = frame_buffer + head * frame_size;
+
+		// Signal consumer that data became available
+		empty_condition.notify_one();
+
+		return new_frame;
+	}
+
+	uint8_t* Dequeue(double* timestamp = NULL, uint64_t* sequence = NULL)
+	{
+		uint8_t* new_frame = (uint8_t*)malloc(frame_size);
+		Dequeue(new_frame, timestamp, sequence);
+		return new_frame;
+	}
+
+	void Dequeue(uint8_t* new_frame, double* timestamp = NULL, uint64_t* sequence = NULL)
+	{
+		SLITSCAN_PROFILE_SCOPE(STAGE_FRAME_QUEUE);
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// If there is no data in the buffer, wait until data becomes available
+		empty_condition.wait(lock, [this] () { return available != 0; });
+		DequeueLocked(new_frame, timestamp, sequence);
+	}
+
+	// Same, but gives up after timeout; returns false if no frame came
+	bool Dequeue(uint8_t* new_frame, std::chrono::milliseconds timeout, double* timestamp = NULL, uint64_t* sequence = NULL)
+	{
+		SLITSCAN_PROFILE_SCOPE(STAGE_FRAME_QUEUE);
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!empty_condition.wait_for(lock, timeout, [this] () { return available != 0; }))
+		{
+			return false;
+		}
+		DequeueLocked(new_frame, timestamp, sequence);
+		return true;
+	}
+
+private:
+	// takes the frame at tail; the caller holds mutex and has checked available
+	void DequeueLocked(uint8_t* new_frame, double* timestamp, uint64_t* sequence)
+	{
+		// Copy from internal buffer
+		uint8_t* source = frame_buffer + frame_size * tail;
+		memcpy(new_frame, source, frame_size);
+		if (timestamp)
+		{
+			*timestamp = timestamps[tail];
+		}
+		if (sequence)
+		{
+			*sequence = sequences[tail];
+		}
+		// the wait and copy belong to the frame they deliver
+		SLITSCAN_PROFILE_FRAME(sequences[tail]);
+
+		// Update tail and available count
+		tail = (tail + 1) % num_frames;
+		available--;
+	}
+
+	uint32_t				frame_size;
+	uint32_t				num_frames;
+
+	uint8_t*				frame_buffer;
+	std::vector<double>		timestamps;
+	std::vector<uint64_t>	sequences;
+	uint32_t				head;
+	uint32_t				tail;
+	uint32_t				available;
+
+	std::mutex				mutex;
+	std::condition_variable	empty_condition;
+};
+
+// Written by the USB thread only, safe to read from any thread
+struct FrameAssemblerStats
+{
+	FrameAssemblerStats() :
+		frames_completed		(0),
+		frames_incomplete		(0),
+		frames_discarded		(0),
+		frames_overwritten		(0),
+		payloads_bad_header		(0),
+		payloads_stream_error	(0),
+		payloads_missing_pts	(0),
+		payloads_size_mismatch	(0),
+		bytes_scanned			(0)
+	{
+	}
+
+	std::atomic<uint64_t>	frames_completed;		// queued, including incomplete ones
+	std::atomic<uint64_t>	frames_incomplete;		// cut short by a new FID/PTS before their EOF, queued anyway
+	std::atomic<uint64_t>	frames_discarded;		// dropped after a bad payload or with the wrong size
+	std::atomic<uint64_t>	frames_overwritten;		// queued while the queue was full: the consumer never saw the previous one
+	std::atomic<uint64_t>	payloads_bad_header;
+	std::atomic<uint64_t>	payloads_stream_error;	// UVC_STREAM_ERR set
+	std::atomic<uint64_t>	payloads_missing_pts;
+	std::atomic<uint64_t>	payloads_size_mismatch;	// EOF at the wrong frame size, or more data than a frame holds
+	std::atomic<uint64_t>	bytes_scanned;
+};
+
+// Reassembles frames from the bulk transfer payloads of one camera, writing
+// them straight into frame_queue's buffers
+class FrameAssembler
+{
+public:
+	FrameAssembler() :
+		last_packet_type		(DISCARD_PACKET),
+		last_pts				(0),
+		last_fid				(0),
+		cur_frame_start			(NULL),
+		cur_frame_data_len		(0),
+		frame_size				(0),
+		frame_queue				(NULL),
+		cur_frame_timestamp		(0)
+	{
+	}
+
+	// Starts assembling into queue (which must hold frames of curr_frame_size)
+	void start(FrameQueue* queue, uint32_t curr_frame_size)
+	{
+		frame_queue = queue;
+		frame_size = curr_frame_size;
+		cur_frame_start = frame_queue->GetFrameBufferStart();
+		cur_frame_data_len = 0;
+		last_packet_type = DISCARD_PACKET;
+		last_pts = 0;
+		last_fid = 0;
+	}
+
+	// Parses one completed bulk transfer: a sequence of payloads of up to
+	// 2048 bytes, each with a 12 byte header
+	void pkt_scan(const uint8_t *data, int len);
+
+	const FrameAssemblerStats& get_stats() const { return stats; }
+
+private:
+	void frame_add(enum gspca_packet_type packet_type, const uint8_t *data, int len);
+
+	enum gspca_packet_type	last_packet_type;
+	uint32_t				last_pts;
+	uint16_t				last_fid;
+
+	uint8_t*				cur_frame_start;
+	uint32_t				cur_frame_data_len;
+	uint32_t				frame_size;
+	FrameQueue*				frame_queue;
+	double					cur_frame_timestamp;	// when its first packet was scanned
+	FrameAssemblerStats		stats;
+};
+
+} // namespace
+
+#endif
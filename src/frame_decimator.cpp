@@ -0,0 +1,31 @@
+#include "frame_decimator.h"
+
+#include <algorithm>
+
+#include "yuv.h"
+
+namespace slitscan {
+
+FrameDecimator::FrameDecimator(int width, int height, int factor) :
+    width(width),
+    height(height),
+    factor((std::min)((std::max)(factor, 2), (int)MAX_FACTOR)),
+    count(0),
+    accumulator((size_t)width * height * 2),
+    average((size_t)width * height * 2)
+{
+}
+
+const uint8_t* FrameDecimator::addFrame(const uint8_t* yuyv, int stride)
+{
+    if (count + 1 < factor) {
+        yuyv_accumulate(yuyv, stride, accumulator.data(), width, height, count == 0);
+        count++;
+        return NULL;
+    }
+    yuyv_accumulate_average(yuyv, stride, accumulator.data(), factor, average.data(), width, height);
+    count = 0;
+    return average.data();
+}
+
+} // namespace
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace slitscan {
+
+// Averages every factor consecutive YUYV frames into one, for a history that
+// spans factor times longer with motion blur instead of aliasing. Frames only
+// pass through 16-bit accumulators (see yuyv_accumulate), so the frames in
+// between cost a single add pass, and no conversion or history write.
+class FrameDecimator
+{
+public:
+    static const int MAX_FACTOR = 256;
+
+    // factor in [2, MAX_FACTOR]
+    FrameDecimator(int width, int height, int factor);
+
+    // Adds a frame; returns the average of the last factor frames (YUYV,
+    // getRowBytes() per row, valid until the next call) when this one
+    // completes it, else NULL
+    const uint8_t* addFrame(const uint8_t* yuyv, int stride);
+    // Starts over, dropping the frames summed so far
+    void reset() { count = 0; }
+
+    int getFactor() const { return factor; }
+    int getRowBytes() const { return width * 2; }
+
+private:
+    int width;
+    int height;
+    int factor;
+    int count;      // frames in accumulator
+    std::vector<uint16_t> accumulator;
+    std::vector<uint8_t> average;
+};
+
+} // namespace
@@ -0,0 +1,40 @@
+#include "frame_history.h"
+
+#include <cstring>
+
+namespace slitscan {
+
+FrameHistory::FrameHistory(int width, int height, int frames) :
+    width(width),
+    height(height),
+    frames(frames),
+    layer_index(0),
+    layer_size((size_t)width * height * 3),
+    data(layer_size * frames + 4, 0)
+{
+}
+
+void FrameHistory::pushRGBA(const uint8_t* rgba, int stride)
+{
+    layer_index = (layer_index + 1) % frames;
+    uint8_t* dst = getLayer(layer_index);
+    for (int y = 0; y < height; y++, rgba += stride) {
+        const uint8_t* src = rgba;
+        for (int x = 0; x < width; x++, src += 4, dst += 3) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+    }
+}
+
+void FrameHistory::pushRGB(const uint8_t* rgb, int stride)
+{
+    layer_index = (layer_index + 1) % frames;
+    uint8_t* dst = getLayer(layer_index);
+    for (int y = 0; y < height; y++, rgb += stride, dst += width * 3) {
+        memcpy(dst, rgb, width * 3);
+    }
+}
+
+} // namespace
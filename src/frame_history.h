@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace slitscan {
+
+// CPU-side copy of the time volume: a ring of frames RGB layers, laid out like
+// the GL_RGB8 3D texture in ofApp (layer-major, then rows, then pixels).
+class FrameHistory
+{
+public:
+    FrameHistory(int width, int height, int frames);
+
+    // Advance the ring and store a new frame as the newest layer.
+    // src is packed RGBA (as produced by yuv422_to_rgba) or RGB rows.
+    void pushRGBA(const uint8_t* rgba, int stride);
+    void pushRGB(const uint8_t* rgb, int stride);
+
+    const uint8_t* getLayer(int index) const { return &data[(size_t)index * layer_size]; }
+    uint8_t* getLayer(int index) { return &data[(size_t)index * layer_size]; }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getFrames() const { return frames; }
+    size_t getLayerSize() const { return layer_size; }
+
+    // Index of the most recently written layer, same meaning as ofApp::layerIndex
+    int getLayerIndex() const { return layer_index; }
+    void setLayerIndex(int index) { layer_index = index; }
+
+    // Z texture coordinate of the newest/oldest layer, as used by ofApp::draw()
+    float getNewestOffset() const { return layer_index / (float)frames; }
+    float getOldestOffset() const { return (layer_index + 1) / (float)frames; }
+
+private:
+    int width;
+    int height;
+    int frames;
+    int layer_index;
+    size_t layer_size;
+    // padded by a few bytes so samplers may read a whole 32-bit word at the last texel
+    std::vector<uint8_t> data;
+};
+
+} // namespace
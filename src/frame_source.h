@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdlib>
+
+namespace slitscan {
+
+// A source of YUYV (YUV422) frames with the same contract as PS3EYECam::getFrame,
+// so files, other capture APIs and the PS3 Eye all feed the same conversion and
+// history code in ofApp::update().
+class FrameSource
+{
+public:
+    FrameSource() : acquired(NULL) {}
+    virtual ~FrameSource() {}
+
+    virtual bool start() = 0;
+    virtual void stop() = 0;
+
+    // Get a frame from the source. Notes:
+    // - If there is no frame available, this function will block until one is
+    // - The returned frame is a malloc'd copy; you must free() it yourself when done with it
+    // - Returns NULL if the source has ended or failed
+    virtual uint8_t* getFrame() = 0;
+
+    // Zero-copy variant of getFrame(): the returned frame stays valid until
+    // releaseFrame(). Sources that can hand out their own buffers (mmap'd files,
+    // V4L2 streaming buffers) override these; the default wraps getFrame().
+    virtual const uint8_t* acquireFrame() { return acquired = getFrame(); }
+    virtual void releaseFrame() { free(acquired); acquired = NULL; }
+
+    // Capture time of the last frame in seconds on std::chrono::steady_clock
+    // (CLOCK_MONOTONIC on Linux), or 0 if the source doesn't know
+    virtual double getFrameTimestamp() const { return 0; }
+    // Sequence number of the last frame as counted where it was captured (the
+    // PS3 Eye's frame assembler, the V4L2 driver, the camera ring's publisher),
+    // or 0 if the source doesn't count
+    virtual uint64_t getFrameSequence() const { return 0; }
+
+    virtual uint32_t getWidth() const = 0;
+    virtual uint32_t getHeight() const = 0;
+    virtual uint32_t getRowBytes() const = 0;
+    virtual double getFrameRate() const = 0;
+
+private:
+    uint8_t* acquired;
+};
+
+} // namespace
@@ -0,0 +1,278 @@
+#include "history_snapshot.h"
+
+#include <cstring>
+#include <chrono>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace slitscan {
+
+static const char SNAPSHOT_MAGIC[8] = { 'S', 'L', 'I', 'T', 'H', 'I', 'S', '2' };
+
+// FNV-1a over 64-bit words: cheap enough to run on every stored layer, and
+// good enough to tell a torn or stale layer from the one that was recorded
+static uint64_t layer_hash(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+HistorySnapshot::HistorySnapshot(size_t queue_layers) :
+    queue_layers(queue_layers),
+    data(NULL),
+    size(0),
+    header_size(0),
+    layer_size(0),
+    frames(0),
+    restorable(false),
+    restored_layer_index(0),
+    checkpoint_interval(2.0),
+    closing(false),
+    newest_layer(-1),
+    newest_sequence(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+HistorySnapshot::~HistorySnapshot()
+{
+    close();
+}
+
+#ifndef _WIN32
+
+bool HistorySnapshot::open(const std::string& path, int width, int height, int num_frames)
+{
+    close();
+    layer_size = (size_t)width * height * 3;
+    frames = num_frames;
+    header_size = (sizeof(Header) + sizeof(LayerInfo) * frames + HEADER_ALIGN - 1) / HEADER_ALIGN * HEADER_ALIGN;
+    size = header_size + layer_size * frames;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool same_size = fstat(fd, &st) == 0 && (size_t)st.st_size == size;
+    if (!same_size && ftruncate(fd, size) != 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data = (uint8_t*)mapping;
+
+    Header* header = (Header*)data;
+    restorable = same_size && memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->width == (uint32_t)width && header->height == (uint32_t)height &&
+                 header->frames == (uint32_t)frames && header->bytes_per_pixel == 3 &&
+                 header->valid && header->layer_index < (uint32_t)frames;
+    restored_layer_index = restorable ? header->layer_index : 0;
+    uint64_t discarded = 0;
+    if (restorable) {
+        discarded = discardUncommitted();
+    } else {
+        // a fresh or foreign file: start over, all black
+        memset(data, 0, header_size);
+        memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+        header->width = width;
+        header->height = height;
+        header->frames = frames;
+        header->bytes_per_pixel = 3;
+        if (same_size) {
+            memset(data + header_size, 0, layer_size * frames);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        memset(&stats, 0, sizeof(stats));
+        stats.layers_discarded = discarded;
+    }
+
+    pool.assign(queue_layers, std::vector<uint8_t>(layer_size));
+    free_buffers.clear();
+    for (size_t i = 0; i < pool.size(); i++) {
+        free_buffers.push_back(&pool[i][0]);
+    }
+    queued.clear();
+    dirty.assign(frames, false);
+    newest_layer = -1;
+    // sequences keep counting from the checkpoint, so they stay comparable with it
+    newest_sequence = header->sequence;
+    closing = false;
+    worker = std::thread(&HistorySnapshot::workerLoop, this);
+    return true;
+}
+
+void HistorySnapshot::close()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+    if (data) {
+        munmap(data, size);
+        data = NULL;
+    }
+}
+
+uint64_t HistorySnapshot::discardUncommitted()
+{
+    const Header* header = (const Header*)data;
+    LayerInfo* info = getLayerInfo();
+    uint64_t discarded = 0;
+    for (int i = 0; i < frames; i++) {
+        uint8_t* layer = data + header_size + layer_size * i;
+        if (info[i].sequence == 0) {
+            continue;   // never written, still black
+        }
+        if (info[i].sequence <= header->sequence && layer_hash(layer, layer_size) == info[i].hash) {
+            continue;
+        }
+        memset(layer, 0, layer_size);
+        info[i].sequence = 0;
+        discarded++;
+    }
+    return discarded;
+}
+
+void HistorySnapshot::checkpoint()
+{
+    if (newest_layer < 0) {
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t flushed = 0;
+    for (int i = 0; i < frames; i++) {
+        if (!dirty[i]) {
+            continue;
+        }
+        // msync wants a page-aligned start
+        size_t begin = header_size + layer_size * i;
+        size_t aligned = begin / page * page;
+        msync(data + aligned, begin + layer_size - aligned, MS_SYNC);
+        dirty[i] = false;
+        flushed++;
+    }
+    // only now point the header at the new layers; the layer table goes along,
+    // and restoring checks it against the layers anyway
+    Header* header = (Header*)data;
+    header->layer_index = newest_layer;
+    header->sequence = newest_sequence;
+    header->valid = 1;
+    header->checkpoints++;
+    msync(data, header_size, MS_SYNC);
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.checkpoints++;
+    stats.layers_flushed += flushed;
+    stats.last_checkpoint_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+#else
+
+bool HistorySnapshot::open(const std::string&, int, int, int) { return false; }
+void HistorySnapshot::close() {}
+void HistorySnapshot::checkpoint() {}
+
+#endif
+
+uint8_t* HistorySnapshot::acquireLayer()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_buffers.empty()) {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex);
+        stats.layers_dropped++;
+        return NULL;
+    }
+    uint8_t* buffer = free_buffers.back();
+    free_buffers.pop_back();
+    return buffer;
+}
+
+void HistorySnapshot::submitLayer(uint8_t* buffer, int layer)
+{
+    Layer item = { buffer, layer };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(item);
+    }
+    wake.notify_one();
+}
+
+void HistorySnapshot::workerLoop()
+{
+    std::chrono::steady_clock::time_point next_checkpoint = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(checkpoint_interval));
+    for (;;) {
+        Layer item = { NULL, 0 };
+        bool stop = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_until(lock, next_checkpoint, [this] () { return closing || !queued.empty(); });
+            if (!queued.empty()) {
+                item = queued.front();
+                queued.pop_front();
+            } else {
+                stop = closing;
+            }
+        }
+
+        if (item.buffer) {
+            // hashed from our own buffer, not the mapping; a crash may leave the
+            // entry and the layer disagreeing, which restoring catches
+            LayerInfo& info = getLayerInfo()[item.layer];
+            info.sequence = ++newest_sequence;
+            info.hash = layer_hash(item.buffer, layer_size);
+            memcpy(data + header_size + layer_size * item.layer, item.buffer, layer_size);
+            dirty[item.layer] = true;
+            newest_layer = item.layer;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_buffers.push_back(item.buffer);
+            }
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.layers_stored++;
+        }
+
+        if (stop || std::chrono::steady_clock::now() >= next_checkpoint) {
+            checkpoint();
+            next_checkpoint = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(checkpoint_interval));
+        }
+        if (stop) {
+            break;
+        }
+    }
+}
+
+HistorySnapshot::Stats HistorySnapshot::getStats() const
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
+
+} // namespace
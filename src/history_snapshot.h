@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace slitscan {
+
+// Keeps a copy of the history volume in a memory-mapped file so a restarted
+// app can pick up where it left off. The file is a header (with a sequence
+// number and hash per layer), padded to whole pages, followed by the layers,
+// packed RGB, in exactly the layout glTexImage3D takes.
+//
+// The render thread hands over each newly written layer; a background thread
+// copies it into the mapping and, every checkpoint interval, flushes only the
+// layers that changed since the last checkpoint before committing the newest
+// layer index to the header. Layers copied in after the last checkpoint may
+// reach the file before a crash, whole or in part; restoring clears every layer
+// newer than the checkpoint or not matching its hash. A crash loses at most one
+// interval of frames (which show black after the restart).
+class HistorySnapshot
+{
+public:
+    struct Stats {
+        uint64_t layers_stored;
+        uint64_t layers_dropped;    // the background thread was behind
+        uint64_t checkpoints;
+        uint64_t layers_flushed;    // summed over all checkpoints
+        uint64_t layers_discarded;  // by open(): written after the last checkpoint, or torn
+        double last_checkpoint_ms;
+    };
+
+    // queue_layers bounds the layers waiting to be copied into the mapping
+    explicit HistorySnapshot(size_t queue_layers = 8);
+    ~HistorySnapshot();
+
+    // Maps (creating or resizing if needed) a snapshot file for a history of
+    // this size. A matching, previously checkpointed file becomes restorable.
+    bool open(const std::string& path, int width, int height, int frames);
+    // Writes out pending layers, checkpoints and unmaps
+    void close();
+    bool isOpen() const { return data != NULL; }
+
+    void setCheckpointInterval(double seconds) { checkpoint_interval = seconds; }
+
+    // State as of the last checkpoint before open(); only meaningful until
+    // the first submitLayer()
+    bool isRestorable() const { return restorable; }
+    const uint8_t* getLayers() const { return data + header_size; }
+    int getLayerIndex() const { return restored_layer_index; }
+
+    size_t getLayerSize() const { return layer_size; }
+    // Returns a free getLayerSize() buffer, or NULL (counted as dropped) if the
+    // background thread is behind
+    uint8_t* acquireLayer();
+    // Queues a buffer from acquireLayer() as the new contents of layer, which
+    // is now the newest one
+    void submitLayer(uint8_t* buffer, int layer);
+
+    Stats getStats() const;
+
+private:
+    HistorySnapshot(const HistorySnapshot&);
+    void operator=(const HistorySnapshot&);
+
+    static const size_t HEADER_ALIGN = 4096;   // layers start on a page boundary
+
+    struct Header {
+        char magic[8];
+        uint32_t width;
+        uint32_t height;
+        uint32_t frames;
+        uint32_t bytes_per_pixel;
+        uint32_t layer_index;       // newest layer as of the last checkpoint
+        uint32_t valid;             // set by the first checkpoint
+        uint64_t checkpoints;
+        uint64_t sequence;          // of the newest layer as of the last checkpoint
+    };
+
+    // one per layer, right after the Header
+    struct LayerInfo {
+        uint64_t sequence;          // counts layers over the file's lifetime; 0 never written
+        uint64_t hash;              // of the layer's contents
+    };
+
+    struct Layer {
+        uint8_t* buffer;
+        int layer;
+    };
+
+    void workerLoop();
+    void checkpoint();
+    LayerInfo* getLayerInfo() { return (LayerInfo*)(data + sizeof(Header)); }
+    // clears the layers a checkpoint doesn't vouch for; returns how many
+    uint64_t discardUncommitted();
+
+    size_t queue_layers;
+    uint8_t* data;
+    size_t size;
+    size_t header_size;
+    size_t layer_size;
+    int frames;
+    bool restorable;
+    int restored_layer_index;
+    double checkpoint_interval;
+
+    // handoff between the render thread and the worker
+    std::vector<std::vector<uint8_t> > pool;
+    std::vector<uint8_t*> free_buffers;
+    std::deque<Layer> queued;
+    bool closing;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+
+    // worker state
+    std::vector<bool> dirty;
+    int newest_layer;
+    uint64_t newest_sequence;
+
+    mutable std::mutex stats_mutex;
+    Stats stats;
+};
+
+} // namespace
@@ -1,13 +1,62 @@
 #include "ofMain.h"
 #include "ofApp.h"
 
+static void usage(){
+	fprintf(stderr, "usage: RealTimeSlitScan [--input file.y4m] [--raw WxH] [--fps N] [--unthrottled] [--device /dev/videoN] [--record out.y4m|out.rgb] [--record-raw camera.slitraw] [--snapshot history.snapshot] [--frames N] [--decimate N] [--pyramid N] [--cold-after N] [--change-threshold T] [--publish name] [--camera-ring name] [--panorama dir] [--latency] [--latency-loopback]\n");
+}
+
 //========================================================================
-int main( ){
+int main(int argc, char** argv){
+	ofApp::Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--input" && i + 1 < argc) {
+			options.inputPath = argv[++i];
+		} else if (arg == "--raw" && i + 1 < argc) {
+			sscanf(argv[++i], "%dx%d", &options.rawWidth, &options.rawHeight);
+		} else if (arg == "--fps" && i + 1 < argc) {
+			options.fps = atof(argv[++i]);
+		} else if (arg == "--unthrottled") {
+			options.unthrottled = true;
+		} else if (arg == "--device" && i + 1 < argc) {
+			options.devicePath = argv[++i];
+		} else if (arg == "--record" && i + 1 < argc) {
+			options.recordPath = argv[++i];
+		} else if (arg == "--record-raw" && i + 1 < argc) {
+			options.recordRawPath = argv[++i];
+		} else if (arg == "--snapshot" && i + 1 < argc) {
+			options.snapshotPath = argv[++i];
+		} else if (arg == "--publish" && i + 1 < argc) {
+			options.publishName = argv[++i];
+		} else if (arg == "--camera-ring" && i + 1 < argc) {
+			options.cameraRing = argv[++i];
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frames = atoi(argv[++i]);
+		} else if (arg == "--decimate" && i + 1 < argc) {
+			options.decimation = atoi(argv[++i]);
+		} else if (arg == "--pyramid" && i + 1 < argc) {
+			options.pyramidLevels = atoi(argv[++i]);
+		} else if (arg == "--cold-after" && i + 1 < argc) {
+			options.coldAfter = atoi(argv[++i]);
+		} else if (arg == "--change-threshold" && i + 1 < argc) {
+			options.changeThreshold = atof(argv[++i]);
+		} else if (arg == "--panorama" && i + 1 < argc) {
+			options.panoramaPath = argv[++i];
+		} else if (arg == "--latency") {
+			options.latency = true;
+		} else if (arg == "--latency-loopback") {
+			options.latencyLoopback = true;
+		} else if (arg.compare(0, 5, "-psn_") != 0) { // macOS adds a process serial number when launched from Finder
+			usage();
+			return 1;
+		}
+	}
+
 	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(new ofApp(options));
 
 }
@@ -3,7 +3,36 @@
 
 static const int WIDTH = 640;
 static const int HEIGHT = 480;
-static const int FRAMES = 256;
+// strip history: over a minute at 60 fps, 7.9 MB for a 640 pixel slit
+static const int STRIP_FRAMES = 4096;
+// change gate ('g'): a little above the PS3 Eye's sensor noise in a lit room
+static const float DEFAULT_CHANGE_THRESHOLD = 4;
+// temporal pyramid ('m'): 8x the history's span for 3x its memory
+static const int DEFAULT_PYRAMID_LEVELS = 3;
+
+// --latency-loopback: one white frame a second, at a rate any display keeps up with
+static const int LOOPBACK_WIDTH = 160;
+static const int LOOPBACK_HEIGHT = 120;
+static const int LOOPBACK_FPS = 60;
+// the newest layer is blended half and half with the one before it, so a
+// flash shows at about 50% on screen
+static const int FLASH_THRESHOLD = 64;
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// "p50 / p95 / p99 / max ms, n samples" of a histogram in ns
+static std::string describeLatency(const slitscan::LatencyHistogram& histogram)
+{
+    std::ostringstream text;
+    text << ofToString(histogram.getPercentile(0.5) / 1e6, 1) << " / "
+         << ofToString(histogram.getPercentile(0.95) / 1e6, 1) << " / "
+         << ofToString(histogram.getPercentile(0.99) / 1e6, 1) << " / "
+         << ofToString(histogram.getMax() / 1e6, 1) << " ms, " << histogram.getCount() << " samples";
+    return text.str();
+}
 
 static void checkOpenGLError(const char* stmt, const char* fname, int line)
 {
@@ -23,62 +52,110 @@ CheckOpenGLError(#stmt, __FILE__, __LINE__); \
 #define GL_CHECK(stmt) stmt
 #endif
 
-static const int ITUR_BT_601_CY = 1220542;
-static const int ITUR_BT_601_CUB = 2116026;
-static const int ITUR_BT_601_CUG = -409993;
-static const int ITUR_BT_601_CVG = -852492;
-static const int ITUR_BT_601_CVR = 1673527;
-static const int ITUR_BT_601_SHIFT = 20;
+// Per-pixel time mapping: instead of interpolating the time coordinate between
+// grid vertices, look it up in the cached per-pixel time table so the result is
+// exact regardless of tessellation. Sticks to GLSL 1.20 so it also runs on
+// software implementations (e.g. Mesa llvmpipe).
+static const char* timeMapVertexShader = R"(
+#version 120
+varying vec2 texCoord;
+void main() {
+    texCoord = gl_MultiTexCoord0.xy;
+    gl_Position = ftransform();
+}
+)";
 
+static const char* timeMapFragmentShader = R"(
+#version 120
+uniform sampler3D history;
+uniform sampler2D timeTable;
+uniform float offset;
+varying vec2 texCoord;
+void main() {
+    float s = texture2D(timeTable, texCoord).r + offset;
+    gl_FragColor = vec4(texture3D(history, vec3(texCoord, s)).rgb, 1.0);
+}
+)";
 
-static void yuv422_to_rgba(const uint8_t *yuv_src, const int stride, uint8_t *dst, const int width, const int height)
-{
-    const int bIdx = 2;
-    const int uIdx = 0;
-    const int yIdx = 0;
-    
-    const int uidx = 1 - yIdx + uIdx * 2;
-    const int vidx = (2 + uidx) % 4;
-    int j, i;
-    
-#define _max(a, b) (((a) > (b)) ? (a) : (b))
-#define _saturate(v) static_cast<uint8_t>(static_cast<uint32_t>(v) <= 0xff ? v : v > 0 ? 0xff : 0)
-    
-    for (j = 0; j < height; j++, yuv_src += stride)
-    {
-        uint8_t* row = dst + (width * 4) * j; // 4 channels
-        
-        for (i = 0; i < 2 * width; i += 4, row += 8)
-        {
-            int u = static_cast<int>(yuv_src[i + uidx]) - 128;
-            int v = static_cast<int>(yuv_src[i + vidx]) - 128;
-            
-            int ruv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVR * v;
-            int guv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVG * v + ITUR_BT_601_CUG * u;
-            int buv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CUB * u;
-            
-            int y00 = _max(0, static_cast<int>(yuv_src[i + yIdx]) - 16) * ITUR_BT_601_CY;
-            row[2 - bIdx] = _saturate((y00 + ruv) >> ITUR_BT_601_SHIFT);
-            row[1] = _saturate((y00 + guv) >> ITUR_BT_601_SHIFT);
-            row[bIdx] = _saturate((y00 + buv) >> ITUR_BT_601_SHIFT);
-            row[3] = (0xff);
-            
-            int y01 = _max(0, static_cast<int>(yuv_src[i + yIdx + 2]) - 16) * ITUR_BT_601_CY;
-            row[6 - bIdx] = _saturate((y01 + ruv) >> ITUR_BT_601_SHIFT);
-            row[5] = _saturate((y01 + guv) >> ITUR_BT_601_SHIFT);
-            row[4 + bIdx] = _saturate((y01 + buv) >> ITUR_BT_601_SHIFT);
-            row[7] = (0xff);
+// Same for the strip history: one slit per texture row, sampled along x for a
+// row slit and along y for a column slit
+static const char* stripFragmentShader = R"(
+#version 120
+uniform sampler2D strips;
+uniform sampler2D timeTable;
+uniform float offset;
+uniform float alongX;
+varying vec2 texCoord;
+void main() {
+    float s = texture2D(timeTable, texCoord).r + offset;
+    float p = mix(texCoord.y, texCoord.x, alongX);
+    gl_FragColor = vec4(texture2D(strips, vec2(p, s)).rgb, 1.0);
+}
+)";
+
+// Through the temporal pyramid: the time table spans all levels, and each pixel
+// samples the finest level that still holds its time, as PyramidLayout::locate()
+// does. GLSL 1.20 can't index samplers, hence the chain; the uniform arrays hold
+// the base and MAX_PYRAMID_LEVELS coarse levels.
+static const char* pyramidFragmentShader = R"(
+#version 120
+uniform sampler3D history;
+uniform sampler3D level1;
+uniform sampler3D level2;
+uniform sampler3D level3;
+uniform sampler3D level4;
+uniform sampler2D timeTable;
+uniform int levels;
+uniform float span;
+uniform float maxAge[5];
+uniform float bias[5];
+uniform float scale[5];
+uniform float offset[5];
+varying vec2 texCoord;
+void main() {
+    float age = 0.5 - texture2D(timeTable, texCoord).r * span;
+    int level = 0;
+    for (int k = 0; k < 4; k++) {
+        if (level == k && k < levels && age > maxAge[k]) {
+            level = k + 1;
         }
     }
+    vec3 coord = vec3(texCoord, offset[level] + bias[level] - age * scale[level]);
+    vec3 color;
+    if (level == 0) {
+        color = texture3D(history, coord).rgb;
+    } else if (level == 1) {
+        color = texture3D(level1, coord).rgb;
+    } else if (level == 2) {
+        color = texture3D(level2, coord).rgb;
+    } else if (level == 3) {
+        color = texture3D(level3, coord).rgb;
+    } else {
+        color = texture3D(level4, coord).rgb;
+    }
+    gl_FragColor = vec4(color, 1.0);
 }
+)";
 
+// Writes a coarse pyramid layer: the average of two layers of the level below,
+// sampled at texel centres
+static const char* pyramidAverageShader = R"(
+#version 120
+uniform sampler3D history;
+uniform float z0;
+uniform float z1;
+varying vec2 texCoord;
+void main() {
+    vec3 a = texture3D(history, vec3(texCoord, z0)).rgb;
+    vec3 b = texture3D(history, vec3(texCoord, z1)).rgb;
+    gl_FragColor = vec4((a + b) * 0.5, 1.0);
+}
+)";
 
-//--------------------------------------------------------------
-void ofApp::setup(){
-    ofSetLogLevel(OF_LOG_VERBOSE);
-    
-    layerIndex = 0;
-    
+// A history volume of frames WIDTH x HEIGHT RGB layers, wrapped in an ofTexture
+// so ofFbo can render into its layers; zeroed unless data is given
+static void allocateHistoryTexture(ofTexture& texture, int frames, const void* data)
+{
     // generate 3d texture: openframeworks is 2d-texture-only
     GLuint texture3d;
     glEnable(GL_TEXTURE_3D);
@@ -92,14 +169,17 @@ void ofApp::setup(){
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     
-    // load data to the texture, set its resolution etc.
-    unsigned char * texData = new unsigned char[WIDTH*HEIGHT*FRAMES*3];
-    memset(texData, 0, WIDTH*HEIGHT*FRAMES*3);
-    
-    // NOTE: won't work without npot support
-    GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, WIDTH, HEIGHT, FRAMES, 0, GL_RGB, GL_UNSIGNED_BYTE, texData));
+    if (data) {
+        GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, WIDTH, HEIGHT, frames, 0, GL_RGB, GL_UNSIGNED_BYTE, data));
+    } else {
+        unsigned char * texData = new unsigned char[(size_t)WIDTH*HEIGHT*frames*3];
+        memset(texData, 0, (size_t)WIDTH*HEIGHT*frames*3);
+        
+        // NOTE: won't work without npot support
+        GL_CHECK(glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, WIDTH, HEIGHT, frames, 0, GL_RGB, GL_UNSIGNED_BYTE, texData));
+        delete[] texData;
+    }
     glDisable(GL_TEXTURE_3D);
-    delete[] texData;
     
     // create an openframeworks texture object to wrap the texture id we created
     ofTextureData settings;
@@ -108,15 +188,111 @@ void ofApp::setup(){
     settings.tex_w = settings.tex_t = WIDTH;
     settings.tex_h = settings.tex_u = HEIGHT;
     settings.textureTarget = GL_TEXTURE_3D;
-    cameraOutput.allocate(settings);
-    cameraOutput.setUseExternalTextureID(texture3d);
+    texture.allocate(settings);
+    texture.setUseExternalTextureID(texture3d);
+}
+
+static void freeHistoryTexture(ofTexture& texture)
+{
+    if (texture.isAllocated()) {
+        // setUseExternalTextureID() leaves deleting it to us
+        GLuint id = texture.getTextureData().textureID;
+        glDeleteTextures(1, &id);
+        texture.clear();
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::setup(){
+    ofSetLogLevel(OF_LOG_VERBOSE);
+    SLITSCAN_PROFILE_THREAD("main");
+    
+    layerIndex = 0;
+    
+    // the history's length in layers is only limited by GL (and memory: 0.9 MB a layer)
+    GLint maxFrames = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxFrames);
+    historyFrames = (std::max)(2, options.frames);
+    if (maxFrames > 0 && historyFrames > maxFrames) {
+        ofLogWarning() << "History limited to " << maxFrames << " frames by GL_MAX_3D_TEXTURE_SIZE";
+        historyFrames = maxFrames;
+    }
+    
+    // load data to the texture, set its resolution etc.
+    if (!options.snapshotPath.empty()) {
+        snapshot.reset(new slitscan::HistorySnapshot());
+        if (!snapshot->open(options.snapshotPath, WIDTH, HEIGHT, historyFrames)) {
+            ofLogError() << "Can't open history snapshot " << options.snapshotPath;
+            snapshot.reset();
+        }
+    }
+    if (snapshot && snapshot->isRestorable()) {
+        // the snapshot file holds the layers in glTexImage3D's layout: warm start
+        // straight from the mapping
+        layerIndex = snapshot->getLayerIndex();
+        ofLogNotice() << "Restoring history from " << options.snapshotPath << ", "
+                      << snapshot->getStats().layers_discarded << " layers newer than its last checkpoint cleared";
+        allocateHistoryTexture(cameraOutput, historyFrames, snapshot->getLayers());
+    } else {
+        allocateHistoryTexture(cameraOutput, historyFrames, NULL);
+    }
+    
+    if (snapshot) {
+        glGenBuffers(NUM_SNAPSHOT_PBOS, snapshotPbos);
+        for (int i = 0; i < NUM_SNAPSHOT_PBOS; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, snapshotPbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, snapshot->getLayerSize(), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
     
     // set up camera & FBO to write to 3d texture
     
     cameraWriter.allocate(WIDTH, HEIGHT);
     cameraWriter.attachTexture(cameraOutput, GL_RGB, 0, layerIndex);
     
-    try {
+    linearTimeMap = new slitscan::LinearTimeMap();
+    timeMaps.push_back(std::unique_ptr<slitscan::TimeMap>(new slitscan::RadialTimeMap()));
+    timeMaps.push_back(std::unique_ptr<slitscan::TimeMap>(linearTimeMap));
+    timeMaps.push_back(std::unique_ptr<slitscan::TimeMap>(new slitscan::SpiralTimeMap()));
+    timeMapIndex = 0;
+    
+    glGenQueries(1, &renderQuery);
+    
+    timeShader.setupShaderFromSource(GL_VERTEX_SHADER, timeMapVertexShader);
+    timeShader.setupShaderFromSource(GL_FRAGMENT_SHADER, timeMapFragmentShader);
+    if (!timeShader.linkProgram()) {
+        ofLogWarning() << "Time map shader failed to link, falling back to vertex grid";
+        useShader = false;
+    }
+    stripShader.setupShaderFromSource(GL_VERTEX_SHADER, timeMapVertexShader);
+    stripShader.setupShaderFromSource(GL_FRAGMENT_SHADER, stripFragmentShader);
+    if (!stripShader.linkProgram()) {
+        ofLogWarning() << "Strip shader failed to link, strip history will use the CPU renderer";
+    }
+    pyramidShader.setupShaderFromSource(GL_VERTEX_SHADER, timeMapVertexShader);
+    pyramidShader.setupShaderFromSource(GL_FRAGMENT_SHADER, pyramidFragmentShader);
+    averageShader.setupShaderFromSource(GL_VERTEX_SHADER, timeMapVertexShader);
+    averageShader.setupShaderFromSource(GL_FRAGMENT_SHADER, pyramidAverageShader);
+    if (!pyramidShader.linkProgram() || !averageShader.linkProgram()) {
+        ofLogWarning() << "Pyramid shaders failed to link, the temporal pyramid is CPU renderer only";
+    }
+    
+    if (options.latencyLoopback) {
+        openLatencyLoopback();
+    }
+    if (!source && !options.inputPath.empty()) {
+        openFileSource();
+    }
+    
+    if (!source && !options.cameraRing.empty()) {
+        openCameraRing();
+    }
+    if (!source && !options.devicePath.empty()) {
+        openV4L2Source(options.devicePath);
+    }
+    
+    if (!source) try {
         using namespace ps3eye;
         std::vector<PS3EYECam::PS3EYERef> devices(PS3EYECam::getDevices());
         if (devices.size())
@@ -136,8 +312,8 @@ void ofApp::setup(){
                     eye->setExposure(125); //TODO: was 255
                     eye->setAutogain(true);
                     
-                    videoFrame = new unsigned char[eye->getWidth()*eye->getHeight() * 4];
-                    videoTexture.allocate(eye->getWidth(), eye->getHeight(), GL_RGB);
+                    source = std::make_shared<slitscan::PS3EyeSource>(eye);
+                    allocateVideoFrame();
                 }
                 else {
                     eye = NULL;
@@ -152,20 +328,206 @@ void ofApp::setup(){
         ofLogError() << "Failed to open PS eye. Exception.";
         eye = NULL;
     }
-    if (eye == NULL) {
+    if (!source) {
         cameraIn.setup(WIDTH, HEIGHT);
     }
+    
+    if (options.decimation > 1) {
+        setDecimation(options.decimation);
+    }
+    if (options.changeThreshold > 0) {
+        setChangeGate(options.changeThreshold);
+    }
+    if (options.pyramidLevels > 0) {
+        setPyramid(options.pyramidLevels);
+    }
+    if (!options.recordPath.empty()) {
+        startRecording(options.recordPath);
+    }
+    if (!options.recordRawPath.empty()) {
+        startRawRecording(options.recordRawPath);
+    }
+    if (!options.publishName.empty()) {
+        publishOutput(ofGetWidth(), ofGetHeight());
+    }
+    if (!options.panoramaPath.empty()) {
+        startPanorama(options.panoramaPath);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::exit(){
+    stopRecording();
+    stopRawRecording();
+    if (snapshot) {
+        snapshot->close();  // final checkpoint
+    }
+    outputRing.reset();
+    if (panorama) {
+        panorama->close();  // writes the last tile and the rest of the pyramid
+        slitscan::PanoramaWriter::Stats stats = panorama->getStats();
+        ofLogNotice() << "Panorama: " << stats.columns << " columns, " << stats.tiles_written << " tiles written, "
+                      << stats.tiles_dropped << " dropped";
+        panorama.reset();
+    }
+    if (options.latency) {
+        ofLogNotice() << "Glass-to-glass latency p50 / p95 / p99 / max: " << describeLatency(latencyHistogram);
+    }
+    if (options.latencyLoopback) {
+        ofLogNotice() << "Loopback flash latency p50 / p95 / p99 / max: " << describeLatency(flashHistogram);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::openFileSource(){
+    std::shared_ptr<slitscan::FileSource> file = std::make_shared<slitscan::FileSource>();
+    bool opened = options.rawWidth ?
+        file->openRaw(options.inputPath, options.rawWidth, options.rawHeight, options.fps > 0 ? (int)options.fps : 30) :
+        file->open(options.inputPath);
+    if (!opened) {
+        ofLogError() << "Can't open input file " << options.inputPath;
+        return;
+    }
+    if (options.unthrottled) {
+        file->setPacing(slitscan::FileSource::PACE_UNTHROTTLED);
+    } else if (options.fps > 0) {
+        file->setPacing(slitscan::FileSource::PACE_FIXED_RATE, options.fps);
+    }
+    file->start();
+    ofLogNotice() << "Playing " << options.inputPath << ": " << file->getWidth() << "x" << file->getHeight()
+                  << ", " << file->getFrameCount() << " frames at " << file->getFrameRate() << " fps";
+    source = file;
+    allocateVideoFrame();
+}
+
+//--------------------------------------------------------------
+void ofApp::openLatencyLoopback(){
+    // a known pattern, played like any other file: frame 0 white, the rest black
+    std::string path = ofToDataPath("latency-loopback.y4m");
+    slitscan::Y4MWriter writer;
+    if (!writer.open(path, LOOPBACK_WIDTH, LOOPBACK_HEIGHT, LOOPBACK_FPS, 1)) {
+        ofLogError() << "Can't write latency loopback pattern " << path;
+        return;
+    }
+    std::vector<uint8_t> frame(LOOPBACK_WIDTH * LOOPBACK_HEIGHT * 4);
+    for (int i = 0; i < LOOPBACK_FPS; i++) {
+        memset(frame.data(), i == 0 ? 255 : 0, frame.size());
+        writer.writeFrame(frame.data(), LOOPBACK_WIDTH * 4);
+    }
+    writer.close();
+    options.inputPath = path;
+    options.rawWidth = 0;
+    options.fps = 0;
+    options.unthrottled = false;
+    options.latency = true;
+    openFileSource();
+}
+
+//--------------------------------------------------------------
+void ofApp::openCameraRing(){
+    std::shared_ptr<slitscan::ShmCameraSource> ring = std::make_shared<slitscan::ShmCameraSource>();
+    if (!ring->open(options.cameraRing)) {
+        ofLogError() << "Can't attach to camera ring " << options.cameraRing << "; is ps3eye_daemon running?";
+        return;
+    }
+    ofLogNotice() << "Reading camera ring " << options.cameraRing << ": " << ring->getWidth() << "x" << ring->getHeight()
+                  << " at " << ring->getFrameRate() << " fps";
+    cameraRingSource = ring;
+    source = ring;
+    allocateVideoFrame();
+}
 
+//--------------------------------------------------------------
+void ofApp::openV4L2Source(const std::string& device){
+#ifdef __linux__
+    std::shared_ptr<slitscan::V4L2Source> v4l2 = std::make_shared<slitscan::V4L2Source>();
+    if (!v4l2->open(device, WIDTH, HEIGHT, 60) || !v4l2->start()) {
+        ofLogNotice() << "No V4L2 YUYV capture on " << device;
+        return;
+    }
+    ofLogNotice() << "Capturing from " << device << ": " << v4l2->getWidth() << "x" << v4l2->getHeight()
+                  << " at " << v4l2->getFrameRate() << " fps";
+    v4l2Source = v4l2;
+    source = v4l2;
+    allocateVideoFrame();
+#endif
+}
+
+//--------------------------------------------------------------
+void ofApp::allocateVideoFrame(){
+    delete[] videoFrame;
+    videoFrame = new unsigned char[source->getWidth()*source->getHeight() * 4];
+    videoTexture.allocate(source->getWidth(), source->getHeight(), GL_RGB);
+    if (changeDetector) {
+        // the new texture has none of the reference's tiles
+        setChangeGate(changeDetector->getThreshold());
+    }
 }
 
 //--------------------------------------------------------------
 void ofApp::update(){
-    if (eye != NULL) {
+    if (options.latency) {
+        measureLatency();
+    }
+    if (source) {
         try {
-            uint8_t* new_pixels = eye->getFrame();
-            yuv422_to_rgba(new_pixels, eye->getRowBytes(), videoFrame, eye->getWidth(), eye->getHeight());
-            videoTexture.loadData(videoFrame, eye->getWidth(), eye->getHeight(), GL_RGBA);
-            free(new_pixels);
+            // convert straight out of the source's buffer (an mmap'd file or a
+            // V4L2 DMA buffer) where it has one
+            const uint8_t* new_pixels = source->acquireFrame();
+            if (new_pixels == NULL) {
+                return;
+            }
+            // numbered where it was captured, so this thread's trace events match the USB thread's
+            SLITSCAN_PROFILE_FRAME(source->getFrameSequence() ? source->getFrameSequence() : ofGetFrameNum());
+            frameTimestamp = source->getFrameTimestamp();
+            if (frameTimestamp == 0) {
+                frameTimestamp = nowSeconds();
+            }
+            if (rawRecorder) {
+                // the recorder copies it on its own thread while we convert
+                rawRecorder->beginFrame(new_pixels, frameTimestamp);
+            }
+            // decimating, only every Nth frame makes a layer: the average of the last N
+            const uint8_t* layer_pixels = new_pixels;
+            {
+                SLITSCAN_PROFILE_SCOPE(STAGE_YUV_TO_RGBA);
+                int layer_stride = source->getRowBytes();
+                if (decimator) {
+                    layer_pixels = decimator->addFrame(new_pixels, layer_stride);
+                    layer_stride = decimator->getRowBytes();
+                }
+                if (layer_pixels && changeDetector) {
+                    // a static frame collapses into the previous layer
+                    if (changeDetector->update(layer_pixels, layer_stride) == 0) {
+                        layer_pixels = NULL;
+                    } else {
+                        convertChangedTiles(layer_pixels, layer_stride);
+                    }
+                } else if (layer_pixels) {
+                    slitscan::yuv422_to_rgba(layer_pixels, layer_stride, videoFrame, source->getWidth(), source->getHeight());
+                }
+            }
+            if (layer_pixels && options.latencyLoopback) {
+                const uint8_t* centre = videoFrame + (source->getHeight() / 2 * source->getWidth() + source->getWidth() / 2) * 4;
+                bool flash = centre[1] >= FLASH_THRESHOLD;
+                if (flash && !flashInSource) {
+                    flashStamp = frameTimestamp;
+                }
+                flashInSource = flash;
+            }
+            if (rawRecorder) {
+                rawRecorder->endFrame();
+            }
+            source->releaseFrame();
+            if (!layer_pixels) {
+                return;
+            }
+            SLITSCAN_PROFILE_SCOPE(STAGE_TEXTURE_UPLOAD);
+            if (changeDetector) {
+                uploadChangedTiles();
+            } else {
+                videoTexture.loadData(videoFrame, source->getWidth(), source->getHeight(), GL_RGBA);
+            }
         }
         catch (...) {
             ofLogWarning("Can't open ps eye. exception. moving to kinect");
@@ -175,131 +537,1024 @@ void ofApp::update(){
         if (!cameraIn.isFrameNew()) {
             return;
         }
+        SLITSCAN_PROFILE_FRAME(ofGetFrameNum());
+        frameTimestamp = nowSeconds();
+    }
+    
+    if (useStrips) {
+        // the strips are the whole history: no volume to write (see setStrips())
+        pushStrip();
+    } else {
+        writeHistoryLayer();
     }
+    historyChanged = true;
+    latencyWrittenStamp = frameTimestamp;
     
-    layerIndex = (layerIndex + 1) % FRAMES;
+    if (panorama) {
+        appendPanoramaColumn();
+    }
+    
+    if (cpuHistory) {
+        if (source) {
+            cpuHistory->pushRGBA(videoFrame, source->getWidth() * 4);
+        } else {
+            const ofPixels& pixels = cameraIn.getPixels();
+            // a grabber that changed size under us leaves the layer as it was
+            if (pixels.getWidth() == cpuHistory->getWidth() && pixels.getHeight() == cpuHistory->getHeight()) {
+                if (pixels.getNumChannels() == 4) {
+                    cpuHistory->pushRGBA(pixels.getData(), pixels.getWidth() * 4);
+                } else {
+                    cpuHistory->pushRGB(pixels.getData(), pixels.getWidth() * 3);
+                }
+            }
+        }
+        if (cpuPyramid) {
+            cpuPyramid->update(*cpuHistory);
+        }
+    }
+    if (cpuTiered) {
+        // only copies: compression happens on the history's own threads
+        if (source) {
+            cpuTiered->pushRGBA(videoFrame, source->getWidth() * 4);
+        } else {
+            const ofPixels& pixels = cameraIn.getPixels();
+            // as above
+            if (pixels.getWidth() == cpuTiered->getWidth() && pixels.getHeight() == cpuTiered->getHeight()) {
+                if (pixels.getNumChannels() == 4) {
+                    cpuTiered->pushRGBA(pixels.getData(), pixels.getWidth() * 4);
+                } else {
+                    cpuTiered->pushRGB(pixels.getData(), pixels.getWidth() * 3);
+                }
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::writeHistoryLayer(){
+    layerIndex = (layerIndex + 1) % historyFrames;
     // NOTE: I modified openframeworks for this to work (gl/ofFbo.h, gl/ofFbo.cpp)
     // changed ofFbo::attachTexture signature to be:
     // void attachTexture(ofTexture & texture, GLenum internalFormat, GLenum attachmentPoint, GLuint layer = 0);
     // (added layer = 0)
     // and then in the implementation, called glFramebufferTexture3D if tex.texData.target == GL_TEXTURE_3D
     // instead of the usual glFramebufferTexture2D call
-    cameraWriter.attachTexture(cameraOutput, GL_RGB, 0, layerIndex);
-    cameraWriter.begin();
-    if (eye != NULL) {
-        videoTexture.draw(0,0,WIDTH, HEIGHT);
+    {
+        SLITSCAN_PROFILE_SCOPE(STAGE_HISTORY_WRITE);
+        cameraWriter.attachTexture(cameraOutput, GL_RGB, 0, layerIndex);
+        cameraWriter.begin();
+        if (source) {
+            videoTexture.draw(0,0,WIDTH, HEIGHT);
+        } else {
+            cameraIn.draw(0,0,WIDTH,HEIGHT);
+        }
+        cameraWriter.end();
+    }
+    
+    if (snapshot) {
+        snapshotLayer();
+    }
+    // after the snapshot's readback, which reads whatever cameraWriter has attached
+    if (pyramidLayout) {
+        SLITSCAN_PROFILE_SCOPE(STAGE_HISTORY_WRITE);
+        writePyramidLevels();
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::measureLatency(){
+    // runs before anything else touches GL this frame: last frame's swap is
+    // queued, and glFinish() returns once it has happened
+    if (!latencyDrawnStamp && !options.latencyLoopback) {
+        return;
+    }
+    glFinish();
+    double now = nowSeconds();
+    if (latencyDrawnStamp) {
+        if (now > latencyDrawnStamp) {
+            latencyHistogram.record((uint64_t)((now - latencyDrawnStamp) * 1e9));
+        }
+        latencyDrawnStamp = 0;
+    }
+    
+    if (options.latencyLoopback) {
+        // what is actually on screen now, at a pixel that shows the newest layer
+        uint8_t pixel[4];
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glReadBuffer(GL_FRONT);
+        glReadPixels(flashProbeX, ofGetHeight() - 1 - flashProbeY, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        glReadBuffer(GL_BACK);
+        bool bright = pixel[1] >= FLASH_THRESHOLD;
+        if (bright && !flashOnScreen && flashStamp && now > flashStamp) {
+            flashHistogram.record((uint64_t)((now - flashStamp) * 1e9));
+        }
+        flashOnScreen = bright;
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::updateFlashProbe(int w, int h){
+    // the highest time map value is the newest layer (0 at most, see TimeMap)
+    const float* table = timeMapCache.getTable(*timeMaps[timeMapIndex], w, h);
+    if (flashProbeGeneration == timeMapCache.getTableGeneration()) {
+        return;
+    }
+    flashProbeGeneration = timeMapCache.getTableGeneration();
+    int newest = 0;
+    for (int i = 1; i < w * h; i++) {
+        if (table[i] > table[newest]) {
+            newest = i;
+        }
+    }
+    flashProbeX = newest % w;
+    flashProbeY = newest / w;
+}
+
+//--------------------------------------------------------------
+slitscan::StripHistory::Slit ofApp::chooseSlit() const{
+    // the slit lies across the direction time runs in: a row unless the linear
+    // map is turned closer to horizontal than vertical
+    if (timeMaps[timeMapIndex].get() == linearTimeMap) {
+        float rad = linearTimeMap->getAngle() * PI / 180.0f;
+        if (std::fabs(std::sin(rad)) > std::fabs(std::cos(rad))) {
+            return slitscan::StripHistory::SLIT_COLUMN;
+        }
+    }
+    return slitscan::StripHistory::SLIT_ROW;
+}
+
+//--------------------------------------------------------------
+void ofApp::pushStrip(){
+    int w = source ? source->getWidth() : cameraIn.getWidth();
+    int h = source ? source->getHeight() : cameraIn.getHeight();
+    slitscan::StripHistory::Slit slit = chooseSlit();
+    if (!stripHistory || stripHistory->getSlit() != slit) {
+        // a new slit starts a new (black) history
+        stripHistory.reset(new slitscan::StripHistory(w, h, STRIP_FRAMES, slit));
+        stripTexture.allocate(stripHistory->getLength(), STRIP_FRAMES, GL_RGB8, false);
+        stripTexture.setTextureWrap(GL_CLAMP_TO_EDGE, GL_REPEAT);
+        stripTexture.loadData(stripHistory->getStrip(0), stripHistory->getLength(), STRIP_FRAMES, GL_RGB);
+        ofLogNotice() << "Strip history: " << (slit == slitscan::StripHistory::SLIT_ROW ? "row " : "column ")
+                      << stripHistory->getPosition() << ", " << STRIP_FRAMES << " frames in "
+                      << ofToString(stripHistory->getMemoryUsage() / 1e6, 1) << " MB";
+    }
+    if (source) {
+        stripHistory->pushRGBA(videoFrame, w * 4);
+    } else {
+        const ofPixels& pixels = cameraIn.getPixels();
+        if (pixels.getNumChannels() == 4) {
+            stripHistory->pushRGBA(pixels.getData(), pixels.getWidth() * 4);
+        } else {
+            stripHistory->pushRGB(pixels.getData(), pixels.getWidth() * 3);
+        }
+    }
+    
+    // one row of the texture per frame
+    int layer = stripHistory->getLayerIndex();
+    glBindTexture(GL_TEXTURE_2D, stripTexture.getTextureData().textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, layer, stripHistory->getLength(), 1, GL_RGB, GL_UNSIGNED_BYTE,
+                    stripHistory->getStrip(layer));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//--------------------------------------------------------------
+void ofApp::setStrips(bool enable){
+    if (enable == useStrips) {
+        return;
+    }
+    useStrips = enable;
+    if (useStrips) {
+        // the strips are drawn on their own, so the volume would only cost
+        // memory: detach it from cameraWriter, or GL keeps it alive, and free it
+        glBindFramebuffer(GL_FRAMEBUFFER, cameraWriter.getId());
+        glFramebufferTexture3D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_3D, 0, 0, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        freeHistoryTexture(cameraOutput);
+        ofLogNotice() << "Strip history on, " << ofToString((double)WIDTH * HEIGHT * 3 * historyFrames / 1e6, 0)
+                      << " MB history volume freed";
+        // the strip history itself is allocated by the next frame's pushStrip()
     } else {
-        cameraIn.draw(0,0,WIDTH,HEIGHT);
+        stripHistory.reset();
+        // back to a black volume, and black pyramid levels to go with it
+        allocateHistoryTexture(cameraOutput, historyFrames, NULL);
+        cameraWriter.attachTexture(cameraOutput, GL_RGB, 0, layerIndex);
+        if (pyramidLevels) {
+            setPyramid(pyramidLevels);
+        }
     }
-    cameraWriter.end();
 }
 
-static float triangle(float t) {
-    float s = fmod(t,2);
-    return min(s, 2-s);
+//--------------------------------------------------------------
+void ofApp::setDecimation(int factor){
+    if (!source) {
+        ofLogWarning() << "Decimation needs a YUYV source (PS3 Eye, V4L2, camera ring or file)";
+        return;
+    }
+    if (factor > 1) {
+        decimator.reset(new slitscan::FrameDecimator(source->getWidth(), source->getHeight(), factor));
+    } else {
+        decimator.reset();
+    }
+    ofLogNotice() << "Averaging " << (decimator ? decimator->getFactor() : 1) << " frames per layer";
 }
 
-static void drawRect(int x, int y, int w, int h, int vertexCount, float offset, float rotateAngle) {
-    // draw using raw OpenGL since ofx doesn't let us use 3d texture coordinates
+//--------------------------------------------------------------
+void ofApp::setChangeGate(float threshold){
+    if (!source) {
+        ofLogWarning() << "The change gate needs a YUYV source (PS3 Eye, V4L2, camera ring or file)";
+        return;
+    }
+    if (threshold > 0) {
+        // starts with every tile dirty, so videoTexture gets a full upload
+        changeDetector.reset(new slitscan::ChangeDetector(source->getWidth(), source->getHeight(), threshold));
+        ofLogNotice() << "Writing layers for changed frames only, threshold " << threshold;
+    } else {
+        changeDetector.reset();
+        ofLogNotice() << "Writing a layer for every frame";
+    }
+}
 
-    ofMatrix4x4 rotation;
-    rotation.translate(-0.5,-0.5,0);
-    rotation.rotate(rotateAngle, 0, 0, 1);
-    rotation.translate(0.5, 0.5, 0);
-    ofVec3f pt(0);
-    for (int row = 0; row < vertexCount - 1; row++) {
-        float py = ofMap(row, 0, vertexCount - 1, y, y + h);
-        float py2 = ofMap(row + 1, 0, vertexCount - 1, y, y + h);
-        float u = ofMap(row, 0, vertexCount - 1, 0, 1);
-        float u2 = ofMap(row + 1, 0, vertexCount - 1, 0, 1);
-        glBegin(GL_TRIANGLE_STRIP);
-        
-        for(int col = 0; col < vertexCount; col++) {
-            float px = ofMap(col, 0, vertexCount - 1, x, x + w);
-            float t = ofMap(col, 0, vertexCount - 1, 0, 1);
-/*            // rotate (t,u,t) around Z axis through (0.5, 0.5, 0)
-            pt.x = t;
-            pt.y = u;
-            //pt = rotation * pt;
-            float s = ofMap(triangle(pt.y), 0, 1, 0 + endOffset, 1 + startOffset);
-            pt.x = t;
-            pt.y = u2;
-            //pt = rotation * pt;
-            float s2 = ofMap(triangle(pt.y), 0, 1, 0 + endOffset, 1 + startOffset);
- */
-            float s = u + offset, s2 = u2 + offset;
-            glTexCoord3d(t, u, s);
-            glVertex2f(px, py);
-            glTexCoord3d(t, u2, s2);
-            glVertex2f(px, py2);
-        }
-        glEnd();
-    }
-}
-
-static void drawRectCircularTime(int x, int y, int w, int h, int vertexCount, float offset) {
-    // draw using raw OpenGL since ofx doesn't let us use 3d texture coordinates
-    
-    ofVec3f pt(0);
-    for (int row = 0; row < vertexCount - 1; row++) {
-        float py = ofMap(row, 0, vertexCount - 1, y, y + h);
-        float py2 = ofMap(row + 1, 0, vertexCount - 1, y, y + h);
-        float u = ofMap(row, 0, vertexCount - 1, 0, 1);
-        float u2 = ofMap(row + 1, 0, vertexCount - 1, 0, 1);
-        float dySqr = (0.5 - u)*(0.5 - u);
-        float dy2Sqr = (0.5 - u2)*(0.5 - u2);
-        glBegin(GL_TRIANGLE_STRIP);
-        
-        for(int col = 0; col < vertexCount; col++) {
-            float px = ofMap(col, 0, vertexCount - 1, x, x + w);
-            float t = ofMap(col, 0, vertexCount - 1, 0, 1);
-            /*            // rotate (t,u,t) around Z axis through (0.5, 0.5, 0)
-             pt.x = t;
-             pt.y = u;
-             //pt = rotation * pt;
-             float s = ofMap(triangle(pt.y), 0, 1, 0 + endOffset, 1 + startOffset);
-             pt.x = t;
-             pt.y = u2;
-             //pt = rotation * pt;
-             float s2 = ofMap(triangle(pt.y), 0, 1, 0 + endOffset, 1 + startOffset);
-             */
-            float dx = 0.5 - ofMap(col, 0, vertexCount - 1, 0, 1);
-            float dxSqr = dx*dx;
-            // TODO: fix distance 0
-            float s = -dxSqr + -dySqr + offset, s2 = -dxSqr + -dy2Sqr + offset;
-            glTexCoord3d(t, u, s);
-            glVertex2f(px, py);
-            glTexCoord3d(t, u2, s2);
-            glVertex2f(px, py2);
-        }
-        glEnd();
+//--------------------------------------------------------------
+void ofApp::convertChangedTiles(const uint8_t* yuyv, int stride){
+    // tiles left alone keep what they had, within the threshold of the frame
+    const int tile = slitscan::ChangeDetector::TILE_SIZE;
+    const int w = source->getWidth(), h = source->getHeight();
+    for (int ty = 0; ty < changeDetector->getTilesY(); ty++) {
+        for (int tx = 0; tx < changeDetector->getTilesX(); tx++) {
+            if (!changeDetector->isDirty(tx, ty)) {
+                continue;
+            }
+            int x = tx * tile, y = ty * tile;
+            int tw = std::min(tile, w - x), th = std::min(tile, h - y);
+            // a row at a time: the conversion writes tightly packed rows
+            for (int r = y; r < y + th; r++) {
+                slitscan::yuv422_to_rgba(yuyv + r * stride + x * 2, stride, videoFrame + (r * w + x) * 4, tw, 1);
+            }
+        }
     }
 }
+
+//--------------------------------------------------------------
+void ofApp::uploadChangedTiles(){
+    // one glTexSubImage2D per run of dirty tiles in a tile row
+    const int tile = slitscan::ChangeDetector::TILE_SIZE;
+    const int w = source->getWidth(), h = source->getHeight();
+    const ofTextureData& data = videoTexture.getTextureData();
+    glBindTexture(data.textureTarget, data.textureID);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, w);
+    for (int ty = 0; ty < changeDetector->getTilesY(); ty++) {
+        int y = ty * tile, th = std::min(tile, h - y);
+        for (int tx = 0; tx < changeDetector->getTilesX(); ) {
+            if (!changeDetector->isDirty(tx, ty)) {
+                tx++;
+                continue;
+            }
+            int first = tx;
+            while (tx < changeDetector->getTilesX() && changeDetector->isDirty(tx, ty)) {
+                tx++;
+            }
+            int x = first * tile, run = std::min(tx * tile, w) - x;
+            glTexSubImage2D(data.textureTarget, 0, x, y, run, th, GL_RGBA, GL_UNSIGNED_BYTE, videoFrame + (y * w + x) * 4);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(data.textureTarget, 0);
+}
+
+//--------------------------------------------------------------
+void ofApp::startPanorama(const std::string& directory){
+    int h = source ? source->getHeight() : cameraIn.getHeight();
+    ofDirectory::createDirectory(directory, false, true);
+    panorama.reset(new slitscan::PanoramaWriter());
+    if (!panorama->open(directory, h)) {
+        ofLogError() << "Can't write panorama tiles to " << directory;
+        panorama.reset();
+        return;
+    }
+    ofLogNotice() << "Writing panorama to " << directory << ": " << panorama->getTileWidth() << " x " << h
+                  << " tiles, " << panorama->getLevels() << " levels";
+}
+
+//--------------------------------------------------------------
+void ofApp::appendPanoramaColumn(){
+    // the centre column, like a photo-finish camera's slit
+    if (source) {
+        panorama->appendColumnRGBA(videoFrame, source->getWidth() * 4, source->getWidth() / 2);
+    } else {
+        const ofPixels& pixels = cameraIn.getPixels();
+        if (pixels.getNumChannels() == 4) {
+            panorama->appendColumnRGBA(pixels.getData(), pixels.getWidth() * 4, pixels.getWidth() / 2);
+        } else {
+            panorama->appendColumnRGB(pixels.getData(), pixels.getWidth() * 3, pixels.getWidth() / 2);
+        }
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::snapshotLayer(){
+    // start reading back the layer just written...
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, cameraWriter.getId());
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, snapshotPbos[snapshotPboIndex]);
+    glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    snapshotPboLayers[snapshotPboIndex] = layerIndex;
+    snapshotPboIndex = (snapshotPboIndex + 1) % NUM_SNAPSHOT_PBOS;
+    snapshotPbosPending++;
+    
+    // ...and hand the one from NUM_SNAPSHOT_PBOS-1 frames ago to the snapshot thread
+    if (snapshotPbosPending == NUM_SNAPSHOT_PBOS) {
+        snapshotPbosPending--;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, snapshotPbos[snapshotPboIndex]);
+        uint8_t* layer = snapshot->acquireLayer();
+        if (layer) {
+            const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            if (pixels) {
+                memcpy(layer, pixels, snapshot->getLayerSize());
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            snapshot->submitLayer(layer, snapshotPboLayers[snapshotPboIndex]);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+static void drawTimeMapMesh(const slitscan::TimeMapMesh& mesh, int x, int y, int w, int h, float offset) {
+    // draw using raw OpenGL since ofx doesn't let us use 3d texture coordinates.
+    // The mesh is cached in normalized coordinates: the modelview matrix scales it
+    // to the output rect and the texture matrix scrolls it through time.
+    glMatrixMode(GL_TEXTURE);
+    glPushMatrix();
+    glTranslatef(0, 0, offset);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glTranslatef(x, y, 0);
+    glScalef(w, h, 1);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, mesh.positions.data());
+    glTexCoordPointer(3, GL_FLOAT, 0, mesh.texcoords.data());
+    glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, mesh.indices.data());
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glPopMatrix();
+    glMatrixMode(GL_TEXTURE);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+static void drawRectShader(int x, int y, int w, int h) {
+    // time coordinate is looked up per pixel by timeShader, so a single quad suffices
+    glBegin(GL_TRIANGLE_STRIP);
+    glTexCoord2f(0, 0);
+    glVertex2f(x, y);
+    glTexCoord2f(1, 0);
+    glVertex2f(x + w, y);
+    glTexCoord2f(0, 1);
+    glVertex2f(x, y + h);
+    glTexCoord2f(1, 1);
+    glVertex2f(x + w, y + h);
+    glEnd();
+}
+
 //--------------------------------------------------------------
 void ofApp::draw(){
-    // we just wrote to layerIndex, so (layerIndex+1) % FRAMES is the oldest layer
-    // we want to do a full cycle from oldest to newest (off-by-one is important here)
-    float newestOffset = layerIndex / (float)FRAMES; // z-coordinate of last drawn frame
-    float oldestOffset = (layerIndex + 1) / (float)FRAMES;
+    SLITSCAN_PROFILE_SCOPE(STAGE_DRAW);
+    int w = ofGetWidth(), h = ofGetHeight();
+    const slitscan::TimeMap& timeMap = *timeMaps[timeMapIndex];
+    
+    // anything besides the history that changes the rendered image
+    RenderState state;
+    state.width = w;
+    state.height = h;
+    state.timeMapId = timeMap.getId();
+    state.timeMapVersion = timeMap.getVersion();
+    state.useShader = useShader;
+    state.useCpuRenderer = useCpuRenderer && (cpuHistory || cpuTiered);
+    state.useStrips = useStrips && stripHistory;
+    state.cpuFilter = cpuRenderer ? cpuRenderer->getFilter() : 0;
+    state.pyramidLevels = pyramidLevels;
+    
+    collectRenderTimer();
+    
+    bool dirty = !damageTracking || historyChanged || !(state == lastRenderState) ||
+                 !outputFbo.isAllocated() || outputFbo.getWidth() != w || outputFbo.getHeight() != h;
+    if (dirty) {
+        uint64_t start = ofGetElapsedTimeMicros();
+        bool timing = !renderQueryPending;
+        if (timing) {
+            glBeginQuery(GL_TIME_ELAPSED, renderQuery);
+        }
+        if (damageTracking) {
+            if (!outputFbo.isAllocated() || outputFbo.getWidth() != w || outputFbo.getHeight() != h) {
+                outputFbo.allocate(w, h, GL_RGB);
+            }
+            outputFbo.begin();
+            ofClear(0, 0, 0, 255);
+        }
+        renderSlitScan(w, h);
+        if (damageTracking) {
+            outputFbo.end();
+        }
+        if (timing) {
+            glEndQuery(GL_TIME_ELAPSED);
+            renderQueryPending = true;
+        }
+        damageStats.cpuMicros += ofGetElapsedTimeMicros() - start;
+        damageStats.rendered++;
+        historyChanged = false;
+        lastRenderState = state;
+    } else {
+        damageStats.skipped++;
+    }
+    
+    if (damageTracking) {
+        outputFbo.draw(0, 0);
+    }
     
-    ofMatrix4x4 originalTextureMatrix = cameraOutput.getTextureMatrix();
-    ofMatrix4x4 newMatrix = originalTextureMatrix;
-    newMatrix.translate(-0.5, -0.5, 0);
-    newMatrix.rotate(90, 1, 0, 0);
+    // every displayed frame is recorded/published, rendered or not, so the file
+    // plays back in real time
+    if (recorder || outputRing) {
+        captureOutput(w, h);
+    }
+    
+    if (showStats) {
+        drawStats();
+    }
     
+    // the newest frame is in this image; measureLatency() waits for its swap
+    if (latencyWrittenStamp) {
+        latencyDrawnStamp = latencyWrittenStamp;
+        latencyWrittenStamp = 0;
+    }
+    if (options.latencyLoopback) {
+        updateFlashProbe(w, h);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::renderSlitScan(int w, int h){
+    // we just wrote to layerIndex; time maps are relative to it, wrapping around
+    // to the oldest layer (layerIndex+1) % historyFrames
+    float newestOffset = layerIndex / (float)historyFrames; // z-coordinate of last drawn frame
+    const slitscan::TimeMap& timeMap = *timeMaps[timeMapIndex];
+    
+    if (useStrips) {
+        // nothing to show until the first strip is in, the volume is gone
+        if (stripHistory) {
+            renderStrips(w, h);
+        }
+        return;
+    }
+    
+    if (useCpuRenderer && (cpuHistory || cpuTiered)) {
+        cpuPixels.resize(w * h * 4);
+        if (cpuTiered) {
+            cpuRenderer->renderTiered(*cpuTiered, timeMapCache.getTable(timeMap, w, h), cpuTiered->getNewestOffset(),
+                                      cpuPixels.data(), w, h, w * 4);
+        } else if (cpuPyramid) {
+            cpuRenderer->renderPyramid(*cpuHistory, *cpuPyramid, timeMapCache.getTable(timeMap, w, h), newestOffset,
+                                       cpuPixels.data(), w, h, w * 4);
+        } else {
+            cpuRenderer->render(*cpuHistory, timeMapCache.getTable(timeMap, w, h), newestOffset,
+                                cpuPixels.data(), w, h, w * 4);
+        }
+        drawCpuPixels(w, h);
+        return;
+    }
+    
+    if (pyramidLayout) {
+        // per pixel regardless of 's': levels are picked per pixel
+        renderPyramid(w, h);
+        return;
+    }
     
     cameraOutput.bind();
-    // draw using raw OpenGL since ofx doesn't let us use 3d texture coordinates
-    //drawRect(0, 0, ofGetWidth(), ofGetHeight(), 100, oldestOffset, 0);// fmod(ofGetElapsedTimef(), 360));
-    drawRectCircularTime(0, 0, ofGetWidth(), ofGetHeight(), 100, newestOffset);// fmod(ofGetElapsedTimef(), 360));
+    if (useShader) {
+        uploadTimeTable(timeMapCache.getTable(timeMap, w, h), w, h);
+        timeShader.begin();
+        timeShader.setUniform1i("history", 0);
+        timeShader.setUniformTexture("timeTable", timeTableTexture, 1);
+        timeShader.setUniform1f("offset", newestOffset);
+        drawRectShader(0, 0, w, h);
+        timeShader.end();
+    } else {
+        // a quarter layer of interpolation error is below what trilinear filtering shows anyway
+        drawTimeMapMesh(timeMapCache.getMesh(timeMap, w, h, 0.25f / historyFrames), 0, 0, w, h, newestOffset);
+    }
     cameraOutput.unbind();
-    cameraOutput.setTextureMatrix(originalTextureMatrix);
+}
+
+//--------------------------------------------------------------
+void ofApp::renderStrips(int w, int h){
+    const float* table = timeMapCache.getTable(*timeMaps[timeMapIndex], w, h);
+    if (useCpuRenderer || !stripShader.isLoaded()) {
+        if (!cpuRenderer) {
+            cpuRenderer.reset(new slitscan::CpuRenderer());
+        }
+        cpuPixels.resize(w * h * 4);
+        cpuRenderer->render(stripHistory->getHistory(), table, stripHistory->getNewestOffset(),
+                            cpuPixels.data(), w, h, w * 4);
+        drawCpuPixels(w, h);
+        return;
+    }
+    
+    uploadTimeTable(table, w, h);
+    stripShader.begin();
+    stripShader.setUniformTexture("strips", stripTexture, 0);
+    stripShader.setUniformTexture("timeTable", timeTableTexture, 1);
+    stripShader.setUniform1f("offset", stripHistory->getNewestOffset());
+    stripShader.setUniform1f("alongX", stripHistory->getSlit() == slitscan::StripHistory::SLIT_ROW ? 1 : 0);
+    drawRectShader(0, 0, w, h);
+    stripShader.end();
+}
+
+//--------------------------------------------------------------
+void ofApp::uploadTimeTable(const float* table, int w, int h){
+    // only re-uploaded when the map, its parameters or the window size change
+    if (timeTableGeneration == timeMapCache.getTableGeneration()) {
+        return;
+    }
+    if (!timeTableTexture.isAllocated() || timeTableTexture.getWidth() != w || timeTableTexture.getHeight() != h) {
+        timeTableTexture.allocate(w, h, GL_LUMINANCE32F_ARB, false);
+        timeTableTexture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+    }
+    timeTableTexture.loadData(table, w, h, GL_LUMINANCE);
+    timeTableGeneration = timeMapCache.getTableGeneration();
+}
+
+//--------------------------------------------------------------
+void ofApp::renderPyramid(int w, int h){
+    const slitscan::PyramidLayout& layout = *pyramidLayout;
+    float maxAge[MAX_PYRAMID_LEVELS + 1], bias[MAX_PYRAMID_LEVELS + 1];
+    float scale[MAX_PYRAMID_LEVELS + 1], offset[MAX_PYRAMID_LEVELS + 1];
+    for (int k = 0; k <= layout.getLevels(); k++) {
+        const slitscan::PyramidLayout::Level& level = layout.getLevel(k);
+        maxAge[k] = k < layout.getLevels() ? level.max_age : 1e30f;
+        bias[k] = level.bias;
+        scale[k] = level.scale;
+        offset[k] = k ? layout.getNewestOffset(k) : layerIndex / (float)historyFrames;
+    }
+    
+    uploadTimeTable(timeMapCache.getTable(*timeMaps[timeMapIndex], w, h), w, h);
+    pyramidShader.begin();
+    pyramidShader.setUniformTexture("history", cameraOutput, 0);
+    pyramidShader.setUniformTexture("timeTable", timeTableTexture, 1);
+    for (int k = 1; k <= layout.getLevels(); k++) {
+        pyramidShader.setUniformTexture("level" + ofToString(k), pyramidTextures[k - 1], k + 1);
+    }
+    pyramidShader.setUniform1i("levels", layout.getLevels());
+    pyramidShader.setUniform1f("span", layout.getSpan());
+    pyramidShader.setUniform1fv("maxAge", maxAge, layout.getLevels() + 1);
+    pyramidShader.setUniform1fv("bias", bias, layout.getLevels() + 1);
+    pyramidShader.setUniform1fv("scale", scale, layout.getLevels() + 1);
+    pyramidShader.setUniform1fv("offset", offset, layout.getLevels() + 1);
+    drawRectShader(0, 0, w, h);
+    pyramidShader.end();
+}
+
+//--------------------------------------------------------------
+void ofApp::writePyramidLevels(){
+    // right after the base layer: each level that is due averages the newest
+    // two layers of the one below, finest first
+    int due = pyramidLayout->advance();
+    for (int k = 1; k <= due; k++) {
+        ofTexture& below = k == 1 ? cameraOutput : pyramidTextures[k - 2];
+        int newest = k == 1 ? layerIndex : pyramidLayout->getLayerIndex(k - 1);
+        int previous = (newest + historyFrames - 1) % historyFrames;
+        cameraWriter.attachTexture(pyramidTextures[k - 1], GL_RGB, 0, pyramidLayout->getLayerIndex(k));
+        cameraWriter.begin();
+        averageShader.begin();
+        averageShader.setUniformTexture("history", below, 0);
+        averageShader.setUniform1f("z0", (previous + 0.5f) / historyFrames);
+        averageShader.setUniform1f("z1", (newest + 0.5f) / historyFrames);
+        drawRectShader(0, 0, WIDTH, HEIGHT);
+        averageShader.end();
+        cameraWriter.end();
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::setPyramid(int levels){
+    for (int k = 0; k < MAX_PYRAMID_LEVELS; k++) {
+        freeHistoryTexture(pyramidTextures[k]);
+    }
+    pyramidLayout.reset();
+    cpuPyramid.reset();
+    pyramidLevels = levels < 0 ? 0 : levels > MAX_PYRAMID_LEVELS ? (int)MAX_PYRAMID_LEVELS : levels;
+    levels = pyramidLevels;
+    if (levels == 0) {
+        ofLogNotice() << "Temporal pyramid off";
+        return;
+    }
+    if (!pyramidShader.isLoaded() || !averageShader.isLoaded()) {
+        ofLogWarning() << "No pyramid shaders, the GL path will show the base history only";
+    } else {
+        // coarse levels start out black and fill up, like the base at startup
+        pyramidLayout.reset(new slitscan::PyramidLayout(historyFrames, levels));
+        for (int k = 0; k < levels; k++) {
+            allocateHistoryTexture(pyramidTextures[k], historyFrames, NULL);
+        }
+    }
+    if (cpuHistory) {
+        cpuPyramid.reset(new slitscan::TemporalPyramid(cpuHistory->getWidth(), cpuHistory->getHeight(), historyFrames, levels));
+    }
+    ofLogNotice() << "Temporal pyramid: " << levels << " levels spanning " << (historyFrames << levels) << " frames, "
+                  << ofToString(levels * (double)WIDTH * HEIGHT * 3 * historyFrames / 1e6, 0) << " MB more";
+}
+
+//--------------------------------------------------------------
+void ofApp::drawCpuPixels(int w, int h){
+    if (!cpuTexture.isAllocated() || cpuTexture.getWidth() != w || cpuTexture.getHeight() != h) {
+        cpuTexture.allocate(w, h, GL_RGBA);
+    }
+    cpuTexture.loadData(cpuPixels.data(), w, h, GL_RGBA);
+    cpuTexture.draw(0, 0);
+}
+
+//--------------------------------------------------------------
+void ofApp::collectRenderTimer(){
+    // GPU time of the last timed render, read back without stalling once it's available
+    if (!renderQueryPending) {
+        return;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(renderQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+        GLuint64 nanos = 0;
+        glGetQueryObjectui64v(renderQuery, GL_QUERY_RESULT, &nanos);
+        damageStats.gpuMicros += nanos / 1000;
+        damageStats.gpuSamples++;
+        renderQueryPending = false;
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::drawStats(){
+    std::ostringstream text;
+    uint64_t frames = damageStats.rendered + damageStats.skipped;
+    double cpuPerRender = damageStats.rendered ? damageStats.cpuMicros / (double)damageStats.rendered : 0;
+    double gpuPerRender = damageStats.gpuSamples ? damageStats.gpuMicros / (double)damageStats.gpuSamples : 0;
+    text << ofToString(ofGetFrameRate(), 1) << " fps";
+    if (useCpuRenderer && cpuRenderer) {
+        text << ", CPU renderer " << ofToString(cpuRenderer->getStats().megapixels_per_second, 1) << " MP/s, "
+             << cpuRenderer->getThreadCount() << " threads";
+    }
+    if (decimator) {
+        double fps = source->getFrameRate();
+        text << ", " << decimator->getFactor() << " frames per layer";
+        if (fps > 0) {
+            text << ", history spans " << ofToString(historyFrames * decimator->getFactor() / fps, 1) << " s";
+        }
+    }
+    if (pyramidLevels) {
+        text << ", pyramid of " << pyramidLevels << " levels spanning " << (historyFrames << pyramidLevels) << " layers";
+    }
+    if (useStrips && stripHistory) {
+        text << ", strip history " << STRIP_FRAMES << " frames in "
+             << ofToString(stripHistory->getMemoryUsage() / 1e6, 1) << " MB";
+    }
+    text << "\nredraw " << (damageTracking ? "on damage" : "every frame")
+         << ": skipped " << ofToString(frames ? 100.0 * damageStats.skipped / frames : 0, 1) << "% of " << frames << " frames"
+         << "\nper render " << ofToString(cpuPerRender / 1000, 2) << " ms CPU, " << ofToString(gpuPerRender / 1000, 2) << " ms GPU"
+         << "\nsaved " << ofToString(damageStats.skipped * cpuPerRender / 1e6, 2) << " s CPU, "
+         << ofToString(damageStats.skipped * gpuPerRender / 1e6, 2) << " s GPU";
+    if (cpuTiered) {
+        slitscan::TieredHistory::Stats cold = cpuTiered->getStats();
+        uint64_t lookups = cold.cache_hits + cold.cache_misses;
+        double layerBytes = cpuTiered->getWidth() * (double)cpuTiered->getHeight() * 3;
+        text << "\ncold history: " << cold.cold_layers << " layers in " << ofToString(cold.cold_bytes / 1e6, 1) << " MB ("
+             << ofToString(cold.cold_bytes ? cold.cold_layers * layerBytes / cold.cold_bytes : 0, 2) << "x smaller), "
+             << cold.hot_layers << " uncompressed, " << cold.groups_skipped << " groups skipped"
+             << "\ntile cache " << ofToString(lookups ? 100.0 * cold.cache_hits / lookups : 0, 1) << "% hits, "
+             << cold.tiles_decoded << " decoded, " << ofToString(cold.compress_seconds, 1) << " s compressing";
+    }
+    if (changeDetector) {
+        // against converting, uploading and writing a layer for every frame
+        const slitscan::ChangeDetector::Stats& change = changeDetector->getStats();
+        uint64_t pixels = change.pixels_dirty + change.pixels_clean;
+        text << "\nchange gate " << ofToString(changeDetector->getThreshold(), 1) << ": "
+             << change.static_frames << " of " << change.frames << " frames static, uploaded "
+             << ofToString(pixels ? 100.0 * change.pixels_dirty / pixels : 0, 1) << "% of tiles"
+             << "\nsaved " << ofToString(change.pixels_clean * 4 / 1e6, 1) << " MB upload, "
+             << ofToString(change.static_frames * (double)WIDTH * HEIGHT * 3 / 1e6, 1) << " MB layer writes";
+    }
+    if (panorama) {
+        slitscan::PanoramaWriter::Stats pano = panorama->getStats();
+        text << "\npanorama " << pano.columns << " columns, " << pano.tiles_written << " tiles ("
+             << ofToString(pano.bytes_written / 1e6, 1) << " MB), " << pano.tiles_dropped << " dropped";
+    }
+    if (snapshot) {
+        slitscan::HistorySnapshot::Stats snap = snapshot->getStats();
+        text << "\nsnapshot " << snap.checkpoints << " checkpoints, last " << ofToString(snap.last_checkpoint_ms, 1)
+             << " ms, " << snap.layers_flushed << " layers flushed, " << snap.layers_stored << " stored, "
+             << snap.layers_dropped << " dropped";
+    }
+    if (recorder) {
+        // dropped frames mean the writer is behind: its time per frame shows by how much
+        slitscan::OutputRecorder::Stats rec = recorder->getStats();
+        text << "\nrecording " << rec.frames_written << " frames written, " << rec.frames_dropped << " dropped, "
+             << ofToString(rec.write_seconds, 1) << " s writing ("
+             << ofToString(rec.frames_written ? rec.write_seconds * 1e3 / rec.frames_written : 0, 1) << " ms a frame)";
+    }
+    if (eye) {
+        ps3eye::PS3EYECam::Stats usb = eye->getStats();
+        text << "\nPS3 Eye " << ofToString(usb.bytes_per_second / 1e6, 1) << " MB/s: " << usb.frames_completed << " frames, "
+             << usb.frames_overwritten << " overwritten, " << usb.frames_discarded << " discarded, "
+             << usb.frames_incomplete << " incomplete"
+             << "\ndropped payloads: " << usb.payloads_bad_header << " bad header, " << usb.payloads_stream_error << " error, "
+             << usb.payloads_missing_pts << " no PTS, " << usb.payloads_size_mismatch << " wrong size";
+        if (usb.transfer_errors || usb.resubmit_failures) {
+            text << "\nUSB stopped: " << usb.transfer_errors << " transfer errors, " << usb.resubmit_failures << " resubmit failures";
+        }
+    }
+    if (v4l2Source) {
+        const slitscan::V4L2Source::Stats& v4l2 = v4l2Source->getStats();
+        text << "\nV4L2 " << v4l2.frames << " frames, " << v4l2.dropped << " dropped, " << v4l2.copies << " copied, "
+             << ofToString(v4l2.latency_ms, 1) << " ms capture to dequeue";
+    }
+    if (cameraRingSource) {
+        // skipped: this process fell behind the daemon; torn: held a slot too long
+        const slitscan::ShmRingReader::Stats& ring = cameraRingSource->getStats();
+        text << "\ncamera ring " << ring.frames_read << " frames read, " << ring.frames_skipped << " skipped, "
+             << ring.frames_torn << " torn";
+    }
+    if (options.latency) {
+        text << "\nglass-to-glass " << describeLatency(latencyHistogram);
+    }
+    if (options.latencyLoopback) {
+        text << "\nloopback flash " << describeLatency(flashHistogram);
+    }
+#ifdef SLITSCAN_PROFILE
+    // CPU time per stage in ms: p50 / p95 / p99 / max
+    const slitscan::Profiler& profiler = slitscan::Profiler::instance();
+    for (int i = 0; i < slitscan::NUM_PROFILE_STAGES; i++) {
+        slitscan::ProfileStage stage = (slitscan::ProfileStage)i;
+        const slitscan::LatencyHistogram& histogram = profiler.getHistogram(stage);
+        text << "\n" << slitscan::Profiler::getStageName(stage) << " "
+             << ofToString(histogram.getPercentile(0.5) / 1e6, 2) << " / "
+             << ofToString(histogram.getPercentile(0.95) / 1e6, 2) << " / "
+             << ofToString(histogram.getPercentile(0.99) / 1e6, 2) << " / "
+             << ofToString(histogram.getMax() / 1e6, 2) << " ms";
+    }
+    if (profiler.isTracing()) {
+        text << "\ntracing";
+    }
+#endif
+    ofDrawBitmapStringHighlight(text.str(), 10, 20);
+}
+
+//--------------------------------------------------------------
+void ofApp::startRecording(const std::string& path){
+    int w = ofGetWidth(), h = ofGetHeight();
+    int fps = (int)(ofGetFrameRate() + 0.5f);
+    bool raw = path.size() > 4 && path.compare(path.size() - 4, 4, ".rgb") == 0;
+    recorder.reset(new slitscan::OutputRecorder());
+    if (!recorder->open(path, w, h, fps > 0 ? fps : 60, 1, raw)) {
+        ofLogError() << "Can't record to " << path;
+        recorder.reset();
+        return;
+    }
+    ofLogNotice() << "Recording " << w << "x" << h << " to " << path;
+}
+
+//--------------------------------------------------------------
+void ofApp::stopRecording(){
+    if (!recorder) {
+        return;
+    }
+    drainOutputPbos();
+    recorder->close();
+    slitscan::OutputRecorder::Stats stats = recorder->getStats();
+    ofLogNotice() << "Recorded " << stats.frames_written << " frames, dropped " << stats.frames_dropped;
+    recorder.reset();
+}
+
+//--------------------------------------------------------------
+bool ofApp::publishOutput(int w, int h){
+    // slots are sized for the window, so a resize means a new ring; readers
+    // notice the old one closing and reattach
+    if (!outputRing) {
+        outputRing.reset(new slitscan::ShmRingWriter());
+    }
+    if (!outputRing->create(options.publishName, w, h, w * 4, slitscan::SHM_RING_RGBA, ofGetFrameRate())) {
+        ofLogError() << "Can't create shared memory ring " << options.publishName;
+        outputRing.reset();
+        return false;
+    }
+    ofLogNotice() << "Publishing " << w << "x" << h << " output to shared memory ring " << options.publishName;
+    return true;
+}
+
+//--------------------------------------------------------------
+void ofApp::captureOutput(int w, int h){
+    if (recorder && (w != recorder->getWidth() || h != recorder->getHeight())) {
+        ofLogWarning() << "Window resized, stopping recording";
+        stopRecording();
+    }
+    if (outputRing && (w != (int)outputRing->getWidth() || h != (int)outputRing->getHeight())) {
+        publishOutput(w, h);
+    }
+    if (!recorder && !outputRing) {
+        return;
+    }
+    
+    if (useCpuRenderer && (cpuHistory || cpuTiered) && cpuPixels.size() == (size_t)w * h * 4) {
+        // the CPU renderer's output is already in memory; GL frames still being
+        // read back are older, so they go first
+        drainOutputPbos();
+        deliverOutput(cpuPixels.data(), w, h, false);
+        return;
+    }
+    
+    if (outputPboWidth != w || outputPboHeight != h) {
+        // (re)allocate for this size, forgetting readbacks of the old one
+        if (!outputPbos[0]) {
+            glGenBuffers(NUM_OUTPUT_PBOS, outputPbos);
+        }
+        for (int i = 0; i < NUM_OUTPUT_PBOS; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, outputPbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, NULL, GL_STREAM_READ);
+        }
+        outputPboWidth = w;
+        outputPboHeight = h;
+        outputPboIndex = 0;
+        outputPbosPending = 0;
+    }
+    
+    // start an asynchronous read of this frame into the next PBO...
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, damageTracking ? outputFbo.getId() : 0);
+    if (!damageTracking) {
+        glReadBuffer(GL_BACK);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, outputPbos[outputPboIndex]);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    outputPboIndex = (outputPboIndex + 1) % NUM_OUTPUT_PBOS;
+    outputPbosPending++;
+    
+    // ...and collect the one issued NUM_OUTPUT_PBOS-1 frames ago, which the GPU is done with
+    if (outputPbosPending == NUM_OUTPUT_PBOS) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, outputPbos[outputPboIndex]);
+        collectOutputPbo();
+        outputPbosPending--;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+//--------------------------------------------------------------
+void ofApp::drainOutputPbos(){
+    // collect the readbacks still in flight, oldest first
+    while (outputPbosPending > 0) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, outputPbos[(outputPboIndex + NUM_OUTPUT_PBOS - outputPbosPending) % NUM_OUTPUT_PBOS]);
+        collectOutputPbo();
+        outputPbosPending--;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+//--------------------------------------------------------------
+void ofApp::collectOutputPbo(){
+    // hands the bound GL_PIXEL_PACK_BUFFER to the recorder and publisher
+    const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (pixels) {
+        deliverOutput((const uint8_t*)pixels, outputPboWidth, outputPboHeight, true);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+}
+
+//--------------------------------------------------------------
+void ofApp::deliverOutput(const uint8_t* pixels, int w, int h, bool bottomUp){
+    if (recorder) {
+        uint8_t* frame = recorder->acquireFrame();
+        if (frame) {
+            memcpy(frame, pixels, (size_t)w * h * 4);
+            recorder->submitFrame(frame, bottomUp);
+        }
+        // else the writer is behind: dropped
+    }
+    if (outputRing) {
+        // published top-down, so readers don't have to care where it came from
+        uint8_t* frame = outputRing->beginFrame();
+        size_t row = (size_t)w * 4;
+        for (int y = 0; y < h; y++) {
+            memcpy(frame + row * y, pixels + row * (bottomUp ? h - 1 - y : y), row);
+        }
+        outputRing->commitFrame(frameTimestamp);
+    }
+}
+
+//--------------------------------------------------------------
+void ofApp::startRawRecording(const std::string& path){
+    if (!source) {
+        ofLogError() << "Raw recording needs a YUYV source (PS3 Eye, V4L2 or file)";
+        return;
+    }
+    rawRecorder.reset(new slitscan::RawStreamRecorder());
+    if (!rawRecorder->open(path, source->getWidth(), source->getHeight(), source->getRowBytes(), source->getFrameRate())) {
+        ofLogError() << "Can't record to " << path;
+        rawRecorder.reset();
+        return;
+    }
+    ofLogNotice() << "Recording camera to " << path;
+}
+
+//--------------------------------------------------------------
+void ofApp::stopRawRecording(){
+    if (!rawRecorder) {
+        return;
+    }
+    rawRecorder->close();
+    slitscan::RawStreamRecorder::Stats stats = rawRecorder->getStats();
+    ofLogNotice() << "Recorded " << stats.frames_written << " camera frames, dropped " << stats.frames_dropped;
+    rawRecorder.reset();
 }
 
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key){
     if (key == 'f') {
         ofToggleFullscreen();
+    } else if (key == 's') {
+        useShader = !useShader && timeShader.isLoaded();
+    } else if (key == 'c') {
+        timeMapIndex = (timeMapIndex + 1) % timeMaps.size();
+    } else if (key == '[' || key == ']') {
+        linearTimeMap->setAngle(linearTimeMap->getAngle() + (key == '[' ? -15 : 15));
+    } else if (key == 'r') {
+        useCpuRenderer = !useCpuRenderer;
+        // the frames as they come in, not the volume's WIDTH x HEIGHT: the
+        // grabber may not deliver the size it was asked for
+        int w = source ? source->getWidth() : cameraIn.getWidth();
+        int h = source ? source->getHeight() : cameraIn.getHeight();
+        if (useCpuRenderer && !cpuHistory && !cpuTiered && options.coldAfter > 0) {
+            cpuTiered.reset(new slitscan::TieredHistory(w, h, historyFrames, options.coldAfter));
+            cpuRenderer.reset(new slitscan::CpuRenderer());
+            if (pyramidLevels) {
+                ofLogWarning() << "The compressed history has no pyramid, the CPU renderer shows the base history only";
+            }
+        } else if (useCpuRenderer && !cpuHistory && !cpuTiered) {
+            // starts out black and fills up like the GL volume did at startup
+            cpuHistory.reset(new slitscan::FrameHistory(w, h, historyFrames));
+            cpuHistory->setLayerIndex(layerIndex);
+            cpuRenderer.reset(new slitscan::CpuRenderer());
+            if (pyramidLevels) {
+                cpuPyramid.reset(new slitscan::TemporalPyramid(cpuHistory->getWidth(), cpuHistory->getHeight(),
+                                                               historyFrames, pyramidLevels));
+            }
+        }
+    } else if (key == 'a') {
+        // 1, 2, 4 ... 16 frames per layer
+        int factor = decimator ? decimator->getFactor() * 2 : 2;
+        setDecimation(factor > 16 ? 1 : factor);
+    } else if (key == 'g') {
+        setChangeGate(changeDetector ? 0 : (options.changeThreshold > 0 ? options.changeThreshold : DEFAULT_CHANGE_THRESHOLD));
+    } else if (key == 'm') {
+        setPyramid(pyramidLevels ? 0 : (options.pyramidLevels > 0 ? options.pyramidLevels : DEFAULT_PYRAMID_LEVELS));
+    } else if (key == 'l') {
+        setStrips(!useStrips);
+    } else if (key == 'd') {
+        damageTracking = !damageTracking;
+        damageStats = DamageStats();
+    } else if (key == 'i') {
+        showStats = !showStats;
+    } else if (key == 'v') {
+        if (recorder) {
+            stopRecording();
+        } else {
+            startRecording(ofToDataPath("slitscan-" + ofGetTimestampString() + ".y4m"));
+        }
+    } else if (key == 'V') {
+        if (rawRecorder) {
+            stopRawRecording();
+        } else {
+            startRawRecording(ofToDataPath("camera-" + ofGetTimestampString() + ".slitraw"));
+        }
+#ifdef SLITSCAN_PROFILE
+    } else if (key == 'P') {
+        std::string path = ofToDataPath("profile-" + ofGetTimestampString() + ".csv");
+        if (slitscan::Profiler::instance().writeCSV(path)) {
+            ofLogNotice() << "Wrote stage timings to " << path;
+        }
+        slitscan::Profiler::instance().reset();
+    } else if (key == 't') {
+        slitscan::Profiler& profiler = slitscan::Profiler::instance();
+        if (!profiler.isTracing()) {
+            profiler.startTrace();
+        } else {
+            std::string path = ofToDataPath("trace-" + ofGetTimestampString() + ".json");
+            if (profiler.stopTrace(path)) {
+                ofLogNotice() << "Wrote trace to " << path;
+            }
+        }
+#endif
+    } else if (key == 'n') {
+        if (cpuRenderer) {
+            cpuRenderer->setFilter(cpuRenderer->getFilter() == slitscan::CpuRenderer::FILTER_NEAREST ?
+                                   slitscan::CpuRenderer::FILTER_TRILINEAR : slitscan::CpuRenderer::FILTER_NEAREST);
+        }
     }
 }
 
@@ -350,5 +1605,42 @@ void ofApp::gotMessage(ofMessage msg){
 
 //--------------------------------------------------------------
 void ofApp::dragEvent(ofDragInfo dragInfo){ 
+    // dropping a grayscale image uses it as the time map
+    for (size_t i = 0; i < dragInfo.files.size(); i++) {
+        if (loadTimeMapImage(dragInfo.files[i])) {
+            break;
+        }
+    }
+}
 
+//--------------------------------------------------------------
+bool ofApp::loadTimeMapImage(const std::string& path){
+    std::unique_ptr<slitscan::ImageTimeMap> map(slitscan::ImageTimeMap::loadPGM(path));
+    if (!map) {
+        // anything openframeworks can load; 8-bit images are widened to 16 bits
+        ofShortPixels pixels;
+        if (!ofLoadImage(pixels, path)) {
+            ofLogError() << "Can't load time map image " << path;
+            return false;
+        }
+        pixels.setImageType(OF_IMAGE_GRAYSCALE);
+        map.reset(new slitscan::ImageTimeMap(pixels.getData(), pixels.getWidth(), pixels.getHeight(), 65535));
+    }
+    
+    // evaluate it now, so that switching to it doesn't cost a frame
+    timeMapCache.getTable(*map, ofGetWidth(), ofGetHeight());
+    timeMapIndex = timeMaps.size();
+    for (size_t i = 0; i < timeMaps.size(); i++) {
+        if (timeMaps[i].get() == imageTimeMap) {
+            timeMapIndex = i;
+        }
+    }
+    imageTimeMap = map.get();
+    if (timeMapIndex == timeMaps.size()) {
+        timeMaps.push_back(std::move(map));
+    } else {
+        timeMaps[timeMapIndex] = std::move(map);
+    }
+    ofLogNotice() << "Loaded time map " << path;
+    return true;
 }
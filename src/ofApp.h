@@ -2,13 +2,59 @@
 
 #include "ofMain.h"
 #include "ps3eye.h"
+#include "frame_history.h"
+#include "temporal_pyramid.h"
+#include "tiered_history.h"
+#include "strip_history.h"
+#include "cpu_renderer.h"
+#include "time_map.h"
+#include "yuv.h"
+#include "frame_decimator.h"
+#include "change_detector.h"
+#include "frame_source.h"
+#include "ps3eye_source.h"
+#include "file_source.h"
+#include "v4l2_source.h"
+#include "output_recorder.h"
+#include "panorama_writer.h"
+#include "raw_stream.h"
+#include "history_snapshot.h"
+#include "shm_ring.h"
+#include "shm_camera_source.h"
+#include "profiler.h"
 
 class ofApp : public ofBaseApp{
 
 public:
+    // command line options, see main.cpp
+    struct Options {
+        std::string inputPath;      // Y4M or raw YUYV file to play instead of a camera
+        int rawWidth = 0, rawHeight = 0;
+        double fps = 0;             // 0 plays at the file's own rate
+        bool unthrottled = false;
+        std::string devicePath;     // V4L2 device to capture from instead of a PS3 Eye
+        std::string recordPath;     // start recording the output to this file (.y4m, or .rgb for raw)
+        std::string recordRawPath;  // start recording the camera's YUYV frames to this raw stream
+        std::string snapshotPath;   // keep the history in this file and restore it at startup
+        std::string publishName;    // publish the output to this POSIX shared memory ring
+        std::string cameraRing;     // read the camera from ps3eye_daemon's shared memory ring
+        int frames = 256;           // history layers
+        int decimation = 1;         // camera frames averaged into each layer
+        int pyramidLevels = 0;      // coarse history levels, each spanning twice the one below
+        int coldAfter = 0;          // CPU renderer: compress history layers older than this; 0 keeps all uncompressed
+        float changeThreshold = 0;  // mean difference per YUYV byte for a tile to count as changed; 0 writes every frame
+        std::string panoramaPath;   // append the centre column of every frame to a tiled panorama in this directory
+        bool latency = false;       // measure glass-to-glass latency
+        bool latencyLoopback = false; // ...and cross-check it with a flash played through the file source
+    };
+    
+    ofApp() {}
+    explicit ofApp(const Options& options) : options(options) {}
+    
     void setup();
     void update();
     void draw();
+    void exit();
 
     void keyPressed(int key);
     void keyReleased(int key);
@@ -23,12 +69,176 @@ public:
     void gotMessage(ofMessage msg);
     
 private:
+    // everything besides the history that affects the rendered image
+    struct RenderState {
+        int width = 0, height = 0;
+        uint32_t timeMapId = 0, timeMapVersion = 0;
+        bool useShader = false, useCpuRenderer = false, useStrips = false;
+        int cpuFilter = 0, pyramidLevels = 0;
+        bool operator==(const RenderState& o) const {
+            return width == o.width && height == o.height && timeMapId == o.timeMapId &&
+                   timeMapVersion == o.timeMapVersion && useShader == o.useShader &&
+                   useCpuRenderer == o.useCpuRenderer && useStrips == o.useStrips && cpuFilter == o.cpuFilter &&
+                   pyramidLevels == o.pyramidLevels;
+        }
+    };
+    
+    struct DamageStats {
+        uint64_t rendered = 0, skipped = 0;
+        uint64_t cpuMicros = 0;     // summed over all renders
+        uint64_t gpuMicros = 0;     // summed over gpuSamples timed renders
+        uint64_t gpuSamples = 0;
+    };
+    
+    bool loadTimeMapImage(const std::string& path);
+    void openFileSource();
+    void openV4L2Source(const std::string& device);
+    void openCameraRing();
+    void allocateVideoFrame();
+    void renderSlitScan(int w, int h);
+    void renderStrips(int w, int h);
+    void renderPyramid(int w, int h);
+    void uploadTimeTable(const float* table, int w, int h);
+    void drawCpuPixels(int w, int h);
+    slitscan::StripHistory::Slit chooseSlit() const;
+    void pushStrip();
+    // 'l': the strip history replaces the GL history volume, which is freed
+    void setStrips(bool enable);
+    void setDecimation(int factor);
+    void setPyramid(int levels);
+    void writePyramidLevels();
+    void setChangeGate(float threshold);
+    void convertChangedTiles(const uint8_t* yuyv, int stride);
+    void uploadChangedTiles();
+    void startPanorama(const std::string& directory);
+    void appendPanoramaColumn();
+    void collectRenderTimer();
+    void drawStats();
+    void startRecording(const std::string& path);
+    void stopRecording();
+    bool publishOutput(int w, int h);
+    void captureOutput(int w, int h);
+    void collectOutputPbo();
+    void drainOutputPbos();
+    void deliverOutput(const uint8_t* pixels, int w, int h, bool bottomUp);
+    void startRawRecording(const std::string& path);
+    void stopRawRecording();
+    void writeHistoryLayer();
+    void snapshotLayer();
+    void openLatencyLoopback();
+    void measureLatency();
+    void updateFlashProbe(int w, int h);
+
+    Options        options;
     ofVideoGrabber cameraIn;
     ofFbo          cameraWriter;
     ofTexture      cameraOutput;
     int            layerIndex;
+    int            historyFrames;   // layers in the history volume, options.frames within GL's limit
     ps3eye::PS3EYECam::PS3EYERef eye = NULL;
-    unsigned char *		videoFrame;
+    std::shared_ptr<slitscan::FrameSource> source; // PS3 Eye, camera ring, V4L2 or file; NULL uses cameraIn
+    std::shared_ptr<slitscan::V4L2Source> v4l2Source; // same as source when capturing through V4L2
+    std::shared_ptr<slitscan::ShmCameraSource> cameraRingSource; // same as source when reading the camera ring
+    unsigned char *		videoFrame = NULL;
+    std::unique_ptr<slitscan::FrameDecimator> decimator; // averages N source frames per layer ('a')
+    // change gate ('g'): static frames don't make a layer, and only the tiles
+    // that changed are converted and uploaded into videoTexture
+    std::unique_ptr<slitscan::ChangeDetector> changeDetector;
     ofTexture			videoTexture;
+    ofShader            timeShader;
+    bool                useShader = true;    // per-pixel time map instead of vertex grid
+    
+    // time maps, cycled with 'c'; timeMapCache only re-evaluates them on change
+    std::vector<std::unique_ptr<slitscan::TimeMap>> timeMaps;
+    slitscan::LinearTimeMap* linearTimeMap;
+    slitscan::ImageTimeMap* imageTimeMap = NULL;    // the last dropped image, replaced by the next
+    size_t              timeMapIndex;
+    slitscan::TimeMapCache timeMapCache;
+    ofTexture           timeTableTexture;
+    uint32_t            timeTableGeneration = 0;
+
+    // CPU rendering path, allocated the first time it's enabled. With
+    // --cold-after its history is cpuTiered, which keeps older layers
+    // compressed, instead of cpuHistory (and has no pyramid).
+    std::unique_ptr<slitscan::FrameHistory> cpuHistory;
+    std::unique_ptr<slitscan::TieredHistory> cpuTiered;
+    std::unique_ptr<slitscan::CpuRenderer>  cpuRenderer;
+    std::vector<uint8_t> cpuPixels;
+    ofTexture           cpuTexture;
+    bool                useCpuRenderer = false;
+    
+    // strip-only history ('l'): just the slit of each frame, so it spans
+    // STRIP_FRAMES frames in a few MB; rendered by stripShader or the CPU renderer
+    std::unique_ptr<slitscan::StripHistory> stripHistory;
+    ofTexture           stripTexture;       // one strip per row, like the history's layers
+    ofShader            stripShader;
+    bool                useStrips = false;
+    
+    // temporal pyramid ('m'): coarse history levels spanning 2x, 4x ... the
+    // history, each layer the average of two of the level below. On the GL path
+    // level k is pyramidTextures[k - 1], written by averageShader; the CPU
+    // renderer has its own in cpuPyramid.
+    static const int    MAX_PYRAMID_LEVELS = 4;    // samplers in pyramidShader
+    int                 pyramidLevels = 0;
+    std::unique_ptr<slitscan::PyramidLayout> pyramidLayout;
+    ofTexture           pyramidTextures[MAX_PYRAMID_LEVELS];
+    ofShader            pyramidShader;
+    ofShader            averageShader;
+    std::unique_ptr<slitscan::TemporalPyramid> cpuPyramid;
+    
+    // damage-driven redraw: the composited output is kept in outputFbo and only
+    // re-rendered when the history or the render state changed
+    ofFbo               outputFbo;
+    bool                damageTracking = true;
+    bool                historyChanged = true;
+    RenderState         lastRenderState;
+    DamageStats         damageStats;
+    GLuint              renderQuery = 0;
+    bool                renderQueryPending = false;
+    bool                showStats = false;
+    
+    // output recording ('v') and publishing (--publish): GL frames are read back
+    // through a ring of PBOs so glReadPixels never waits for the GPU, then
+    // written out by the recorder thread and/or copied into the shared memory ring
+    static const int    NUM_OUTPUT_PBOS = 3;
+    std::unique_ptr<slitscan::OutputRecorder> recorder;
+    std::unique_ptr<slitscan::ShmRingWriter> outputRing;
+    GLuint              outputPbos[NUM_OUTPUT_PBOS] = {};
+    int                 outputPboWidth = 0, outputPboHeight = 0;
+    int                 outputPboIndex = 0;     // next PBO to read into
+    int                 outputPbosPending = 0;  // readbacks issued but not collected yet
+    double              frameTimestamp = 0;     // capture time of the newest frame, steady_clock seconds
+    
+    // photo-finish panorama (--panorama): one column per frame, tiles written
+    // by the panorama's own thread
+    std::unique_ptr<slitscan::PanoramaWriter> panorama;
+    
+    // camera recording ('V'): source frames go to rawRecorder instead of being freed
+    std::unique_ptr<slitscan::RawStreamRecorder> rawRecorder;
+    
+    // persistent history (--snapshot): every new layer is read back through a
+    // PBO ring like the recorder's and checkpointed by snapshot's own thread
+    static const int    NUM_SNAPSHOT_PBOS = 3;
+    std::unique_ptr<slitscan::HistorySnapshot> snapshot;
+    GLuint              snapshotPbos[NUM_SNAPSHOT_PBOS] = {};
+    int                 snapshotPboLayers[NUM_SNAPSHOT_PBOS] = {};
+    int                 snapshotPboIndex = 0;
+    int                 snapshotPbosPending = 0;
+    
+    // glass-to-glass latency (--latency): from a frame's capture stamp (first
+    // USB packet for the PS3 Eye) to the end of the buffer swap that first
+    // presents it, in ns
+    slitscan::LatencyHistogram latencyHistogram;
+    double              latencyWrittenStamp = 0; // frame written to the volume, not drawn yet
+    double              latencyDrawnStamp = 0;   // drawn, its swap not waited for yet
+    
+    // --latency-loopback: a generated flash plays through the file source and is
+    // timed by reading it back from the front buffer, no photodiode needed
+    slitscan::LatencyHistogram flashHistogram;
+    double              flashStamp = 0;          // delivery of the newest flash frame
+    bool                flashInSource = false;
+    bool                flashOnScreen = false;
+    int                 flashProbeX = 0, flashProbeY = 0; // output pixel showing the newest layer
+    uint32_t            flashProbeGeneration = 0;
 
 };
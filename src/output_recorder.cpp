@@ -0,0 +1,111 @@
+#include "output_recorder.h"
+
+#include <chrono>
+
+namespace slitscan {
+
+OutputRecorder::OutputRecorder(size_t pool_frames) :
+    pool_frames(pool_frames),
+    width(0),
+    height(0),
+    file_frame_bytes(0),
+    frames_written(0),
+    frames_dropped(0),
+    bytes_written(0),
+    write_micros(0)
+{
+}
+
+OutputRecorder::~OutputRecorder()
+{
+    close();
+}
+
+bool OutputRecorder::open(const std::string& path, int w, int h, int fps_num, int fps_den, bool raw_rgb)
+{
+    close();
+    if (!file.open(path, w, h, fps_num, fps_den, raw_rgb)) {
+        return false;
+    }
+    width = w;
+    height = h;
+    // both Y4M 4:4:4 and raw RGB take 3 bytes per pixel; Y4M adds "FRAME\n"
+    file_frame_bytes = (size_t)w * h * 3 + (raw_rgb ? 0 : 6);
+    frames_written = 0;
+    frames_dropped = 0;
+    bytes_written = 0;
+    write_micros = 0;
+
+    pool.assign(pool_frames, std::vector<uint8_t>((size_t)w * h * 4));
+    free_frames.reset(new BoundedQueue<uint8_t*>(pool_frames));
+    queued_frames.reset(new BoundedQueue<Frame>(pool_frames));
+    for (size_t i = 0; i < pool.size(); i++) {
+        uint8_t* frame = &pool[i][0];
+        free_frames->push(std::move(frame));
+    }
+    writer = std::thread(&OutputRecorder::writerLoop, this);
+    return true;
+}
+
+void OutputRecorder::close()
+{
+    if (!writer.joinable()) {
+        return;
+    }
+    queued_frames->close();
+    writer.join();
+    file.close();
+    pool.clear();
+}
+
+uint8_t* OutputRecorder::acquireFrame()
+{
+    uint8_t* frame = NULL;
+    if (!isOpen() || !free_frames->tryPop(frame)) {
+        frames_dropped++;
+        return NULL;
+    }
+    return frame;
+}
+
+void OutputRecorder::submitFrame(uint8_t* data, bool bottom_up)
+{
+    // never blocks: every buffer in flight came out of the pool, which is
+    // exactly as big as the queue
+    Frame frame = { data, bottom_up };
+    queued_frames->tryPush(std::move(frame));
+}
+
+void OutputRecorder::writerLoop()
+{
+    Frame frame;
+    while (queued_frames->pop(frame)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int stride = width * 4;
+        const uint8_t* first_row = frame.data;
+        if (frame.bottom_up) {
+            first_row += (size_t)stride * (height - 1);
+            stride = -stride;
+        }
+        if (file.writeFrame(first_row, stride)) {
+            frames_written++;
+            bytes_written += file_frame_bytes;
+        } else {
+            frames_dropped++;
+        }
+        write_micros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        free_frames->push(std::move(frame.data));
+    }
+}
+
+OutputRecorder::Stats OutputRecorder::getStats() const
+{
+    Stats stats;
+    stats.frames_written = frames_written;
+    stats.frames_dropped = frames_dropped;
+    stats.bytes_written = bytes_written;
+    stats.write_seconds = write_micros * 1e-6;
+    return stats;
+}
+
+} // namespace
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "bounded_queue.h"
+#include "y4m.h"
+
+namespace slitscan {
+
+// Records rendered frames to a Y4M (or raw RGB) file without stalling the
+// render thread. Frames are copied into one of a fixed pool of buffers and
+// written out by a background thread; when the writer falls behind and the pool
+// is empty, frames are dropped (and counted) rather than queued without bound.
+class OutputRecorder
+{
+public:
+    struct Stats {
+        uint64_t frames_written;
+        uint64_t frames_dropped;    // pool exhausted or the write failed
+        uint64_t bytes_written;
+        double write_seconds;       // writer thread time spent converting and writing
+    };
+
+    // pool_frames bounds memory at pool_frames * width * height * 4 bytes
+    explicit OutputRecorder(size_t pool_frames = 8);
+    ~OutputRecorder();
+
+    // raw_rgb writes headerless packed RGB instead of Y4M
+    bool open(const std::string& path, int width, int height, int fps_num, int fps_den = 1, bool raw_rgb = false);
+    // Writes out everything already queued, then closes the file
+    void close();
+    bool isOpen() const { return writer.joinable(); }
+
+    // Returns a free width * height * 4 byte RGBA buffer to fill, or NULL (and
+    // counts a dropped frame) if the writer is behind
+    uint8_t* acquireFrame();
+    // Queues a buffer from acquireFrame(); bottom_up for GL readbacks
+    void submitFrame(uint8_t* frame, bool bottom_up);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    Stats getStats() const;
+
+private:
+    OutputRecorder(const OutputRecorder&);
+    void operator=(const OutputRecorder&);
+
+    struct Frame {
+        uint8_t* data;
+        bool bottom_up;
+    };
+
+    void writerLoop();
+
+    size_t pool_frames;
+    int width;
+    int height;
+    size_t file_frame_bytes;
+    Y4MWriter file;
+    std::vector<std::vector<uint8_t> > pool;
+    // recreated by every open(), since closed queues stay closed
+    std::unique_ptr<BoundedQueue<uint8_t*> > free_frames;
+    std::unique_ptr<BoundedQueue<Frame> > queued_frames;
+    std::thread writer;
+
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> write_micros;
+};
+
+} // namespace
@@ -0,0 +1,286 @@
+#include "panorama_writer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+namespace slitscan {
+
+PanoramaWriter::PanoramaWriter(size_t pool_tiles) :
+    pool_tiles(pool_tiles),
+    height(0),
+    tile_width(0),
+    levels(0),
+    tile_bytes(0),
+    current(NULL),
+    columns(0),
+    appended(0),
+    tiles_written(0),
+    tiles_dropped(0),
+    bytes_written(0),
+    write_micros(0)
+{
+}
+
+PanoramaWriter::~PanoramaWriter()
+{
+    close();
+}
+
+std::string PanoramaWriter::getTilePath(const std::string& directory, int level, uint64_t index)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/tile-%d-%06llu.ppm", level, (unsigned long long)index);
+    return directory + name;
+}
+
+std::string PanoramaWriter::getIndexPath(const std::string& directory)
+{
+    return directory + "/panorama.txt";
+}
+
+bool PanoramaWriter::open(const std::string& dir, int h, int tw)
+{
+    close();
+    directory = dir;
+    height = h;
+    // pairs of columns are averaged into the next level
+    tile_width = (std::max)(2, tw & ~1);
+    levels = 1;
+    while (levels < MAX_LEVELS && (height >> levels) >= 1) {
+        levels++;
+    }
+    tile_bytes = (size_t)tile_width * height * 3;
+    columns = 0;
+    current = NULL;
+    appended = 0;
+    tiles_written = 0;
+    tiles_dropped = 0;
+    bytes_written = 0;
+    write_micros = 0;
+
+    // fails early if the directory isn't writable
+    writeIndex(0);
+    FILE* index = fopen(getIndexPath(directory).c_str(), "r");
+    if (!index) {
+        return false;
+    }
+    fclose(index);
+
+    pyramid.resize(levels);
+    for (int l = 1; l < levels; l++) {
+        pyramid[l].height = height >> l;
+        pyramid[l].pixels.assign((size_t)tile_width * pyramid[l].height * 3, 0);
+        pyramid[l].index = 0;
+        pyramid[l].filled = false;
+    }
+    pool.assign(pool_tiles, std::vector<uint8_t>(tile_bytes));
+    free_tiles.reset(new BoundedQueue<uint8_t*>(pool_tiles));
+    queued_tiles.reset(new BoundedQueue<Tile>(pool_tiles));
+    for (size_t i = 0; i < pool.size(); i++) {
+        uint8_t* tile = &pool[i][0];
+        free_tiles->push(std::move(tile));
+    }
+    writer = std::thread(&PanoramaWriter::writerLoop, this);
+    return true;
+}
+
+void PanoramaWriter::close()
+{
+    if (!writer.joinable()) {
+        return;
+    }
+    if (current) {
+        // the last, partly filled tile
+        Tile tile = { current, columns / tile_width, (int)(columns % tile_width) };
+        queued_tiles->tryPush(std::move(tile));
+        current = NULL;
+    }
+    queued_tiles->close();
+    writer.join();
+    pool.clear();
+    pyramid.clear();
+}
+
+uint8_t* PanoramaWriter::beginColumn()
+{
+    int column = (int)(columns % tile_width);
+    if (column == 0) {
+        current = NULL;
+        if (!free_tiles->tryPop(current)) {
+            // drop this whole tile, so the next one starts where it should
+            current = NULL;
+            tiles_dropped++;
+        }
+    }
+    return current ? current + column * 3 : NULL;
+}
+
+void PanoramaWriter::endColumn()
+{
+    columns++;
+    appended = columns;
+    if (columns % tile_width == 0 && current) {
+        // never blocks: every tile in flight came out of the pool, which is
+        // exactly as big as the queue
+        Tile tile = { current, columns / tile_width - 1, tile_width };
+        queued_tiles->tryPush(std::move(tile));
+        current = NULL;
+    }
+}
+
+void PanoramaWriter::appendColumnRGBA(const uint8_t* rgba, int stride, int x)
+{
+    if (!isOpen()) {
+        return;
+    }
+    uint8_t* dst = beginColumn();
+    if (dst) {
+        const uint8_t* src = rgba + x * 4;
+        for (int y = 0; y < height; y++, src += stride, dst += tile_width * 3) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+    }
+    endColumn();
+}
+
+void PanoramaWriter::appendColumnRGB(const uint8_t* rgb, int stride, int x)
+{
+    if (!isOpen()) {
+        return;
+    }
+    uint8_t* dst = beginColumn();
+    if (dst) {
+        const uint8_t* src = rgb + x * 3;
+        for (int y = 0; y < height; y++, src += stride, dst += tile_width * 3) {
+            memcpy(dst, src, 3);
+        }
+    }
+    endColumn();
+}
+
+void PanoramaWriter::writerLoop()
+{
+    Tile tile;
+    while (queued_tiles->pop(tile)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (tile.columns < tile_width) {
+            // pool tiles are reused: black out what the last one left behind
+            for (int y = 0; y < height; y++) {
+                memset(tile.data + ((size_t)y * tile_width + tile.columns) * 3, 0, (tile_width - tile.columns) * 3);
+            }
+        }
+        if (!writeTile(0, tile.index, tile.data, height)) {
+            tiles_dropped++;
+        }
+        if (levels > 1) {
+            addToLevel(1, tile.index, tile.data);
+        }
+        writeIndex(tile.index * tile_width + tile.columns);
+        write_micros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        free_tiles->push(std::move(tile.data));
+    }
+
+    // closing: write out the partly filled tiles, bottom up so each one still
+    // reaches the levels above it
+    for (int l = 1; l < levels; l++) {
+        if (pyramid[l].filled) {
+            flushLevel(l);
+        }
+    }
+    writeIndex(appended);
+}
+
+void PanoramaWriter::addToLevel(int level, uint64_t index, const uint8_t* pixels)
+{
+    // pixels is tile index of the level below; it becomes one half of tile index / 2
+    Level& lv = pyramid[level];
+    uint64_t target = index / 2;
+    if (lv.filled && lv.index != target) {
+        // the other half never came (dropped tile)
+        flushLevel(level);
+    }
+    lv.index = target;
+    lv.filled = true;
+
+    const int half = tile_width / 2;
+    const size_t row = (size_t)tile_width * 3;
+    uint8_t* dst = &lv.pixels[(index % 2) * half * 3];
+    for (int y = 0; y < lv.height; y++, dst += row) {
+        const uint8_t* s0 = pixels + 2 * y * row;
+        const uint8_t* s1 = s0 + row;
+        for (int x = 0; x < half * 3; x += 3) {
+            for (int c = 0; c < 3; c++) {
+                int i = 2 * x + c;
+                dst[x + c] = (uint8_t)((s0[i] + s0[i + 3] + s1[i] + s1[i + 3] + 2) >> 2);
+            }
+        }
+    }
+
+    if (index % 2 == 1) {
+        flushLevel(level);
+    }
+}
+
+void PanoramaWriter::flushLevel(int level)
+{
+    Level& lv = pyramid[level];
+    writeTile(level, lv.index, lv.pixels.data(), lv.height);
+    if (level + 1 < levels) {
+        addToLevel(level + 1, lv.index, lv.pixels.data());
+    }
+    std::fill(lv.pixels.begin(), lv.pixels.end(), 0);
+    lv.filled = false;
+}
+
+bool PanoramaWriter::writeTile(int level, uint64_t index, const uint8_t* pixels, int tile_height)
+{
+    FILE* file = fopen(getTilePath(directory, level, index).c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    int header = fprintf(file, "P6\n%d %d\n255\n", tile_width, tile_height);
+    size_t size = (size_t)tile_width * tile_height * 3;
+    bool ok = header > 0 && fwrite(pixels, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (ok) {
+        tiles_written++;
+        bytes_written += header + size;
+    }
+    return ok;
+}
+
+void PanoramaWriter::writeIndex(uint64_t width)
+{
+    // replaced in one rename, so readers never see half of it
+    std::string path = getIndexPath(directory);
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "columns %llu\nheight %d\ntile_width %d\nlevels %d\n",
+            (unsigned long long)width, height, tile_width, levels);
+    if (fclose(file) == 0) {
+#ifdef _WIN32
+        remove(path.c_str());
+#endif
+        rename(temp.c_str(), path.c_str());
+    }
+}
+
+PanoramaWriter::Stats PanoramaWriter::getStats() const
+{
+    Stats stats;
+    stats.columns = appended;
+    stats.tiles_written = tiles_written;
+    stats.tiles_dropped = tiles_dropped;
+    stats.bytes_written = bytes_written;
+    stats.write_seconds = write_micros * 1e-6;
+    return stats;
+}
+
+} // namespace
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "bounded_queue.h"
+
+namespace slitscan {
+
+// Endless "photo-finish" panorama: one column per frame, appended to an image
+// of unbounded width that is cut into tiles of tile_width columns and written
+// to disk (binary PPM) by a background thread. Memory stays at a fixed pool of
+// tiles however long the capture runs; when the writer falls behind and the
+// pool is empty, a whole tile is dropped (and counted) rather than stalling
+// the capture thread, so the tiles stay aligned.
+//
+// The writer also builds a pyramid for zoomed-out previews: a tile of level L
+// is the 2x2 box-filtered pair of level L-1 tiles below it, so it covers
+// tile_width << L columns at height >> L rows. Tiles are named
+// directory/tile-<level>-<index>.ppm, and directory/panorama.txt says how far
+// the panorama got (rewritten after every tile, so a crash loses one tile at most).
+class PanoramaWriter
+{
+public:
+    static const int DEFAULT_TILE_WIDTH = 256;
+    static const int MAX_LEVELS = 10;
+
+    struct Stats {
+        uint64_t columns;           // appended so far
+        uint64_t tiles_written;     // all levels
+        uint64_t tiles_dropped;     // level 0 tiles lost to a full pool or a failed write
+        uint64_t bytes_written;
+        double write_seconds;       // writer thread time spent filtering and writing
+    };
+
+    // pool_tiles bounds memory at pool_tiles level 0 tiles
+    explicit PanoramaWriter(size_t pool_tiles = 4);
+    ~PanoramaWriter();
+
+    // directory has to exist; height is the column height, the frame height
+    bool open(const std::string& directory, int height, int tile_width = DEFAULT_TILE_WIDTH);
+    // Writes out everything queued, the partly filled tiles of every level and
+    // the final index, then stops the writer
+    void close();
+    bool isOpen() const { return writer.joinable(); }
+
+    // Append column x of a frame of height() rows: packed RGBA (as produced by
+    // yuv422_to_rgba) or RGB, stride bytes per row
+    void appendColumnRGBA(const uint8_t* rgba, int stride, int x);
+    void appendColumnRGB(const uint8_t* rgb, int stride, int x);
+
+    int getHeight() const { return height; }
+    int getTileWidth() const { return tile_width; }
+    int getLevels() const { return levels; }
+    Stats getStats() const;
+
+    static std::string getTilePath(const std::string& directory, int level, uint64_t index);
+    static std::string getIndexPath(const std::string& directory);
+
+private:
+    PanoramaWriter(const PanoramaWriter&);
+    void operator=(const PanoramaWriter&);
+
+    struct Tile {
+        uint8_t* data;
+        uint64_t index;
+        int columns;        // filled; less than tile_width only for the last one
+    };
+
+    // a partly filled tile of a pyramid level, owned by the writer thread
+    struct Level {
+        std::vector<uint8_t> pixels;
+        int height;
+        uint64_t index;
+        bool filled;
+    };
+
+    uint8_t* beginColumn();
+    void endColumn();
+    void writerLoop();
+    void addToLevel(int level, uint64_t index, const uint8_t* pixels);
+    void flushLevel(int level);
+    bool writeTile(int level, uint64_t index, const uint8_t* pixels, int tile_height);
+    void writeIndex(uint64_t columns);
+
+    size_t pool_tiles;
+    std::string directory;
+    int height;
+    int tile_width;
+    int levels;
+    size_t tile_bytes;
+
+    // capture thread side: the tile being filled, NULL while a tile is being dropped
+    uint8_t* current;
+    uint64_t columns;
+
+    std::vector<std::vector<uint8_t> > pool;
+    std::unique_ptr<BoundedQueue<uint8_t*> > free_tiles;
+    std::unique_ptr<BoundedQueue<Tile> > queued_tiles;
+    std::thread writer;
+    std::vector<Level> pyramid;     // levels 1 and up; [0] is unused
+
+    std::atomic<uint64_t> appended;
+    std::atomic<uint64_t> tiles_written;
+    std::atomic<uint64_t> tiles_dropped;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> write_micros;
+};
+
+} // namespace
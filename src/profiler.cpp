@@ -0,0 +1,238 @@
+#include "profiler.h"
+
+#include <cstdio>
+#include <chrono>
+
+// plain TLS for a POD pointer; older Xcode toolchains lack C++11 thread_local
+#if defined(_MSC_VER)
+    #define SLITSCAN_THREAD_LOCAL __declspec(thread)
+#else
+    #define SLITSCAN_THREAD_LOCAL __thread
+#endif
+
+namespace slitscan {
+
+static const char* stage_names[NUM_PROFILE_STAGES] = {
+    "usb_transfer",
+    "pkt_scan",
+    "frame_queue",
+    "yuv422_to_rgba",
+    "texture_upload",
+    "history_write",
+    "draw"
+};
+
+// ring slots stopTrace() leaves alone at the old end: threads that haven't seen
+// tracing switch off yet keep writing there while the trace is written out
+static const uint64_t TRACE_MARGIN = 4096;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::getBucket(uint64_t ns)
+{
+    if (ns < (1u << SUB_BUCKET_BITS)) {
+        return (int)ns;
+    }
+    int exponent = 63;
+    while (!(ns >> exponent)) {
+        exponent--;
+    }
+    int shift = exponent - SUB_BUCKET_BITS;
+    return ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + (int)((ns >> shift) & ((1 << SUB_BUCKET_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::getBucketMiddle(int bucket)
+{
+    if (bucket < (1 << SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    uint64_t low = (uint64_t)((1 << SUB_BUCKET_BITS) + (bucket & ((1 << SUB_BUCKET_BITS) - 1))) << shift;
+    return low + ((uint64_t)1 << shift) / 2;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    buckets[getBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t old_max = max.load(std::memory_order_relaxed);
+    while (ns > old_max && !max.compare_exchange_weak(old_max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::getMean() const
+{
+    uint64_t n = getCount();
+    return n ? sum.load(std::memory_order_relaxed) / (double)n : 0;
+}
+
+uint64_t LatencyHistogram::getPercentile(double p) const
+{
+    uint64_t n = getCount();
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p * (n - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // never report more than was actually seen
+            uint64_t middle = getBucketMiddle(i);
+            return middle < getMax() ? middle : getMax();
+        }
+    }
+    return getMax();
+}
+
+Profiler::Profiler() :
+    tracing(false)
+{
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+const char* Profiler::getStageName(ProfileStage stage)
+{
+    return stage_names[stage];
+}
+
+uint64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::ThreadTrace* Profiler::getThreadTrace()
+{
+    static SLITSCAN_THREAD_LOCAL ThreadTrace* thread_trace = NULL;
+    if (!thread_trace) {
+        Profiler& profiler = instance();
+        std::lock_guard<std::mutex> lock(profiler.threads_mutex);
+        ThreadTrace* trace = new ThreadTrace();
+        trace->id = (uint32_t)profiler.threads.size() + 1;
+        trace->name = "thread " + std::to_string(trace->id);
+        trace->frame = 0;
+        trace->written.store(0, std::memory_order_relaxed);
+        trace->trace_start = 0;
+        trace->events.resize(ThreadTrace::CAPACITY);
+        // threads don't unregister: the buffer outlives them so their events can still be written out
+        profiler.threads.push_back(std::unique_ptr<ThreadTrace>(trace));
+        thread_trace = trace;
+    }
+    return thread_trace;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+    ThreadTrace* trace = getThreadTrace();
+    std::lock_guard<std::mutex> lock(instance().threads_mutex);
+    trace->name = name;
+}
+
+void Profiler::setFrame(uint64_t frame)
+{
+    getThreadTrace()->frame = frame;
+}
+
+void Profiler::record(ProfileStage stage, uint64_t start_ns, uint64_t end_ns)
+{
+    histograms[stage].record(end_ns - start_ns);
+    if (!tracing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ThreadTrace* trace = getThreadTrace();
+    uint64_t index = trace->written.load(std::memory_order_relaxed);
+    Event& event = trace->events[index % ThreadTrace::CAPACITY];
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    event.frame = trace->frame;
+    event.stage = stage;
+    trace->written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::reset()
+{
+    for (int i = 0; i < NUM_PROFILE_STAGES; i++) {
+        histograms[i].reset();
+    }
+}
+
+bool Profiler::writeCSV(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "stage,count,mean_us,p50_us,p95_us,p99_us,max_us\n");
+    for (int i = 0; i < NUM_PROFILE_STAGES; i++) {
+        const LatencyHistogram& h = histograms[i];
+        fprintf(file, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", stage_names[i], (unsigned long long)h.getCount(),
+                h.getMean() / 1000, h.getPercentile(0.5) / 1000.0, h.getPercentile(0.95) / 1000.0,
+                h.getPercentile(0.99) / 1000.0, h.getMax() / 1000.0);
+    }
+    return fclose(file) == 0;
+}
+
+void Profiler::startTrace()
+{
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->trace_start = threads[i]->written.load(std::memory_order_acquire);
+    }
+    tracing.store(true, std::memory_order_relaxed);
+}
+
+bool Profiler::stopTrace(const std::string& path)
+{
+    tracing.store(false, std::memory_order_relaxed);
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t t = 0; t < threads.size(); t++) {
+        ThreadTrace& trace = *threads[t];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", trace.id, trace.name.c_str());
+        first = false;
+
+        // anything older than the ring's capacity has been overwritten, and the
+        // oldest TRACE_MARGIN events may be overwritten while we read
+        uint64_t end = trace.written.load(std::memory_order_acquire);
+        uint64_t begin = trace.trace_start;
+        if (end - begin > ThreadTrace::CAPACITY - TRACE_MARGIN) {
+            begin = end - (ThreadTrace::CAPACITY - TRACE_MARGIN);
+        }
+        for (uint64_t i = begin; i < end; i++) {
+            const Event& event = trace.events[i % ThreadTrace::CAPACITY];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                    stage_names[event.stage], trace.id, event.start_ns / 1000.0, event.duration_ns / 1000.0,
+                    (unsigned long long)event.frame);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+} // namespace
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+// Per-stage pipeline instrumentation: every SLITSCAN_PROFILE_SCOPE feeds a
+// latency histogram for its stage and, while a trace is being captured, a
+// complete event into a per-thread buffer that can be written out as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Everything is compiled out unless SLITSCAN_PROFILE is defined; when it is, a
+// scope costs two clock reads and a few uncontended atomic adds.
+
+namespace slitscan {
+
+enum ProfileStage {
+    STAGE_USB_TRANSFER,     // interval between completed USB transfers
+    STAGE_PKT_SCAN,         // UVC payload parsing and frame assembly
+    STAGE_FRAME_QUEUE,      // FrameQueue::Dequeue, waiting for and copying out a frame
+    STAGE_YUV_TO_RGBA,
+    STAGE_TEXTURE_UPLOAD,
+    STAGE_HISTORY_WRITE,    // rendering the frame into its history layer
+    STAGE_DRAW,
+    NUM_PROFILE_STAGES
+};
+
+// Log-linear histogram of durations in nanoseconds, 16 buckets per power of
+// two (about 6% resolution). Safe to record from any number of threads.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+    double getMean() const;
+    // p in [0, 1]; returns the middle of the bucket holding that quantile
+    uint64_t getPercentile(double p) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    static int getBucket(uint64_t ns);
+    static uint64_t getBucketMiddle(int bucket);
+
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+class Profiler
+{
+public:
+    static Profiler& instance();
+
+    static const char* getStageName(ProfileStage stage);
+    // nanoseconds on steady_clock
+    static uint64_t now();
+
+    void record(ProfileStage stage, uint64_t start_ns, uint64_t end_ns);
+    const LatencyHistogram& getHistogram(ProfileStage stage) const { return histograms[stage]; }
+    void reset();
+    // stage,count,mean_us,p50_us,p95_us,p99_us,max_us
+    bool writeCSV(const std::string& path) const;
+
+    // Tracing: events are kept in a ring per thread (the newest ~60k make it
+    // into the trace), so a trace covers the last few seconds before stopTrace()
+    void startTrace();
+    bool stopTrace(const std::string& path);
+    bool isTracing() const { return tracing.load(std::memory_order_relaxed); }
+
+    // Names the calling thread in traces
+    static void setThreadName(const char* name);
+    // Frame sequence number attached to the calling thread's events from now on;
+    // the camera's own numbering (FrameSource::getFrameSequence()), so events on
+    // the USB thread and the render thread line up
+    static void setFrame(uint64_t frame);
+
+private:
+    Profiler();
+    Profiler(const Profiler&);
+    void operator=(const Profiler&);
+
+    struct Event {
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        uint64_t frame;
+        uint32_t stage;
+    };
+
+    // written only by its thread; read by stopTrace()
+    struct ThreadTrace {
+        static const size_t CAPACITY = 1 << 16;
+        std::string name;
+        uint32_t id;
+        uint64_t frame;
+        std::atomic<uint64_t> written;
+        uint64_t trace_start;           // written at startTrace()
+        std::vector<Event> events;
+    };
+
+    static ThreadTrace* getThreadTrace();
+
+    LatencyHistogram histograms[NUM_PROFILE_STAGES];
+    std::atomic<bool> tracing;
+    std::mutex threads_mutex;
+    std::vector<std::unique_ptr<ThreadTrace> > threads;
+};
+
+// Times its own lifetime as one occurrence of a stage
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(ProfileStage stage) : stage(stage), start(Profiler::now()) {}
+    ~ScopedTimer() { Profiler::instance().record(stage, start, Profiler::now()); }
+
+private:
+    ProfileStage stage;
+    uint64_t start;
+};
+
+} // namespace
+
+#ifdef SLITSCAN_PROFILE
+    #define SLITSCAN_PROFILE_CONCAT2(a, b) a##b
+    #define SLITSCAN_PROFILE_CONCAT(a, b) SLITSCAN_PROFILE_CONCAT2(a, b)
+    #define SLITSCAN_PROFILE_SCOPE(stage) slitscan::ScopedTimer SLITSCAN_PROFILE_CONCAT(profile_scope_, __LINE__)(slitscan::stage)
+    #define SLITSCAN_PROFILE_RECORD(stage, start_ns, end_ns) slitscan::Profiler::instance().record(slitscan::stage, start_ns, end_ns)
+    #define SLITSCAN_PROFILE_NOW() slitscan::Profiler::now()
+    #define SLITSCAN_PROFILE_THREAD(name) slitscan::Profiler::setThreadName(name)
+    #define SLITSCAN_PROFILE_FRAME(frame) slitscan::Profiler::setFrame(frame)
+#else
+    #define SLITSCAN_PROFILE_SCOPE(stage) ((void)0)
+    #define SLITSCAN_PROFILE_RECORD(stage, start_ns, end_ns) ((void)0)
+    #define SLITSCAN_PROFILE_NOW() 0
+    #define SLITSCAN_PROFILE_THREAD(name) ((void)0)
+    #define SLITSCAN_PROFILE_FRAME(frame) ((void)0)
+#endif
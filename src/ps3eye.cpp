@@ -1,6 +1,8 @@
 #include "ps3eye.h"
+#include "frame_assembler.h"
 
 #include <thread>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -309,24 +311,6 @@ static const uint8_t sensor_start_qvga[][2] = {
 	{0x65, 0x2f},
 };
 
-/* Values for bmHeaderInfo (Video and Still Image Payload Headers, 2.4.3.3) */
-#define UVC_STREAM_EOH	(1 << 7)
-#define UVC_STREAM_ERR	(1 << 6)
-#define UVC_STREAM_STI	(1 << 5)
-#define UVC_STREAM_RES	(1 << 4)
-#define UVC_STREAM_SCR	(1 << 3)
-#define UVC_STREAM_PTS	(1 << 2)
-#define UVC_STREAM_EOF	(1 << 1)
-#define UVC_STREAM_FID	(1 << 0)
-
-/* packet types when moving from iso buf to frame buf */
-enum gspca_packet_type {
-    DISCARD_PACKET,
-    FIRST_PACKET,
-    INTER_PACKET,
-    LAST_PACKET
-};
-
 /*
  * look for an input transfer endpoint in an alternate setting
  * libusb_endpoint_descriptor
@@ -378,6 +362,8 @@ class USBMgr
     int listDevices(std::vector<PS3EYECam::PS3EYERef>& list);
 	void cameraStarted();
 	void cameraStopped();
+	// Times the event thread returned from libusb_handle_events, shared by all cameras
+	uint64_t getEventThreadWakeups() const { return event_thread_wakeups; }
 
     static std::shared_ptr<USBMgr>  sInstance;
     static int                      sTotalDevices;
@@ -387,6 +373,7 @@ class USBMgr
 	std::thread						update_thread;
 	std::atomic_bool				exit_signaled;
 	std::atomic_int					active_camera_count;
+	std::atomic<uint64_t>			event_thread_wakeups;
 
     USBMgr(const USBMgr&);
     void operator=(const USBMgr&);
@@ -401,7 +388,8 @@ int                     USBMgr::sTotalDevices = 0;
 
 USBMgr::USBMgr() :
 	exit_signaled({ false }),
-	active_camera_count({ 0 })
+	active_camera_count({ 0 }),
+	event_thread_wakeups(0)
 {
     libusb_init(&usb_context);
     libusb_set_debug(usb_context, 1);
@@ -450,6 +438,7 @@ void USBMgr::stopTransferThread()
 void USBMgr::transferThreadFunc()
 {
 	SetThreadName("PS3EyeDriver Transfer Thread");
+	SLITSCAN_PROFILE_THREAD("usb transfer");
 
 	struct timeval tv;
 	tv.tv_sec = 0;
@@ -457,6 +446,7 @@ void USBMgr::transferThreadFunc()
 
 	while (!exit_signaled)
 	{
+		event_thread_wakeups++;
 #ifdef _WIN32
 		libusb_handle_events_timeout_completed(usb_context, &tv, NULL);
 #else
@@ -505,92 +495,6 @@ int USBMgr::listDevices( std::vector<PS3EYECam::PS3EYERef>& list )
 
 static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr);
 
-class FrameQueue
-{
-public:
-	FrameQueue(uint32_t frame_size) :
-		frame_size			(frame_size),
-		num_frames			(2),
-		frame_buffer		((uint8_t*)malloc(frame_size * num_frames)),
-		head				(0),
-		tail				(0),
-		available			(0)
-	{
-	}
-
-	~FrameQueue()
-	{
-		free(frame_buffer);
-	}
-
-	uint8_t* GetFrameBufferStart()
-	{
-		return frame_buffer;
-	}
-
-	uint8_t* Enqueue()
-	{
-		uint8_t* new_frame = NULL;
-
-		std::lock_guard<std::mutex> lock(mutex);
-
-		// Unlike traditional producer/consumer, we don't block the producer if the buffer is full (ie. the consumer is not reading data fast enough).
-		// Instead, if the buffer is full, we simply return the current frame pointer, causing the producer to overwrite the previous frame.
-		// This allows performance to degrade gracefully: if the consumer is not fast enough (< Camera FPS), it will miss frames, but if it is fast enough (>= Camera FPS), it will see everything.
-		//
-		// Note that because the the producer is writing directly to the ring buffer, we can only ever be a maximum of num_frames-1 ahead of the consumer, 
-		// otherwise the producer could overwrite the frame the consumer is currently reading (in case of a slow consumer)
-		if (available >= num_frames - 1)
-		{
-			return frame_buffer + head * frame_size;
-		}
-
-		// Note: we don't need to copy any data to the buffer since the USB packets are directly written to the frame buffer.
-		// We just need to update head and available count to signal to the consumer that a new frame is available
-		head = (head + 1) % num_frames;
-		available++;
-
-		// Determine the next frame pointer that the producer should write to
-		new_frame = frame_buffer + head * frame_size;
-
-		// Signal consumer that data became available
-		empty_condition.notify_one();
-
-		return new_frame;
-	}
-
-	uint8_t* Dequeue()
-	{
-		uint8_t* new_frame = (uint8_t*)malloc(frame_size);
-		
-		std::unique_lock<std::mutex> lock(mutex);
-
-		// If there is no data in the buffer, wait until data becomes available
-		empty_condition.wait(lock, [this] () { return available != 0; });
-
-		// Copy from internal buffer
-		uint8_t* source = frame_buffer + frame_size * tail;
-		memcpy(new_frame, source, frame_size);
-
-		// Update tail and available count
-		tail = (tail + 1) % num_frames;
-		available--;
-
-		return new_frame;
-	}
-
-private:
-	uint32_t				frame_size;
-	uint32_t				num_frames;
-
-	uint8_t*				frame_buffer;
-	uint32_t				head;
-	uint32_t				tail;
-	uint32_t				available;
-
-	std::mutex				mutex;
-	std::condition_variable	empty_condition;
-};
 
 // URBDesc
 
@@ -599,14 +503,16 @@ class URBDesc
 public:
 	URBDesc() : 
 		num_active_transfers			(0),
-		last_packet_type		(DISCARD_PACKET), 
-		last_pts				(0), 
-		last_fid				(0), 
 		transfer_buffer			(NULL),
-		cur_frame_start			(NULL),
-		cur_frame_data_len		(0),
 		frame_size				(0),
-		frame_queue				(NULL)
+		frame_queue				(NULL),
+		transfers_completed		(0),
+		transfer_errors			(0),
+		resubmit_failures		(0),
+		bytes_per_second		(0),
+		rate_window_start_ns	(0),
+		rate_window_bytes		(0),
+		last_transfer_ns		(0)
 	{
 	}
 
@@ -622,9 +528,8 @@ public:
         frame_size = curr_frame_size;
 		frame_queue = new FrameQueue(frame_size);
 
-		// Initialize the current frame pointer to the start of the buffer; it will be updated as frames are completed and pushed onto the frame queue
-		cur_frame_start = frame_queue->GetFrameBufferStart();
-		cur_frame_data_len = 0;
+		// Assembly starts at the start of the buffer; the frame pointer will be updated as frames are completed and pushed onto the frame queue
+		assembler.start(frame_queue, frame_size);
 
 		// Find the bulk transfer endpoint
 		uint8_t bulk_endpoint = find_ep(libusb_get_device(handle));
@@ -646,8 +551,7 @@ public:
 			num_active_transfers++;
 		}
 
-		last_pts = 0;
-		last_fid = 0;
+		last_transfer_ns = 0;
 
 		USBMgr::instance()->cameraStarted();
 
@@ -685,138 +589,75 @@ public:
 		num_active_transfers_condition.notify_one();
 	}
 
-	void frame_add(enum gspca_packet_type packet_type, const uint8_t *data, int len)
+	static uint64_t steady_ns()
 	{
-	    if (packet_type == FIRST_PACKET) 
-	    {
-            cur_frame_data_len = 0;
-	    } 
-	    else
-	    {
-            switch(last_packet_type)  // ignore warning.
-            {
-                case DISCARD_PACKET:
-                    if (packet_type == LAST_PACKET) {
-                        last_packet_type = packet_type;
-                        cur_frame_data_len = 0;
-                    }
-                    return;
-                case LAST_PACKET:
-                    return;
-                default:
-                    break;
-            }
-	    }
-
-	    /* append the packet to the frame buffer */
-	    if (len > 0)
-        {
-            if(cur_frame_data_len + len > frame_size)
-            {
-                packet_type = DISCARD_PACKET;
-                cur_frame_data_len = 0;
-            } else {
-                memcpy(cur_frame_start+cur_frame_data_len, data, len);
-                cur_frame_data_len += len;
-            }
-	    }
-
-	    last_packet_type = packet_type;
-
-	    if (packet_type == LAST_PACKET) {        
-			cur_frame_data_len = 0;
-			cur_frame_start = frame_queue->Enqueue();
-	        //debug("frame completed %d\n", frame_complete_ind);
-	    }
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Called for every completed transfer after it's been scanned
+	void update_rate()
+	{
+		uint64_t now_ns = steady_ns();
+		uint64_t bytes = assembler.get_stats().bytes_scanned;
+		if (rate_window_start_ns == 0)
+		{
+			rate_window_start_ns = now_ns;
+			rate_window_bytes = bytes;
+		}
+		else if (now_ns - rate_window_start_ns >= 1000000000)
+		{
+			bytes_per_second = (bytes - rate_window_bytes) * 1000000000 / (now_ns - rate_window_start_ns);
+			rate_window_start_ns = now_ns;
+			rate_window_bytes = bytes;
+		}
 	}
 
-	void pkt_scan(uint8_t *data, int len)
+	void get_stats(PS3EYECam::Stats& stats) const
 	{
-	    uint32_t this_pts;
-	    uint16_t this_fid;
-	    int remaining_len = len;
-	    int payload_len;
-
-	    payload_len = 2048; // bulk type
-	    do {
-			len = (std::min)(remaining_len, payload_len);
-
-	        /* Payloads are prefixed with a UVC-style header.  We
-	           consider a frame to start when the FID toggles, or the PTS
-	           changes.  A frame ends when EOF is set, and we've received
-	           the correct number of bytes. */
-
-	        /* Verify UVC header.  Header length is always 12 */
-	        if (data[0] != 12 || len < 12) {
-	            debug("bad header\n");
-	            goto discard;
-	        }
-
-	        /* Check errors */
-	        if (data[1] & UVC_STREAM_ERR) {
-	            debug("payload error\n");
-	            goto discard;
-	        }
-
-	        /* Extract PTS and FID */
-	        if (!(data[1] & UVC_STREAM_PTS)) {
-	            debug("PTS not present\n");
-	            goto discard;
-	        }
-
-	        this_pts = (data[5] << 24) | (data[4] << 16) | (data[3] << 8) | data[2];
-	        this_fid = (data[1] & UVC_STREAM_FID) ? 1 : 0;
-
-	        /* If PTS or FID has changed, start a new frame. */
-	        if (this_pts != last_pts || this_fid != last_fid) {
-	            if (last_packet_type == INTER_PACKET)
-	            {
-	                frame_add(LAST_PACKET, NULL, 0);
-	            }
-	            last_pts = this_pts;
-	            last_fid = this_fid;
-	            frame_add(FIRST_PACKET, data + 12, len - 12);
-	        } /* If this packet is marked as EOF, end the frame */
-	        else if (data[1] & UVC_STREAM_EOF) 
-	        {
-	            last_pts = 0;
-                if(cur_frame_data_len + len - 12 != frame_size)
-                {
-                    goto discard;
-                }
-	            frame_add(LAST_PACKET, data + 12, len - 12);
-	        } else {
-	            /* Add the data from this payload */
-	            frame_add(INTER_PACKET, data + 12, len - 12);
-	        }
-
-
-	        /* Done this payload */
-	        goto scan_next;
-
-	discard:
-	        /* Discard data until a new frame starts. */
-	        frame_add(DISCARD_PACKET, NULL, 0);
-	scan_next:
-	        remaining_len -= len;
-	        data += len;
-	    } while (remaining_len > 0);
+		const FrameAssemblerStats& frames = assembler.get_stats();
+		stats.bytes_received = frames.bytes_scanned;
+		stats.bytes_per_second = bytes_per_second;
+		// only transfers move the window along; once they stop, the last
+		// published rate would stick, so average over the window so far instead
+		uint64_t window_start_ns = rate_window_start_ns;
+		uint64_t window_ns = steady_ns() - window_start_ns;
+		if (window_start_ns != 0 && window_ns >= 2000000000)
+		{
+			stats.bytes_per_second = (frames.bytes_scanned - rate_window_bytes) * 1000000000 / window_ns;
+		}
+		stats.transfers_completed = transfers_completed;
+		stats.transfer_errors = transfer_errors;
+		stats.resubmit_failures = resubmit_failures;
+		stats.frames_completed = frames.frames_completed;
+		stats.frames_incomplete = frames.frames_incomplete;
+		stats.frames_discarded = frames.frames_discarded;
+		stats.frames_overwritten = frames.frames_overwritten;
+		stats.payloads_bad_header = frames.payloads_bad_header;
+		stats.payloads_stream_error = frames.payloads_stream_error;
+		stats.payloads_missing_pts = frames.payloads_missing_pts;
+		stats.payloads_size_mismatch = frames.payloads_size_mismatch;
 	}
 
 	uint8_t					num_active_transfers;
 	std::mutex				num_active_transfers_mutex;
 	std::condition_variable	num_active_transfers_condition;
 
-	enum gspca_packet_type	last_packet_type;
-	uint32_t				last_pts;
-	uint16_t				last_fid;
 	libusb_transfer*		xfr[NUM_TRANSFERS];
 
 	uint8_t*				transfer_buffer;
-    uint8_t*				cur_frame_start;
-	uint32_t				cur_frame_data_len;
 	uint32_t				frame_size;
 	FrameQueue*				frame_queue;
+	FrameAssembler			assembler;
+
+	// transport counters, written by the USB thread
+	std::atomic<uint64_t>	transfers_completed;
+	std::atomic<uint64_t>	transfer_errors;
+	std::atomic<uint64_t>	resubmit_failures;
+	std::atomic<uint64_t>	bytes_per_second;
+	std::atomic<uint64_t>	rate_window_start_ns;	// also read by get_stats()
+	std::atomic<uint64_t>	rate_window_bytes;
+
+	uint64_t				last_transfer_ns;	// profiling only
 };
 
 static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr)
@@ -833,6 +674,7 @@ static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr)
         
         if(status != LIBUSB_TRANSFER_CANCELLED)
         {
+            urb->transfer_errors++;
             urb->close_transfers();
         }
         return;
@@ -840,10 +682,25 @@ static void LIBUSB_CALL transfer_completed_callback(struct libusb_transfer *xfr)
 
     //debug("length:%u, actual_length:%u\n", xfr->length, xfr->actual_length);
 
-    urb->pkt_scan(xfr->buffer, xfr->actual_length);
+#ifdef SLITSCAN_PROFILE
+    uint64_t transfer_ns = SLITSCAN_PROFILE_NOW();
+    if (urb->last_transfer_ns)
+    {
+        SLITSCAN_PROFILE_RECORD(STAGE_USB_TRANSFER, urb->last_transfer_ns, transfer_ns);
+    }
+    urb->last_transfer_ns = transfer_ns;
+#endif
+
+    {
+        SLITSCAN_PROFILE_SCOPE(STAGE_PKT_SCAN);
+        urb->assembler.pkt_scan(xfr->buffer, xfr->actual_length);
+    }
+    urb->transfers_completed++;
+    urb->update_rate();
 
     if (libusb_submit_transfer(xfr) < 0) {
         debug("error re-submitting URB\n");
+        urb->resubmit_failures++;
         urb->close_transfers();
     }
 }
@@ -887,6 +744,8 @@ PS3EYECam::PS3EYECam(libusb_device *device)
 	handle_ = NULL;
 
 	is_streaming = false;
+	frame_timestamp = 0;
+	frame_sequence = 0;
 
 	device_ = device;
 	mgrPtr = USBMgr::instance();
@@ -1045,7 +904,29 @@ void PS3EYECam::stop()
 
 uint8_t* PS3EYECam::getFrame()
 {
-	return urb->frame_queue->Dequeue();
+	return urb->frame_queue->Dequeue(&frame_timestamp, &frame_sequence);
+}
+
+void PS3EYECam::getFrame(uint8_t* frame)
+{
+	urb->frame_queue->Dequeue(frame, &frame_timestamp, &frame_sequence);
+}
+
+bool PS3EYECam::getFrame(uint8_t* frame, int timeout_ms)
+{
+	return urb->frame_queue->Dequeue(frame, std::chrono::milliseconds(timeout_ms), &frame_timestamp, &frame_sequence);
+}
+
+PS3EYECam::Stats PS3EYECam::getStats() const
+{
+	Stats stats;
+	memset(&stats, 0, sizeof(stats));
+	if (urb)
+	{
+		urb->get_stats(stats);
+	}
+	stats.event_thread_wakeups = USBMgr::instance()->getEventThreadWakeups();
+	return stats;
 }
 
 bool PS3EYECam::open_usb()
@@ -149,12 +149,43 @@ public:
 	// - If there is no frame available, this function will block until one is
 	// - The returned frame is a malloc'd copy; you must free() it yourself when done with it
 	uint8_t* getFrame();
+	// Same, but copies the frame into a caller-provided buffer of getRowBytes() * getHeight() bytes
+	void getFrame(uint8_t* frame);
+	// Same, but waits at most timeout_ms; returns false (and leaves frame alone) if none came
+	bool getFrame(uint8_t* frame, int timeout_ms);
+	// Host time (steady_clock seconds) the first USB packet of the frame last
+	// returned by getFrame() arrived, the earliest we know of it
+	double getFrameTimestamp() const { return frame_timestamp; }
+	// The frame assembler's sequence number for the same frame, counting from 1;
+	// gaps are frames overwritten before getFrame() took them
+	uint64_t getFrameSequence() const { return frame_sequence; }
 
 	uint32_t getWidth() const { return frame_width; }
 	uint32_t getHeight() const { return frame_height; }
 	uint8_t getFrameRate() const { return frame_rate; }
 	uint32_t getRowBytes() const { return frame_stride; }
 
+	// USB transport counters since the camera was opened. Until now, dropped
+	// frames were silent; these tell a starved hub from a slow consumer.
+	struct Stats
+	{
+		uint64_t bytes_received;
+		uint64_t bytes_per_second;			// over the last second or so, falls to 0 when transfers stop
+		uint64_t transfers_completed;
+		uint64_t transfer_errors;			// completed with an error status, streaming stops
+		uint64_t resubmit_failures;			// streaming stops too
+		uint64_t frames_completed;			// queued for getFrame(), including incomplete ones
+		uint64_t frames_incomplete;			// no EOF before the next frame started
+		uint64_t frames_discarded;			// dropped by the packet parser
+		uint64_t frames_overwritten;		// replaced before getFrame() took them: consumer too slow
+		uint64_t payloads_bad_header;		// discarded payloads by reason
+		uint64_t payloads_stream_error;
+		uint64_t payloads_missing_pts;
+		uint64_t payloads_size_mismatch;	// at EOF, or overflowing the frame
+		uint64_t event_thread_wakeups;		// shared by all cameras
+	};
+	Stats getStats() const;
+
 	//
 	static const std::vector<PS3EYERef>& getDevices( bool forceRefresh = false );
 
@@ -203,6 +234,8 @@ private:
 	uint8_t frame_rate;
 
 	double last_qued_frame_time;
+	double frame_timestamp;
+	uint64_t frame_sequence;
 
 	//usb stuff
 	libusb_device *device_;
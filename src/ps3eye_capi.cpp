@@ -191,6 +191,31 @@ ps3eye_close(ps3eye_t *eye)
     delete eye;
 }
 
+int
+ps3eye_get_stats(ps3eye_t *eye, ps3eye_stats_t *stats)
+{
+    if (!eye || !stats) {
+        return -1;
+    }
+
+    ps3eye::PS3EYECam::Stats s = eye->eye->getStats();
+    stats->bytes_received = s.bytes_received;
+    stats->bytes_per_second = s.bytes_per_second;
+    stats->transfers_completed = s.transfers_completed;
+    stats->transfer_errors = s.transfer_errors;
+    stats->resubmit_failures = s.resubmit_failures;
+    stats->frames_completed = s.frames_completed;
+    stats->frames_incomplete = s.frames_incomplete;
+    stats->frames_discarded = s.frames_discarded;
+    stats->frames_overwritten = s.frames_overwritten;
+    stats->payloads_bad_header = s.payloads_bad_header;
+    stats->payloads_stream_error = s.payloads_stream_error;
+    stats->payloads_missing_pts = s.payloads_missing_pts;
+    stats->payloads_size_mismatch = s.payloads_size_mismatch;
+    stats->event_thread_wakeups = s.event_thread_wakeups;
+    return 0;
+}
+
 int
 ps3eye_get_parameter(ps3eye_t *eye, ps3eye_parameter param)
 {
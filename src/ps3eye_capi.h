@@ -51,6 +51,26 @@ typedef enum{
     PS3EYE_VFLIP                // [false, true]
 } ps3eye_parameter;
 
+/**
+ * USB transport counters of an open camera, see ps3eye_get_stats().
+ **/
+typedef struct {
+    unsigned long long bytes_received;
+    unsigned long long bytes_per_second;        // over the last second
+    unsigned long long transfers_completed;
+    unsigned long long transfer_errors;         // streaming stops after one
+    unsigned long long resubmit_failures;       // streaming stops after one
+    unsigned long long frames_completed;        // including incomplete ones
+    unsigned long long frames_incomplete;       // no EOF before the next frame started
+    unsigned long long frames_discarded;        // dropped by the packet parser
+    unsigned long long frames_overwritten;      // never grabbed: the caller was too slow
+    unsigned long long payloads_bad_header;     // discarded payloads by reason
+    unsigned long long payloads_stream_error;
+    unsigned long long payloads_missing_pts;
+    unsigned long long payloads_size_mismatch;
+    unsigned long long event_thread_wakeups;    // shared by all cameras
+} ps3eye_stats_t;
+
 /**
  * Initialize and enumerate connected cameras.
  * Needs to be called once before all other API functions.
@@ -112,6 +132,13 @@ ps3eye_set_parameter(ps3eye_t *eye, ps3eye_parameter param, int value);
 int
 ps3eye_get_parameter(ps3eye_t *eye, ps3eye_parameter param);
 
+/**
+ * Get the USB transport counters since the camera was opened.
+ * Returns -1 if there is an error, otherwise 0.
+ **/
+int
+ps3eye_get_stats(ps3eye_t *eye, ps3eye_stats_t *stats);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "frame_source.h"
+#include "ps3eye.h"
+
+namespace slitscan {
+
+// FrameSource adapter for an initialized PS3 Eye
+class PS3EyeSource : public FrameSource
+{
+public:
+    explicit PS3EyeSource(ps3eye::PS3EYECam::PS3EYERef eye) : eye(eye) {}
+
+    bool start() { eye->start(); return eye->isStreaming(); }
+    void stop() { eye->stop(); }
+    uint8_t* getFrame() { return eye->getFrame(); }
+
+    uint32_t getWidth() const { return eye->getWidth(); }
+    uint32_t getHeight() const { return eye->getHeight(); }
+    uint32_t getRowBytes() const { return eye->getRowBytes(); }
+    double getFrameRate() const { return eye->getFrameRate(); }
+    // arrival of the frame's first USB packet
+    double getFrameTimestamp() const { return eye->getFrameTimestamp(); }
+    uint64_t getFrameSequence() const { return eye->getFrameSequence(); }
+
+private:
+    ps3eye::PS3EYECam::PS3EYERef eye;
+};
+
+} // namespace
@@ -0,0 +1,187 @@
+#include "raw_stream.h"
+
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+namespace slitscan {
+
+RawStreamRecorder::RawStreamRecorder(size_t pool_frames) :
+    pool_frames(pool_frames),
+    file(NULL),
+    source_row_bytes(0),
+    next_sequence(0),
+    copy_source(NULL),
+    copy_exit(false),
+    frames_written(0),
+    frames_dropped(0),
+    bytes_written(0),
+    write_micros(0)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+RawStreamRecorder::~RawStreamRecorder()
+{
+    close();
+}
+
+uint32_t RawStreamRecorder::getRecordSize(uint32_t payload_size)
+{
+    uint32_t size = sizeof(RawStreamRecord) + payload_size;
+    return (size + RAW_STREAM_ALIGN - 1) / RAW_STREAM_ALIGN * RAW_STREAM_ALIGN;
+}
+
+bool RawStreamRecorder::open(const std::string& path, uint32_t width, uint32_t height, uint32_t row_bytes, double fps)
+{
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RAW_STREAM_MAGIC, sizeof(header.magic));
+    header.header_size = RAW_STREAM_ALIGN;
+    header.record_size = getRecordSize(width * 2 * height);
+    header.width = width;
+    header.height = height;
+    header.row_bytes = width * 2;
+    header.fps_num = (uint32_t)(fps * 1000 + 0.5);
+    header.fps_den = 1000;
+
+    std::vector<uint8_t> page(RAW_STREAM_ALIGN);
+    memcpy(&page[0], &header, sizeof(header));
+    if (fwrite(&page[0], 1, page.size(), file) != page.size()) {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+
+    source_row_bytes = row_bytes;
+    next_sequence = 0;
+    frames_written = 0;
+    frames_dropped = 0;
+    bytes_written = page.size();
+    write_micros = 0;
+    pool.assign(pool_frames, std::vector<uint8_t>((size_t)header.row_bytes * height));
+    free_frames.reset(new BoundedQueue<uint8_t*>(pool_frames));
+    queue.reset(new BoundedQueue<Frame>(pool_frames));
+    for (size_t i = 0; i < pool.size(); i++) {
+        uint8_t* frame = &pool[i][0];
+        free_frames->push(std::move(frame));
+    }
+    copy_source = NULL;
+    copy_exit = false;
+    copier = std::thread(&RawStreamRecorder::copyLoop, this);
+    writer = std::thread(&RawStreamRecorder::writerLoop, this);
+    return true;
+}
+
+void RawStreamRecorder::close()
+{
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(copy_mutex);
+            copy_exit = true;
+        }
+        copy_condition.notify_all();
+        copier.join();
+        queue->close();
+        writer.join();
+        pool.clear();
+    }
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void RawStreamRecorder::beginFrame(const uint8_t* frame, double timestamp)
+{
+    if (!isOpen()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(copy_mutex);
+        copy_source = frame;
+        copy_frame.sequence = next_sequence++;
+        copy_frame.timestamp = timestamp;
+    }
+    copy_condition.notify_all();
+}
+
+void RawStreamRecorder::endFrame()
+{
+    std::unique_lock<std::mutex> lock(copy_mutex);
+    copy_condition.wait(lock, [this] () { return copy_source == NULL; });
+}
+
+void RawStreamRecorder::copyLoop()
+{
+    const size_t row_bytes = header.row_bytes;
+    std::unique_lock<std::mutex> lock(copy_mutex);
+    for (;;) {
+        copy_condition.wait(lock, [this] () { return copy_source != NULL || copy_exit; });
+        if (!copy_source) {
+            return;
+        }
+        Frame frame = copy_frame;
+        const uint8_t* src = copy_source;
+        lock.unlock();
+
+        // never waits for the writer: no free buffer means the disk is behind
+        if (free_frames->tryPop(frame.data)) {
+            for (uint32_t y = 0; y < header.height; y++) {
+                memcpy(frame.data + row_bytes * y, src + (size_t)source_row_bytes * y, row_bytes);
+            }
+            // can't fail: every buffer in flight came out of the pool, which is as big as the queue
+            queue->tryPush(std::move(frame));
+        } else {
+            frames_dropped++;
+        }
+
+        lock.lock();
+        copy_source = NULL;
+        copy_condition.notify_all();
+    }
+}
+
+void RawStreamRecorder::writerLoop()
+{
+    uint32_t payload_size = header.row_bytes * header.height;
+    std::vector<uint8_t> padding(header.record_size - sizeof(RawStreamRecord) - payload_size);
+    Frame frame;
+    while (queue->pop(frame)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RawStreamRecord record;
+        memset(&record, 0, sizeof(record));
+        record.magic = RAW_RECORD_MAGIC;
+        record.payload_size = payload_size;
+        record.sequence = frame.sequence;
+        record.timestamp = frame.timestamp;
+        bool ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+                  fwrite(frame.data, 1, payload_size, file) == payload_size &&
+                  (padding.empty() || fwrite(&padding[0], 1, padding.size(), file) == padding.size());
+        free_frames->push(std::move(frame.data));
+        if (ok) {
+            frames_written++;
+            bytes_written += header.record_size;
+        } else {
+            frames_dropped++;
+        }
+        write_micros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+RawStreamRecorder::Stats RawStreamRecorder::getStats() const
+{
+    Stats stats;
+    stats.frames_written = frames_written;
+    stats.frames_dropped = frames_dropped;
+    stats.bytes_written = bytes_written;
+    stats.write_seconds = write_micros * 1e-6;
+    return stats;
+}
+
+} // namespace
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+#include "bounded_queue.h"
+
+namespace slitscan {
+
+// Raw capture container: a page-sized header followed by fixed-size,
+// page-aligned records, each a RawStreamRecord header and one YUYV frame.
+// Records are only ever appended, so a file cut short by a crash loses at most
+// the last frame, and readers can mmap it and index frames by arithmetic.
+// Fields are stored in host (little endian) byte order.
+static const char RAW_STREAM_MAGIC[8] = { 'S', 'L', 'I', 'T', 'R', 'A', 'W', '1' };
+static const uint32_t RAW_STREAM_ALIGN = 4096;
+static const uint32_t RAW_RECORD_MAGIC = 0x4d415246; // "FRAM"
+
+struct RawStreamHeader {
+    char magic[8];
+    uint32_t header_size;       // offset of the first record
+    uint32_t record_size;       // bytes per record, including padding
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_bytes;         // width * 2: rows are stored unpadded
+    uint32_t fps_num;           // nominal rate; the records carry actual capture times
+    uint32_t fps_den;
+    uint32_t reserved[7];
+};
+
+struct RawStreamRecord {
+    uint32_t magic;
+    uint32_t payload_size;      // followed by the frame, row_bytes * height bytes
+    uint64_t sequence;          // frames dropped by the recorder leave gaps
+    double timestamp;           // capture time, seconds on steady_clock
+    uint64_t reserved[5];
+};
+
+// Appends camera frames to a raw stream file on background threads. The
+// capture thread lends out the frame it acquired from its FrameSource; a copy
+// thread moves it into one of a fixed pool of buffers (dropping any row
+// padding) while the capture thread converts it, and a writer thread appends
+// it to the file. If the disk falls behind and the pool runs dry, frames are
+// dropped (and counted) instead of piling up in memory.
+class RawStreamRecorder
+{
+public:
+    struct Stats {
+        uint64_t frames_written;
+        uint64_t frames_dropped;
+        uint64_t bytes_written;
+        double write_seconds;
+    };
+
+    // pool_frames bounds the frames waiting for the writer
+    explicit RawStreamRecorder(size_t pool_frames = 32);
+    ~RawStreamRecorder();
+
+    // row_bytes is the stride of the frames passed to beginFrame()
+    bool open(const std::string& path, uint32_t width, uint32_t height, uint32_t row_bytes, double fps);
+    // Writes out everything already queued, then closes the file
+    void close();
+    bool isOpen() const { return writer.joinable(); }
+
+    // Starts copying a YUYV frame on the copy thread; frame must stay valid
+    // (not released back to its source) until endFrame() returns
+    void beginFrame(const uint8_t* frame, double timestamp);
+    // Waits until the frame passed to beginFrame() has been copied
+    void endFrame();
+
+    Stats getStats() const;
+
+    // Record size for a frame of payload_size bytes
+    static uint32_t getRecordSize(uint32_t payload_size);
+
+private:
+    RawStreamRecorder(const RawStreamRecorder&);
+    void operator=(const RawStreamRecorder&);
+
+    struct Frame {
+        uint8_t* data;
+        uint64_t sequence;
+        double timestamp;
+    };
+
+    void copyLoop();
+    void writerLoop();
+
+    size_t pool_frames;
+    FILE* file;
+    RawStreamHeader header;
+    uint32_t source_row_bytes;
+    uint64_t next_sequence;
+    std::vector<std::vector<uint8_t> > pool;
+    // recreated by every open(), since closed queues stay closed
+    std::unique_ptr<BoundedQueue<uint8_t*> > free_frames;
+    std::unique_ptr<BoundedQueue<Frame> > queue;
+    std::thread copier;
+    std::thread writer;
+
+    // the frame on loan from the capture thread, NULL once copied
+    std::mutex copy_mutex;
+    std::condition_variable copy_condition;
+    const uint8_t* copy_source;
+    Frame copy_frame;
+    bool copy_exit;
+
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> write_micros;
+};
+
+} // namespace
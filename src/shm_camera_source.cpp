@@ -0,0 +1,77 @@
+#include "shm_camera_source.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace slitscan {
+
+ShmCameraSource::ShmCameraSource() :
+    width(0),
+    height(0),
+    row_bytes(0),
+    frame_rate(0)
+{
+    memset(&info, 0, sizeof(info));
+}
+
+bool ShmCameraSource::open(const std::string& ring_name)
+{
+    name = ring_name;
+    return attach();
+}
+
+bool ShmCameraSource::attach()
+{
+    if (!ring.open(name)) {
+        return false;
+    }
+    const ShmRingHeader& header = ring.getHeader();
+    // the app was set up for the first ring's frame size; a restarted daemon
+    // has to publish the same format
+    bool same_format = !width || (header.width == width && header.height == height && header.stride == row_bytes);
+    if (header.pixel_format != SHM_RING_YUYV || !same_format) {
+        ring.close();
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+    row_bytes = header.stride;
+    frame_rate = header.fps_milli / 1000.0;
+    return true;
+}
+
+const uint8_t* ShmCameraSource::acquireFrame()
+{
+    if (!ring.isOpen() || ring.isClosed()) {
+        // the daemon went away; pick up its successor when there is one
+        ring.close();
+        if (!attach()) {
+            return NULL;
+        }
+    }
+    // wait about as long as the PS3 Eye driver's getFrame() would
+    return ring.acquireFrame(&info, 1000);
+}
+
+void ShmCameraSource::releaseFrame()
+{
+    ring.releaseFrame();
+}
+
+uint8_t* ShmCameraSource::getFrame()
+{
+    const uint8_t* frame = acquireFrame();
+    if (!frame) {
+        return NULL;
+    }
+    uint8_t* copy = (uint8_t*)malloc(row_bytes * height);
+    memcpy(copy, frame, row_bytes * height);
+    if (!ring.releaseFrame()) {
+        // overwritten while we copied it
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+} // namespace
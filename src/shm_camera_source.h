@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "frame_source.h"
+#include "shm_ring.h"
+
+namespace slitscan {
+
+// FrameSource that attaches to a camera ring published by ps3eye_daemon, so
+// several processes can share one PS3 Eye. acquireFrame() returns the frame in
+// place in shared memory; the daemon never waits for us, so a reader that
+// holds a frame too long only gets its own frame torn (counted, see getStats()).
+// Readers can come and go freely, and if the daemon restarts we reattach.
+class ShmCameraSource : public FrameSource
+{
+public:
+    ShmCameraSource();
+
+    bool open(const std::string& name);
+
+    bool start() { return ring.isOpen(); }
+    void stop() {}
+    uint8_t* getFrame();
+    const uint8_t* acquireFrame();
+    void releaseFrame();
+    double getFrameTimestamp() const { return info.timestamp; }
+    // as the publisher (tools/ps3eye_daemon) numbered it
+    uint64_t getFrameSequence() const { return info.user; }
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    uint32_t getRowBytes() const { return row_bytes; }
+    double getFrameRate() const { return frame_rate; }
+
+    const ShmRingReader::Stats& getStats() const { return ring.getStats(); }
+
+private:
+    ShmCameraSource(const ShmCameraSource&);
+    void operator=(const ShmCameraSource&);
+
+    bool attach();
+
+    std::string name;
+    ShmRingReader ring;
+    ShmFrameInfo info;
+    uint32_t width, height, row_bytes;
+    double frame_rate;
+};
+
+} // namespace
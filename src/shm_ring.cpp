@@ -0,0 +1,249 @@
+#include "shm_ring.h"
+
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace slitscan {
+
+static const uint32_t SHM_RING_ALIGN = 4096;
+
+static_assert(sizeof(ShmSlotHeader) == 64, "frames start one cache line into the slot");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+
+static std::string shm_path(const std::string& name)
+{
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+static ShmSlotHeader* get_slot(ShmRingHeader* header, uint64_t frame)
+{
+    return (ShmSlotHeader*)((uint8_t*)header + header->header_size + (size_t)header->slot_size * (frame % header->slot_count));
+}
+
+ShmRingWriter::ShmRingWriter() :
+    header(NULL),
+    size(0),
+    slot(NULL)
+{
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    close();
+}
+
+ShmRingReader::ShmRingReader() :
+    header(NULL),
+    size(0),
+    next_frame(0),
+    slot(NULL),
+    slot_sequence(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+#ifndef _WIN32
+
+bool ShmRingWriter::create(const std::string& ring_name, uint32_t width, uint32_t height, uint32_t stride,
+                           uint32_t pixel_format, double fps, uint32_t slot_count)
+{
+    close();
+    if (slot_count < 2) {
+        return false;
+    }
+    name = shm_path(ring_name);
+    // readers of a previous producer keep their (now orphaned) segment until
+    // they notice it's closed and reopen
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t slot_size = (sizeof(ShmSlotHeader) + stride * height + SHM_RING_ALIGN - 1) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+    size = SHM_RING_ALIGN + (size_t)slot_size * slot_count;
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // the segment is zero-filled, so every slot starts out at sequence 0: never written
+    header = (ShmRingHeader*)mapping;
+    header->header_size = SHM_RING_ALIGN;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+    header->pixel_format = pixel_format;
+    header->fps_milli = (uint32_t)(fps * 1000 + 0.5);
+    header->closed.store(0, std::memory_order_relaxed);
+    header->published.store(0, std::memory_order_relaxed);
+    // readers check the magic last, so it goes in after everything else
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, SHM_RING_MAGIC, sizeof(header->magic));
+    return true;
+}
+
+void ShmRingWriter::close()
+{
+    if (!header) {
+        return;
+    }
+    header->closed.store(1, std::memory_order_release);
+    munmap(header, size);
+    shm_unlink(name.c_str());
+    header = NULL;
+    slot = NULL;
+}
+
+bool ShmRingReader::open(const std::string& ring_name)
+{
+    close();
+    int fd = shm_open(shm_path(ring_name).c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= SHM_RING_ALIGN) {
+        mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    header = (ShmRingHeader*)mapping;
+    size = st.st_size;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (memcmp(header->magic, SHM_RING_MAGIC, sizeof(header->magic)) != 0 || header->slot_count < 2 ||
+        size < header->header_size + (size_t)header->slot_size * header->slot_count ||
+        header->slot_size < sizeof(ShmSlotHeader) + (size_t)header->stride * header->height) {
+        close();
+        return false;
+    }
+    // start with the next frame, not whatever is still lying around
+    next_frame = header->published.load(std::memory_order_acquire);
+    return true;
+}
+
+void ShmRingReader::close()
+{
+    if (header) {
+        munmap(header, size);
+    }
+    header = NULL;
+    slot = NULL;
+}
+
+#else
+
+bool ShmRingWriter::create(const std::string&, uint32_t, uint32_t, uint32_t, uint32_t, double, uint32_t) { return false; }
+void ShmRingWriter::close() {}
+bool ShmRingReader::open(const std::string&) { return false; }
+void ShmRingReader::close() {}
+
+#endif
+
+uint8_t* ShmRingWriter::beginFrame()
+{
+    if (!header) {
+        return NULL;
+    }
+    uint64_t frame = header->published.load(std::memory_order_relaxed);
+    slot = get_slot(header, frame);
+    slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    // order the odd sequence before any of the frame's bytes
+    std::atomic_thread_fence(std::memory_order_release);
+    return (uint8_t*)(slot + 1);
+}
+
+void ShmRingWriter::commitFrame(double timestamp, uint64_t user)
+{
+    if (!slot) {
+        return;
+    }
+    uint64_t frame = header->published.load(std::memory_order_relaxed);
+    slot->frame = frame;
+    slot->timestamp = timestamp;
+    slot->user = user;
+    slot->sequence.store(2 * frame + 2, std::memory_order_release);
+    header->published.store(frame + 1, std::memory_order_release);
+    slot = NULL;
+}
+
+const uint8_t* ShmRingReader::acquireFrame(ShmFrameInfo* info, int timeout_ms, bool latest_only)
+{
+    if (!header) {
+        return NULL;
+    }
+    slot = NULL;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        uint64_t published = header->published.load(std::memory_order_acquire);
+        if (published > next_frame) {
+            // frames older than slot_count - 1 behind are being (or have been) overwritten
+            uint64_t oldest = published > header->slot_count - 1 ? published - (header->slot_count - 1) : 0;
+            uint64_t frame = latest_only ? published - 1 : std::max(next_frame, oldest);
+            stats.frames_skipped += frame - next_frame;
+            next_frame = frame + 1;
+
+            const ShmSlotHeader* candidate = get_slot(header, frame);
+            uint64_t sequence = candidate->sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * frame + 2) {
+                stats.frames_torn++;
+                continue;
+            }
+            if (info) {
+                info->frame = frame;
+                info->timestamp = candidate->timestamp;
+                info->user = candidate->user;
+            }
+            slot = candidate;
+            slot_sequence = sequence;
+            return (const uint8_t*)(slot + 1);
+        }
+        if (header->closed.load(std::memory_order_acquire) || std::chrono::steady_clock::now() >= deadline) {
+            return NULL;
+        }
+        // the producer never signals anybody, so poll; well under a frame time
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+bool ShmRingReader::releaseFrame()
+{
+    if (!slot) {
+        return false;
+    }
+    // the seqlock read check: everything read from the frame happens before this load
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool intact = slot->sequence.load(std::memory_order_relaxed) == slot_sequence;
+    slot = NULL;
+    if (intact) {
+        stats.frames_read++;
+    } else {
+        stats.frames_torn++;
+    }
+    return intact;
+}
+
+} // namespace
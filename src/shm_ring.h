@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <atomic>
+
+namespace slitscan {
+
+// Single-producer, many-reader frame ring in POSIX shared memory, for handing
+// video to other processes on the same host without copies or sockets.
+//
+// The segment is a page-sized header followed by slot_count page-aligned
+// slots, each a ShmSlotHeader and one frame. Every slot is guarded by a
+// seqlock: the producer makes the sequence odd while it writes frame n and sets
+// it to 2n+2 once done, never waiting for anybody. Readers use frames in place
+// and check afterwards that the sequence didn't move; a reader that is too
+// slow simply sees its frame overwritten (a torn read) or skips ahead, while
+// the producer and the other readers carry on.
+static const char SHM_RING_MAGIC[8] = { 'S', 'L', 'I', 'T', 'S', 'H', 'M', '1' };
+static const uint32_t SHM_RING_RGBA = 0x41424752; // "RGBA", top-down
+static const uint32_t SHM_RING_YUYV = 0x56595559; // "YUYV"
+
+struct ShmRingHeader {
+    char magic[8];
+    uint32_t header_size;       // offset of the first slot
+    uint32_t slot_count;
+    uint32_t slot_size;         // bytes per slot, including its header and padding
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;            // bytes per row
+    uint32_t pixel_format;      // SHM_RING_RGBA or SHM_RING_YUYV
+    uint32_t fps_milli;         // nominal frame rate * 1000, 0 if unknown
+    std::atomic<uint32_t> closed;       // set when the producer goes away; readers should reopen
+    uint32_t reserved;
+    std::atomic<uint64_t> published;    // frames completed so far; the newest is published - 1
+};
+
+struct ShmSlotHeader {
+    std::atomic<uint64_t> sequence;     // 2n+1 while frame n is written, 2n+2 once complete
+    uint64_t frame;                     // n
+    double timestamp;                   // capture time, seconds on steady_clock
+    uint64_t user;                      // producer-defined, e.g. the camera's frame counter
+    uint8_t padding[32];
+};
+
+struct ShmFrameInfo {
+    uint64_t frame;
+    double timestamp;
+    uint64_t user;
+};
+
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    // Creates (replacing any stale one) the segment /name
+    bool create(const std::string& name, uint32_t width, uint32_t height, uint32_t stride,
+                uint32_t pixel_format, double fps, uint32_t slot_count = 4);
+    // Marks the ring closed and unlinks it; mapped readers keep their mapping
+    void close();
+    bool isOpen() const { return header != NULL; }
+
+    uint32_t getWidth() const { return header ? header->width : 0; }
+    uint32_t getHeight() const { return header ? header->height : 0; }
+    uint32_t getStride() const { return header ? header->stride : 0; }
+
+    // Returns the slot to fill with the next frame (stride * height bytes);
+    // never blocks, whatever the readers are doing
+    uint8_t* beginFrame();
+    void commitFrame(double timestamp, uint64_t user = 0);
+
+private:
+    ShmRingWriter(const ShmRingWriter&);
+    void operator=(const ShmRingWriter&);
+
+    std::string name;
+    ShmRingHeader* header;
+    size_t size;
+    ShmSlotHeader* slot;        // being written, between beginFrame() and commitFrame()
+};
+
+class ShmRingReader
+{
+public:
+    struct Stats {
+        uint64_t frames_read;
+        uint64_t frames_skipped;    // published but never seen, because we were behind
+        uint64_t frames_torn;       // overwritten while we were reading them
+    };
+
+    ShmRingReader();
+    ~ShmRingReader();
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const { return header != NULL; }
+    // The producer closed (or restarted) the ring; close() and open() again
+    bool isClosed() const { return header && header->closed.load(std::memory_order_acquire); }
+
+    const ShmRingHeader& getHeader() const { return *header; }
+
+    // Waits up to timeout_ms for a frame newer than the last one acquired and
+    // returns it in place in shared memory, or NULL on timeout. With
+    // latest_only, frames we're behind on are skipped so we catch up at once.
+    const uint8_t* acquireFrame(ShmFrameInfo* info, int timeout_ms, bool latest_only = true);
+    // Ends the read; false if the producer overwrote the frame meanwhile, in
+    // which case whatever was read from it must be discarded
+    bool releaseFrame();
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    ShmRingReader(const ShmRingReader&);
+    void operator=(const ShmRingReader&);
+
+    ShmRingHeader* header;
+    size_t size;
+    uint64_t next_frame;        // first frame we haven't acquired yet
+    const ShmSlotHeader* slot;  // acquired, or NULL
+    uint64_t slot_sequence;
+    Stats stats;
+};
+
+} // namespace
@@ -0,0 +1,31 @@
+#include "strip_history.h"
+
+#include <algorithm>
+
+namespace slitscan {
+
+static int clamp_position(int position, int size)
+{
+    return position < 0 ? size / 2 : (std::min)(position, size - 1);
+}
+
+StripHistory::StripHistory(int frame_width, int frame_height, int frames, Slit slit, int position) :
+    slit(slit),
+    position(clamp_position(position, slit == SLIT_ROW ? frame_height : frame_width)),
+    history(slit == SLIT_ROW ? frame_width : 1, slit == SLIT_ROW ? 1 : frame_height, frames)
+{
+}
+
+void StripHistory::pushRGBA(const uint8_t* rgba, int stride)
+{
+    // a row is one row of history; a column is frame_height rows of one pixel,
+    // still stride bytes apart
+    history.pushRGBA(slit == SLIT_ROW ? rgba + (size_t)position * stride : rgba + position * 4, stride);
+}
+
+void StripHistory::pushRGB(const uint8_t* rgb, int stride)
+{
+    history.pushRGB(slit == SLIT_ROW ? rgb + (size_t)position * stride : rgb + position * 3, stride);
+}
+
+} // namespace
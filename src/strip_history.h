@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "frame_history.h"
+
+namespace slitscan {
+
+// History for the classic single-slit scan: keeps only the slit (one row or
+// column) of every frame, so memory grows with W*T instead of W*H*T and
+// thousands of frames fit in a few megabytes. The strips are stored as a
+// FrameHistory one pixel high (row slit) or wide (column slit), which the
+// renderers sample like any other: each output pixel shows the slit as it was
+// at that pixel's time, at the pixel's position along the slit. With the
+// linear time map at 0 degrees a row slit gives the classic image, time
+// running down the screen; at 90 degrees a column slit does.
+class StripHistory
+{
+public:
+    enum Slit {
+        SLIT_ROW,       // one row of the frame, sampled along x
+        SLIT_COLUMN     // one column, sampled along y
+    };
+
+    // position is the frame row (or column) the slit is on, -1 for the centre
+    StripHistory(int frame_width, int frame_height, int frames, Slit slit, int position = -1);
+
+    // Advance the ring and store the slit of a new frame, which is packed RGBA
+    // (as produced by yuv422_to_rgba) or RGB rows of the size given above
+    void pushRGBA(const uint8_t* rgba, int stride);
+    void pushRGB(const uint8_t* rgb, int stride);
+
+    const FrameHistory& getHistory() const { return history; }
+    // getLength() RGB pixels of the strip in layer index
+    const uint8_t* getStrip(int index) const { return history.getLayer(index); }
+
+    Slit getSlit() const { return slit; }
+    int getPosition() const { return position; }
+    int getLength() const { return slit == SLIT_ROW ? history.getWidth() : history.getHeight(); }
+    int getFrames() const { return history.getFrames(); }
+    int getLayerIndex() const { return history.getLayerIndex(); }
+    float getNewestOffset() const { return history.getNewestOffset(); }
+    size_t getMemoryUsage() const { return history.getLayerSize() * history.getFrames(); }
+
+private:
+    Slit slit;
+    int position;
+    FrameHistory history;
+};
+
+} // namespace
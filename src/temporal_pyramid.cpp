@@ -0,0 +1,100 @@
+#include "temporal_pyramid.h"
+
+#include <cfloat>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SLITSCAN_SSE2 1
+#endif
+
+namespace slitscan {
+
+// dst = (a + b) / 2, rounded up or down; alternating between the two keeps
+// repeated halving from drifting brighter level by level
+static void average_layers(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t size, bool round_up)
+{
+    size_t i = 0;
+#ifdef SLITSCAN_SSE2
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= size; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i avg = _mm_avg_epu8(va, vb);     // rounds up
+        if (!round_up) {
+            avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(va, vb), one));
+        }
+        _mm_storeu_si128((__m128i*)(dst + i), avg);
+    }
+#endif
+    for (; i < size; i++) {
+        dst[i] = (uint8_t)((a[i] + b[i] + (round_up ? 1 : 0)) >> 1);
+    }
+}
+
+PyramidLayout::PyramidLayout(int frames, int levels) :
+    frames(frames),
+    levels((std::max)(0, (std::min)(levels, (int)MAX_LEVELS))),
+    count(0)
+{
+    updateLevels();
+}
+
+int PyramidLayout::advance()
+{
+    count++;
+    int due = 0;
+    while (due < levels && count % ((uint64_t)2 << due) == 0) {
+        due++;
+    }
+    updateLevels();
+    return due;
+}
+
+void PyramidLayout::updateLevels()
+{
+    for (int k = 0; k <= levels; k++) {
+        // the newest layer of level k averages step base frames and was written
+        // count % step base frames ago, so its centre is this old
+        int step = 1 << k;
+        float centre = (float)(count % step) + (step - 1) * 0.5f;
+        Level& level = level_params[k];
+        level.scale = 1.0f / ((float)step * frames);
+        level.bias = (0.5f + centre / step) / frames;
+        // two layers short of the oldest, so filtering stays clear of the wrap to the newest
+        level.max_age = k == levels ? FLT_MAX : centre + (float)(frames - 2) * step;
+    }
+}
+
+TemporalPyramid::TemporalPyramid(int width, int height, int frames, int levels) :
+    layout(frames, levels)
+{
+    for (int k = 0; k < layout.getLevels(); k++) {
+        coarse.push_back(std::unique_ptr<FrameHistory>(new FrameHistory(width, height, frames)));
+    }
+}
+
+void TemporalPyramid::update(const FrameHistory& base)
+{
+    int due = layout.advance();
+    for (int k = 1; k <= due; k++) {
+        const FrameHistory& src = k == 1 ? base : *coarse[k - 2];
+        FrameHistory& dst = *coarse[k - 1];
+        int newest = src.getLayerIndex();
+        int previous = (newest + src.getFrames() - 1) % src.getFrames();
+        dst.setLayerIndex(layout.getLayerIndex(k));
+        average_layers(src.getLayer(previous), src.getLayer(newest), dst.getLayer(dst.getLayerIndex()),
+                       dst.getLayerSize(), (layout.getLayerIndex(k) & 1) != 0);
+    }
+}
+
+size_t TemporalPyramid::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (size_t k = 0; k < coarse.size(); k++) {
+        bytes += coarse[k]->getLayerSize() * coarse[k]->getFrames();
+    }
+    return bytes;
+}
+
+} // namespace
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "frame_history.h"
+
+namespace slitscan {
+
+// Mipmaps along the time axis. Next to the full rate history (the base, level 0)
+// each coarse level k keeps as many layers again, each the average of two
+// layers of level k - 1, i.e. of 2^k base frames. The levels span 2^k times
+// the base, so covering a long stretch of time costs memory logarithmic in its
+// length, and the far past comes pre-filtered instead of aliasing in time.
+//
+// With a pyramid the time map's (-1, 0] covers the whole span (getSpan() base
+// frames). Each time is sampled from the finest level that still holds it, so
+// recent times stay at full rate and older ones get blurrier.
+//
+// PyramidLayout is the bookkeeping without the layers, shared by TemporalPyramid
+// and ofApp's GL pyramid (which keeps its levels in 3D textures).
+class PyramidLayout
+{
+public:
+    static const int MAX_LEVELS = 8;
+
+    // Where times land in one level: z = newest offset + bias - age * scale, for
+    // ages (in base frames) up to max_age, past which the next level takes over
+    struct Level {
+        float max_age;
+        float bias;
+        float scale;
+    };
+
+    // frames: layers per level, the base's included; levels: coarse levels above the base
+    PyramidLayout(int frames, int levels);
+
+    // Counts a new base layer. Returns how many coarse levels have to be written
+    // for it, levels 1 to n in order, each averaging the newest two layers of
+    // the level below.
+    int advance();
+
+    int getFrames() const { return frames; }
+    int getLevels() const { return levels; }
+    // Base frames covered by the time map's (-1, 0]
+    int getSpan() const { return frames << levels; }
+    const Level& getLevel(int level) const { return level_params[level]; }
+
+    // Newest layer of a coarse level (level >= 1); the base tracks its own
+    int getLayerIndex(int level) const { return (int)((count >> level) % frames); }
+    float getNewestOffset(int level) const { return getLayerIndex(level) / (float)frames; }
+
+    // Level to sample time coordinate t at, and its z texture coordinate there;
+    // base_offset is the base's newest offset (FrameHistory::getNewestOffset())
+    int locate(float t, float base_offset, float& z) const
+    {
+        // in base frames, matching the base's own half-layer convention at t = 0
+        float age = 0.5f - t * getSpan();
+        int level = 0;
+        while (level < levels && age > level_params[level].max_age) {
+            level++;
+        }
+        float offset = level ? getNewestOffset(level) : base_offset;
+        z = offset + level_params[level].bias - age * level_params[level].scale;
+        return level;
+    }
+
+private:
+    void updateLevels();
+
+    int frames;
+    int levels;
+    uint64_t count;     // base layers counted since the pyramid started
+    Level level_params[MAX_LEVELS + 1];
+};
+
+// The coarse levels themselves, for the CPU renderer. Fed from a base
+// FrameHistory after every push to it.
+class TemporalPyramid
+{
+public:
+    TemporalPyramid(int width, int height, int frames, int levels);
+
+    // Call after each push to base (same size and frames); writes the coarse
+    // levels that are due
+    void update(const FrameHistory& base);
+
+    const PyramidLayout& getLayout() const { return layout; }
+    // level in [1, getLayout().getLevels()]
+    const FrameHistory& getLevel(int level) const { return *coarse[level - 1]; }
+    // Of the coarse levels, the base not included
+    size_t getMemoryUsage() const;
+
+private:
+    TemporalPyramid(const TemporalPyramid&);
+    void operator=(const TemporalPyramid&);
+
+    PyramidLayout layout;
+    std::vector<std::unique_ptr<FrameHistory>> coarse;
+};
+
+} // namespace
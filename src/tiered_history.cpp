@@ -0,0 +1,282 @@
+#include "tiered_history.h"
+#include "tile_codec.h"
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+namespace slitscan {
+
+// raw layers kept for reuse rather than freed and allocated again
+static const size_t MAX_SPARE_LAYERS = TieredHistory::GROUP_SIZE * 2;
+
+TieredHistory::TieredHistory(int width, int height, int frames, int hot_frames, int threads, size_t cache_tiles) :
+    width(width),
+    height(height),
+    frames(frames),
+    hot_frames((std::max)(1, hot_frames)),
+    tiles_x((width + TILE_SIZE - 1) / TILE_SIZE),
+    tiles_y((height + TILE_SIZE - 1) / TILE_SIZE),
+    sequence(0),
+    slots(frames),
+    pending(frames / GROUP_SIZE + 1),
+    cache_tiles((std::max)((size_t)1, cache_tiles)),
+    groups_skipped(0),
+    in_flight(0),
+    compress_micros(0),
+    tiles_decoded(0),
+    cache_hits(0),
+    cache_misses(0)
+{
+    // black until written, like FrameHistory; one layer serves them all. Padded
+    // by a few bytes so samplers may read a whole 32-bit word at the last texel.
+    RawLayer black = std::make_shared<std::vector<uint8_t>>((size_t)width * height * 3 + 4, 0);
+    for (int i = 0; i < frames; i++) {
+        slots[i].sequence = 0;
+        slots[i].raw = black;
+    }
+    for (int i = 0; i < (std::max)(1, threads); i++) {
+        workers.push_back(std::thread(&TieredHistory::workerLoop, this));
+    }
+}
+
+TieredHistory::~TieredHistory()
+{
+    pending.close();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void TieredHistory::pushRGBA(const uint8_t* rgba, int stride)
+{
+    uint8_t* dst = advance();
+    for (int y = 0; y < height; y++, rgba += stride) {
+        const uint8_t* src = rgba;
+        for (int x = 0; x < width; x++, src += 4, dst += 3) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+        }
+    }
+    collect();
+    submit();
+}
+
+void TieredHistory::pushRGB(const uint8_t* rgb, int stride)
+{
+    uint8_t* dst = advance();
+    for (int y = 0; y < height; y++, rgb += stride, dst += width * 3) {
+        memcpy(dst, rgb, width * 3);
+    }
+    collect();
+    submit();
+}
+
+void TieredHistory::flush()
+{
+    while (in_flight > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    collect();
+}
+
+uint8_t* TieredHistory::advance()
+{
+    sequence++;
+    Slot& slot = slots[sequence % frames];
+    if (slot.raw && slot.raw.use_count() == 1 && spare.size() < MAX_SPARE_LAYERS) {
+        spare.push_back(slot.raw);
+    }
+    slot.sequence = sequence;
+    slot.cold.reset();
+    if (spare.empty()) {
+        slot.raw = std::make_shared<std::vector<uint8_t>>((size_t)width * height * 3 + 4, 0);
+    } else {
+        slot.raw = spare.back();
+        spare.pop_back();
+    }
+    return &(*slot.raw)[0];
+}
+
+void TieredHistory::collect()
+{
+    // swap in whatever the workers finished
+    std::vector<Group> finished;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        finished.swap(done);
+    }
+    for (size_t g = 0; g < finished.size(); g++) {
+        Group& group = finished[g];
+        group.layers.clear();
+        for (size_t i = 0; i < group.cold.size(); i++) {
+            uint64_t seq = group.first_sequence + i;
+            Slot& slot = slots[seq % frames];
+            if (slot.sequence != seq) {
+                continue;   // overwritten while it was being compressed
+            }
+            if (slot.raw.use_count() == 1 && spare.size() < MAX_SPARE_LAYERS) {
+                spare.push_back(slot.raw);
+            }
+            slot.raw.reset();
+            slot.cold = group.cold[i];
+        }
+    }
+}
+
+void TieredHistory::submit()
+{
+    // hand over the group that just aged out of the hot window
+    if (hot_frames + GROUP_SIZE > frames || sequence < (uint64_t)hot_frames + GROUP_SIZE) {
+        return;
+    }
+    uint64_t newest = sequence - hot_frames;
+    if (newest % GROUP_SIZE != 0) {
+        return;
+    }
+    Group group;
+    group.first_sequence = newest - GROUP_SIZE + 1;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        group.layers.push_back(slots[(group.first_sequence + i) % frames].raw);
+    }
+    in_flight++;
+    if (!pending.tryPush(std::move(group))) {
+        in_flight--;
+        groups_skipped++;
+    }
+}
+
+void TieredHistory::workerLoop()
+{
+    Group group;
+    while (pending.pop(group)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < GROUP_SIZE; i++) {
+            const uint8_t* newer = i + 1 < GROUP_SIZE ? &(*group.layers[i + 1])[0] : NULL;
+            group.cold.push_back(compress(&(*group.layers[i])[0], newer));
+        }
+        compress_micros += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done.push_back(std::move(group));
+        in_flight--;
+    }
+}
+
+void TieredHistory::tileSize(int tx, int ty, int& w, int& h) const
+{
+    // with the apron
+    w = (width - tx * TILE_SIZE < TILE_SIZE ? width - tx * TILE_SIZE : TILE_SIZE) + 1;
+    h = (height - ty * TILE_SIZE < TILE_SIZE ? height - ty * TILE_SIZE : TILE_SIZE) + 1;
+}
+
+void TieredHistory::gatherTile(const uint8_t* layer, int tx, int ty, uint8_t* tile) const
+{
+    int w, h;
+    tileSize(tx, ty, w, h);
+    const int x = tx * TILE_SIZE;
+    const int apron_x = (x + w - 1) % width;
+    for (int r = 0; r < h; r++, tile += getTileStride()) {
+        const uint8_t* row = layer + (size_t)((ty * TILE_SIZE + r) % height) * width * 3;
+        memcpy(tile, row + x * 3, (w - 1) * 3);
+        memcpy(tile + (w - 1) * 3, row + apron_x * 3, 3);
+    }
+}
+
+std::shared_ptr<const TieredHistory::ColdLayer> TieredHistory::compress(const uint8_t* layer, const uint8_t* newer) const
+{
+    std::shared_ptr<ColdLayer> cold = std::make_shared<ColdLayer>();
+    std::vector<uint8_t> tile(getTileStride() * (TILE_SIZE + 1)), ref(tile.size());
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int w, h;
+            tileSize(tx, ty, w, h);
+            gatherTile(layer, tx, ty, &tile[0]);
+            if (newer) {
+                gatherTile(newer, tx, ty, &ref[0]);
+            }
+            cold->offsets.push_back((uint32_t)cold->data.size());
+            tile_encode(&tile[0], newer ? &ref[0] : NULL, getTileStride(), w, h, cold->data);
+        }
+    }
+    cold->offsets.push_back((uint32_t)cold->data.size());
+    cold->data.shrink_to_fit();
+    return cold;
+}
+
+TieredHistory::Tile TieredHistory::getTile(int index, int tx, int ty) const
+{
+    const Slot& slot = slots[index];
+    const int tile_index = ty * tiles_x + tx;
+    const uint64_t key = slot.sequence * (uint64_t)(tiles_x * tiles_y) + tile_index;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::unordered_map<uint64_t, std::list<CacheEntry>::iterator>::iterator it = cache_index.find(key);
+        if (it != cache_index.end()) {
+            cache.splice(cache.begin(), cache, it->second);
+            cache_hits++;
+            return it->second->second;
+        }
+    }
+    cache_misses++;
+    if (!slot.cold) {
+        return Tile();
+    }
+
+    // decoded without the lock, so threads missing different tiles don't wait on each other
+    const ColdLayer& cold = *slot.cold;
+    const uint8_t* data = &cold.data[0] + cold.offsets[tile_index];
+    size_t size = cold.offsets[tile_index + 1] - cold.offsets[tile_index];
+    Tile ref;
+    if (tile_uses_reference(data, size)) {
+        // the newer neighbour, in the same group; at most GROUP_SIZE - 1 deep
+        ref = getTile((index + 1) % frames, tx, ty);
+        if (!ref) {
+            return Tile();
+        }
+    }
+    int w, h;
+    tileSize(tx, ty, w, h);
+    std::shared_ptr<std::vector<uint8_t>> decoded = std::make_shared<std::vector<uint8_t>>(getTileStride() * (TILE_SIZE + 1) + 4, 0);
+    if (!tile_decode(data, size, ref ? &(*ref)[0] : NULL, getTileStride(), &(*decoded)[0], getTileStride(), w, h)) {
+        return Tile();
+    }
+    tiles_decoded++;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    std::unordered_map<uint64_t, std::list<CacheEntry>::iterator>::iterator it = cache_index.find(key);
+    if (it != cache_index.end()) {
+        return it->second->second;  // another thread was quicker
+    }
+    cache.push_front(CacheEntry(key, decoded));
+    cache_index[key] = cache.begin();
+    while (cache.size() > cache_tiles) {
+        cache_index.erase(cache.back().first);
+        cache.pop_back();
+    }
+    return decoded;
+}
+
+TieredHistory::Stats TieredHistory::getStats() const
+{
+    Stats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < frames; i++) {
+        if (slots[i].cold) {
+            stats.cold_layers++;
+            stats.cold_bytes += slots[i].cold->data.size() + slots[i].cold->offsets.size() * sizeof(uint32_t);
+        } else if (slots[i].sequence) {
+            stats.hot_layers++;
+        }
+    }
+    stats.hot_bytes = (size_t)stats.hot_layers * width * height * 3;
+    stats.groups_skipped = groups_skipped;
+    stats.compress_seconds = compress_micros / 1e6;
+    stats.tiles_decoded = tiles_decoded;
+    stats.cache_hits = cache_hits;
+    stats.cache_misses = cache_misses;
+    return stats;
+}
+
+} // namespace
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "bounded_queue.h"
+
+namespace slitscan {
+
+// A FrameHistory whose older layers are kept compressed. The newest hot_frames
+// layers stay as plain RGB; behind them, layers are handed to worker threads in
+// groups of GROUP_SIZE and compressed losslessly (see tile_codec.h) in
+// TILE_SIZE square tiles. The newest layer of a group is coded on its own and
+// the others may predict from their newer neighbour, so a group gets dropped
+// oldest first without breaking what's left. Cold tiles are decoded when a
+// renderer asks for them, into an LRU cache.
+//
+// Pushing and reading (getRawLayer(), getTile()) must not overlap, as with
+// FrameHistory; finished compression only takes effect at the next push.
+// Reads may come from several threads at once.
+class TieredHistory
+{
+public:
+    static const int TILE_SIZE = 32;
+    static const int GROUP_SIZE = 8;
+
+    struct Stats {
+        int hot_layers;             // uncompressed, including those waiting for a worker
+        int cold_layers;
+        size_t hot_bytes;
+        size_t cold_bytes;          // compressed size of the cold layers
+        uint64_t groups_skipped;    // workers too far behind: left uncompressed
+        double compress_seconds;    // worker time
+        uint64_t tiles_decoded;
+        uint64_t cache_hits;
+        uint64_t cache_misses;
+    };
+
+    // A decoded tile: TILE_SIZE + 1 texels square, the extra column and row
+    // being the texels right of and below it (wrapping around like GL_REPEAT),
+    // so bilinear filtering never needs a second tile. getTileStride() bytes per row.
+    typedef std::shared_ptr<const std::vector<uint8_t>> Tile;
+
+    // hot_frames: newest layers kept uncompressed; threads: compression workers;
+    // cache_tiles: decoded tiles kept, about 3.3 kB each. It wants to hold every
+    // tile a render touches: a spiral map over a VGA history needs some 10000.
+    TieredHistory(int width, int height, int frames, int hot_frames, int threads = 2, size_t cache_tiles = 16384);
+    ~TieredHistory();
+
+    // Same as FrameHistory's
+    void pushRGBA(const uint8_t* rgba, int stride);
+    void pushRGB(const uint8_t* rgb, int stride);
+    // Waits for the workers to finish what they were given and takes it in,
+    // e.g. before reading a history that won't be pushed to again
+    void flush();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getFrames() const { return frames; }
+    int getHotFrames() const { return hot_frames; }
+    int getLayerIndex() const { return (int)(sequence % frames); }
+    float getNewestOffset() const { return getLayerIndex() / (float)frames; }
+
+    // The layer at index as width * height RGB, or NULL if it is cold (use getTile())
+    const uint8_t* getRawLayer(int index) const { return slots[index].raw ? &(*slots[index].raw)[0] : NULL; }
+    // Tile (tx, ty) of the cold layer at index, decoded if it isn't cached
+    Tile getTile(int index, int tx, int ty) const;
+    static int getTileStride() { return (TILE_SIZE + 1) * 3; }
+
+    Stats getStats() const;
+
+private:
+    TieredHistory(const TieredHistory&);
+    void operator=(const TieredHistory&);
+
+    typedef std::shared_ptr<std::vector<uint8_t>> RawLayer;
+
+    // compressed tiles of one layer, back to back
+    struct ColdLayer {
+        std::vector<uint8_t> data;
+        std::vector<uint32_t> offsets;  // tile i is [offsets[i], offsets[i + 1])
+    };
+
+    struct Slot {
+        uint64_t sequence;              // push that stored this layer, 0 for none yet
+        RawLayer raw;
+        std::shared_ptr<const ColdLayer> cold;
+    };
+
+    struct Group {
+        uint64_t first_sequence;
+        std::vector<RawLayer> layers;   // oldest first
+        std::vector<std::shared_ptr<const ColdLayer>> cold;
+    };
+
+    uint8_t* advance();
+    void collect();
+    void submit();
+    void workerLoop();
+    std::shared_ptr<const ColdLayer> compress(const uint8_t* layer, const uint8_t* newer) const;
+    // copies tile (tx, ty) and its apron out of a full layer
+    void gatherTile(const uint8_t* layer, int tx, int ty, uint8_t* tile) const;
+    void tileSize(int tx, int ty, int& w, int& h) const;
+
+    int width;
+    int height;
+    int frames;
+    int hot_frames;
+    int tiles_x;
+    int tiles_y;
+    uint64_t sequence;                  // pushes so far
+    std::vector<Slot> slots;
+    std::vector<RawLayer> spare;        // raw layers to reuse
+
+    BoundedQueue<Group> pending;
+    std::mutex done_mutex;
+    std::vector<Group> done;
+    std::vector<std::thread> workers;
+
+    // decoded tiles, most recently used first
+    typedef std::pair<uint64_t, Tile> CacheEntry;
+    size_t cache_tiles;
+    mutable std::mutex cache_mutex;
+    mutable std::list<CacheEntry> cache;
+    mutable std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> cache_index;
+
+    uint64_t groups_skipped;
+    std::atomic<int> in_flight;         // groups given to the workers and not yet done
+    std::atomic<uint64_t> compress_micros;
+    mutable std::atomic<uint64_t> tiles_decoded;
+    mutable std::atomic<uint64_t> cache_hits;
+    mutable std::atomic<uint64_t> cache_misses;
+};
+
+} // namespace
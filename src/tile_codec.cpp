@@ -0,0 +1,305 @@
+#include "tile_codec.h"
+
+#include <cstring>
+
+namespace slitscan {
+
+enum TileMode {
+    MODE_STORED,        // raw RGB rows
+    MODE_SPATIAL,       // median predictor within the block
+    MODE_REFERENCE      // difference to the reference block
+};
+
+// unary quotients longer than this are escaped to 8 raw bits
+static const int RICE_LIMIT = 16;
+
+// G, R - G, B - G: most of a pixel's information ends up in G, and the
+// differences are small and cheap to code
+static void to_planes(const uint8_t* rgb, int stride, int w, int h, uint8_t* planes)
+{
+    const size_t plane_size = (size_t)w * h;
+    for (int y = 0; y < h; y++, rgb += stride) {
+        for (int x = 0; x < w; x++) {
+            size_t i = (size_t)y * w + x;
+            uint8_t g = rgb[x * 3 + 1];
+            planes[i] = g;
+            planes[plane_size + i] = (uint8_t)(rgb[x * 3] - g);
+            planes[plane_size * 2 + i] = (uint8_t)(rgb[x * 3 + 2] - g);
+        }
+    }
+}
+
+static void from_planes(const uint8_t* planes, int w, int h, uint8_t* rgb, int stride)
+{
+    const size_t plane_size = (size_t)w * h;
+    for (int y = 0; y < h; y++, rgb += stride) {
+        for (int x = 0; x < w; x++) {
+            size_t i = (size_t)y * w + x;
+            uint8_t g = planes[i];
+            rgb[x * 3] = (uint8_t)(planes[plane_size + i] + g);
+            rgb[x * 3 + 1] = g;
+            rgb[x * 3 + 2] = (uint8_t)(planes[plane_size * 2 + i] + g);
+        }
+    }
+}
+
+// JPEG-LS median edge detector from the left (a), upper (b) and upper left (c)
+// neighbours; the block's first row and column predict from what they have
+static inline int predict(const uint8_t* plane, int w, int x, int y)
+{
+    if (y == 0) {
+        return x == 0 ? 0 : plane[x - 1];
+    }
+    const uint8_t* row = plane + (size_t)y * w;
+    if (x == 0) {
+        return row[x - w];
+    }
+    int a = row[x - 1], b = row[x - w], c = row[x - w - 1];
+    int lo = a < b ? a : b, hi = a < b ? b : a;
+    return c >= hi ? lo : c <= lo ? hi : a + b - c;
+}
+
+// residual mod 256 as a signed byte, folded to 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+static inline int fold(int residual)
+{
+    int r = (int8_t)(uint8_t)residual;
+    return r >= 0 ? r * 2 : -r * 2 - 1;
+}
+
+static inline int unfold(int folded)
+{
+    return (folded & 1) ? -((folded + 1) >> 1) : folded >> 1;
+}
+
+// Golomb-Rice parameter from the running mean of the folded residuals, as in LOCO-I
+struct RiceState {
+    int sum;
+    int count;
+    RiceState() : sum(4), count(1) {}
+    int parameter() const
+    {
+        int k = 0;
+        while ((count << k) < sum) {
+            k++;
+        }
+        return k;
+    }
+    void update(int folded)
+    {
+        sum += folded;
+        if (++count == 32) {
+            sum >>= 1;
+            count >>= 1;
+        }
+    }
+};
+
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out), acc(0), bits(0) {}
+    void put(uint32_t value, int n)
+    {
+        acc |= (uint64_t)value << bits;
+        bits += n;
+        while (bits >= 8) {
+            out.push_back((uint8_t)acc);
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    void flush()
+    {
+        if (bits > 0) {
+            out.push_back((uint8_t)acc);
+        }
+        acc = 0;
+        bits = 0;
+    }
+private:
+    std::vector<uint8_t>& out;
+    uint64_t acc;
+    int bits;
+};
+
+static inline int trailing_ones(uint64_t v)
+{
+#if defined(__GNUC__)
+    return ~v ? __builtin_ctzll(~v) : 64;
+#else
+    int n = 0;
+    while (n < 64 && (v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), end(data + size), acc(0), bits(0), consumed(0), available(size * 8) {}
+    // a Rice code with parameter k, or the escape
+    int rice(int k)
+    {
+        refill();
+        int q = trailing_ones(acc);
+        int value, n;
+        if (q < RICE_LIMIT) {
+            value = (q << k) | (int)((acc >> (q + 1)) & ((1u << k) - 1));
+            n = q + 1 + k;
+        } else {
+            value = (int)((acc >> RICE_LIMIT) & 0xff);
+            n = RICE_LIMIT + 8;
+        }
+        acc >>= n;
+        bits -= n;
+        consumed += n;
+        return value;
+    }
+    // read past the end (which reads as zeros)
+    bool failed() const { return consumed > available; }
+private:
+    // at least 57 bits in acc, which is more than a code takes
+    void refill()
+    {
+        if (end - data >= 8) {
+            uint64_t next;
+            memcpy(&next, data, 8);     // little endian, like the rest of the app
+            acc |= next << bits;
+            data += (63 - bits) >> 3;
+            bits |= 56;
+            return;
+        }
+        while (bits <= 56) {
+            acc |= (uint64_t)(data < end ? *data++ : 0) << bits;
+            bits += 8;
+        }
+    }
+
+    const uint8_t* data;
+    const uint8_t* end;
+    uint64_t acc;
+    int bits;
+    uint64_t consumed;
+    uint64_t available;
+};
+
+void tile_encode(const uint8_t* rgb, const uint8_t* ref, int stride, int w, int h, std::vector<uint8_t>& out)
+{
+    const size_t plane_size = (size_t)w * h;
+    std::vector<uint8_t> planes(plane_size * 3), ref_planes;
+    to_planes(rgb, stride, w, h, &planes[0]);
+
+    // folded residuals of both predictors; the smaller sum codes shorter
+    std::vector<uint8_t> spatial(plane_size * 3), temporal;
+    uint64_t spatial_cost = 0, temporal_cost = ~0ull;
+    for (int c = 0; c < 3; c++) {
+        const uint8_t* plane = &planes[plane_size * c];
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                size_t i = (size_t)y * w + x;
+                int f = fold(plane[i] - predict(plane, w, x, y));
+                spatial[plane_size * c + i] = (uint8_t)f;
+                spatial_cost += f;
+            }
+        }
+    }
+    if (ref) {
+        ref_planes.resize(plane_size * 3);
+        to_planes(ref, stride, w, h, &ref_planes[0]);
+        temporal.resize(plane_size * 3);
+        temporal_cost = 0;
+        for (size_t i = 0; i < plane_size * 3; i++) {
+            int f = fold(planes[i] - ref_planes[i]);
+            temporal[i] = (uint8_t)f;
+            temporal_cost += f;
+        }
+    }
+    bool use_ref = temporal_cost < spatial_cost;
+    const uint8_t* residuals = use_ref ? &temporal[0] : &spatial[0];
+
+    size_t start = out.size();
+    out.push_back(use_ref ? MODE_REFERENCE : MODE_SPATIAL);
+    BitWriter writer(out);
+    RiceState state[3];
+    for (size_t i = 0; i < plane_size; i++) {
+        for (int c = 0; c < 3; c++) {
+            int f = residuals[plane_size * c + i];
+            int k = state[c].parameter();
+            int q = f >> k;
+            if (q < RICE_LIMIT) {
+                // q ones, a zero and the low k bits
+                writer.put(((1u << q) - 1) | (uint32_t)(f & ((1 << k) - 1)) << (q + 1), q + 1 + k);
+            } else {
+                writer.put(((1u << RICE_LIMIT) - 1) | (uint32_t)f << RICE_LIMIT, RICE_LIMIT + 8);
+            }
+            state[c].update(f);
+        }
+    }
+    writer.flush();
+
+    // noise doesn't compress: store it instead of making it bigger
+    if (out.size() - start > plane_size * 3 + 1) {
+        out.resize(start);
+        out.push_back(MODE_STORED);
+        for (int y = 0; y < h; y++) {
+            out.insert(out.end(), rgb + (size_t)y * stride, rgb + (size_t)y * stride + w * 3);
+        }
+    }
+}
+
+bool tile_uses_reference(const uint8_t* data, size_t size)
+{
+    return size > 0 && data[0] == MODE_REFERENCE;
+}
+
+bool tile_decode(const uint8_t* data, size_t size, const uint8_t* ref, int ref_stride,
+                 uint8_t* rgb, int stride, int w, int h)
+{
+    const size_t plane_size = (size_t)w * h;
+    if (size < 1) {
+        return false;
+    }
+    if (data[0] == MODE_STORED) {
+        if (size != 1 + plane_size * 3) {
+            return false;
+        }
+        for (int y = 0; y < h; y++) {
+            memcpy(rgb + (size_t)y * stride, data + 1 + (size_t)y * w * 3, w * 3);
+        }
+        return true;
+    }
+    bool use_ref = data[0] == MODE_REFERENCE;
+    if ((data[0] != MODE_SPATIAL && !use_ref) || (use_ref && !ref)) {
+        return false;
+    }
+
+    std::vector<uint8_t> planes(plane_size * 3), ref_planes;
+    if (use_ref) {
+        ref_planes.resize(plane_size * 3);
+        to_planes(ref, ref_stride, w, h, &ref_planes[0]);
+    }
+    BitReader reader(data + 1, size - 1);
+    RiceState state[3];
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            size_t i = (size_t)y * w + x;
+            for (int c = 0; c < 3; c++) {
+                int f = reader.rice(state[c].parameter());
+                state[c].update(f);
+                uint8_t* plane = &planes[plane_size * c];
+                int prediction = use_ref ? ref_planes[plane_size * c + i] : predict(plane, w, x, y);
+                plane[i] = (uint8_t)(prediction + unfold(f));
+            }
+        }
+    }
+    if (reader.failed()) {
+        return false;
+    }
+    from_planes(&planes[0], w, h, rgb, stride);
+    return true;
+}
+
+} // namespace
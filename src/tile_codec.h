@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace slitscan {
+
+// Lossless codec for blocks of RGB history texels (TieredHistory's cold
+// layers). Each block is predicted either spatially (the JPEG-LS median
+// predictor on G, R - G and B - G) or from the same block of a reference layer,
+// whichever leaves smaller residuals, and the residuals are Golomb-Rice coded
+// with a per-plane adaptive parameter. Blocks that don't shrink are stored as is.
+
+// Appends the encoding of a w x h block to out. ref is the same block of the
+// reference layer to predict from, or NULL to only predict spatially; both
+// have stride bytes per row.
+void tile_encode(const uint8_t* rgb, const uint8_t* ref, int stride, int w, int h, std::vector<uint8_t>& out);
+
+// True if the encoding at data uses the reference layer (decoding then needs it)
+bool tile_uses_reference(const uint8_t* data, size_t size);
+
+// Decodes a w x h block into rgb (stride bytes per row); ref is the decoded
+// reference block (ref_stride bytes per row), needed if tile_uses_reference().
+// Returns false on corrupt input.
+bool tile_decode(const uint8_t* data, size_t size, const uint8_t* ref, int ref_stride,
+                 uint8_t* rgb, int stride, int w, int h);
+
+} // namespace
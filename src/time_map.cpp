@@ -0,0 +1,368 @@
+#include "time_map.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <atomic>
+#include <algorithm>
+
+namespace slitscan {
+
+static const float PI = 3.14159265358979f;
+
+static std::atomic<uint32_t> next_time_map_id(1);
+
+// larger PGMs are rejected before anything is allocated for them
+static const int MAX_PGM_SIZE = 8192;
+
+// t moved by whole history lengths to within half a history of reference. Time
+// wraps around the history, so this is the same moment, but interpolating
+// between the two no longer sweeps through everything in between.
+static inline float unwrap(float t, float reference)
+{
+    return t + std::floor(reference - t + 0.5f);
+}
+
+TimeMap::TimeMap() :
+    id(next_time_map_id++),
+    version(0)
+{
+}
+
+TimeMap* TimeMap::create(const std::string& spec)
+{
+    size_t colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+    std::string arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+    if (name == "radial") {
+        return new RadialTimeMap();
+    } else if (name == "linear") {
+        return new LinearTimeMap(arg.empty() ? 0 : (float)atof(arg.c_str()));
+    } else if (name == "spiral") {
+        return arg.empty() ? new SpiralTimeMap() : new SpiralTimeMap((float)atof(arg.c_str()));
+    } else if (name == "image") {
+        return ImageTimeMap::loadPGM(arg);
+    }
+    return NULL;
+}
+
+float LinearTimeMap::evaluate(float x, float y) const
+{
+    // rotate (x, y) around (0.5, 0.5) and use the rotated y as time
+    float rad = angle * PI / 180.0f;
+    float ry = -(x - 0.5f) * std::sin(rad) + (y - 0.5f) * std::cos(rad) + 0.5f;
+    return ry - 1;
+}
+
+float RadialTimeMap::evaluate(float x, float y) const
+{
+    float dx = cx - x;
+    float dy = cy - y;
+    return -(dx*dx + dy*dy) * scale;
+}
+
+float SpiralTimeMap::evaluate(float x, float y) const
+{
+    float dx = x - 0.5f;
+    float dy = y - 0.5f;
+    float r = std::sqrt(dx*dx + dy*dy);
+    // time jumps by a whole history at the atan2 seam: the same moment per pixel,
+    // but anything interpolating across it has to unwrap() first
+    float angle = std::atan2(dy, dx) / (2 * PI) - 0.5f;
+    return angle - turns * r;
+}
+
+ImageTimeMap::ImageTimeMap(const uint16_t* src, int width, int height, int max_level) :
+    levels((size_t)width * height),
+    width(width),
+    height(height),
+    // one level short of a full history, so the brightest level doesn't wrap to the newest frame
+    depth(max_level / (max_level + 1.0f))
+{
+    float scale = max_level > 0 ? 1.0f / max_level : 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+        levels[i] = src[i] * scale;
+    }
+}
+
+ImageTimeMap* ImageTimeMap::loadPGM(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    // header: "P5" width height maxval, separated by whitespace, '#' starts a comment
+    int values[3];
+    char magic[3] = { 0 };
+    bool ok = fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && magic[1] == '5';
+    for (int i = 0; ok && i < 3; i++) {
+        int c = fgetc(file);
+        while (c == '#' || isspace(c)) {
+            if (c == '#') {
+                while (c != '\n' && c != EOF) c = fgetc(file);
+            }
+            c = fgetc(file);
+        }
+        ungetc(c, file);
+        ok = fscanf(file, "%d", &values[i]) == 1;
+    }
+    // exactly one whitespace character separates the header from the samples
+    ok = ok && isspace(fgetc(file)) && values[0] > 0 && values[1] > 0 && values[2] > 0 && values[2] < 65536 &&
+        values[0] <= MAX_PGM_SIZE && values[1] <= MAX_PGM_SIZE;
+
+    ImageTimeMap* map = NULL;
+    if (ok) {
+        int width = values[0], height = values[1], max_level = values[2];
+        size_t count = (size_t)width * height;
+        size_t sample_size = max_level > 255 ? 2 : 1;
+        std::vector<uint8_t> raw(count * sample_size);
+        if (fread(&raw[0], 1, raw.size(), file) == raw.size()) {
+            std::vector<uint16_t> samples(count);
+            for (size_t i = 0; i < count; i++) {
+                // 16-bit PGM samples are big-endian
+                samples[i] = sample_size == 2 ? (uint16_t)((raw[i*2] << 8) | raw[i*2 + 1]) : raw[i];
+            }
+            map = new ImageTimeMap(&samples[0], width, height, max_level);
+        }
+    }
+
+    fclose(file);
+    return map;
+}
+
+float ImageTimeMap::evaluate(float x, float y) const
+{
+    // bilinear, clamped to the edges
+    float fx = (std::min)((std::max)(x * width - 0.5f, 0.0f), (float)(width - 1));
+    float fy = (std::min)((std::max)(y * height - 0.5f, 0.0f), (float)(height - 1));
+    int x0 = (int)fx, y0 = (int)fy;
+    int x1 = (std::min)(x0 + 1, width - 1), y1 = (std::min)(y0 + 1, height - 1);
+    float wx = fx - x0, wy = fy - y0;
+    const float* r0 = &levels[(size_t)y0 * width];
+    const float* r1 = &levels[(size_t)y1 * width];
+    float top = r0[x0] + (r0[x1] - r0[x0]) * wx;
+    float bottom = r1[x0] + (r1[x1] - r1[x0]) * wx;
+    return -(top + (bottom - top) * wy) * depth;
+}
+
+TimeMapCache::TimeMapCache() :
+    table_generation(0),
+    next_generation(0),
+    lookups(0)
+{
+    meshes.reserve(MAX_MESHES);
+}
+
+const float* TimeMapCache::getTable(const TimeMap& map, int width, int height)
+{
+    Key key = { map.getId(), map.getVersion(), width, height };
+    lookups++;
+
+    Table* entry = NULL;
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (tables[i].key == key) {
+            tables[i].last_used = lookups;
+            table_generation = tables[i].generation;
+            return &tables[i].values[0];
+        }
+        // reuse the slot of an outdated version of the same map, else the least recently used one
+        if (tables[i].key.map_id == key.map_id) {
+            entry = &tables[i];
+        }
+    }
+    if (!entry) {
+        if (tables.size() < MAX_TABLES) {
+            tables.push_back(Table());
+            entry = &tables.back();
+        } else {
+            entry = &tables[0];
+            for (size_t i = 1; i < tables.size(); i++) {
+                if (tables[i].last_used < entry->last_used) entry = &tables[i];
+            }
+        }
+    }
+
+    entry->values.resize((size_t)width * height);
+    float* out = &entry->values[0];
+    for (int row = 0; row < height; row++) {
+        float y = (row + 0.5f) / height;
+        for (int col = 0; col < width; col++) {
+            *out++ = map.evaluate((col + 0.5f) / width, y);
+        }
+    }
+
+    // generations are unique across entries, so uploads notice switching between cached maps too
+    entry->key = key;
+    entry->generation = ++next_generation;
+    entry->last_used = lookups;
+    table_generation = entry->generation;
+    return &entry->values[0];
+}
+
+// Quadtree leaves are kept as (x, y, size) triples on a grid of 2^depth cells per side
+void TimeMapCache::subdivide(const TimeMap& map, int x, int y, int size, int grid, int min_size, float tolerance,
+                             std::vector<int>& leaves)
+{
+    if (size > 1 && size > min_size) {
+        // split anything coarser than the minimum depth, so small features can't fall between samples
+        bool split = size > grid / 4;
+        if (!split) {
+            float x0 = x / (float)grid, y0 = y / (float)grid, s = size / (float)grid;
+            // unwrapped like the fans in getMesh(), so a seam in time alone doesn't force a split
+            float t00 = map.evaluate(x0, y0);
+            float t10 = unwrap(map.evaluate(x0 + s, y0), t00);
+            float t01 = unwrap(map.evaluate(x0, y0 + s), t00);
+            float t11 = unwrap(map.evaluate(x0 + s, y0 + s), t00);
+            // compare against bilinear interpolation of the corners at the centre, the
+            // edge midpoints and the quadrant centres
+            static const float probes[][2] = {
+                { 0.5f, 0.5f }, { 0.5f, 0 }, { 0.5f, 1 }, { 0, 0.5f }, { 1, 0.5f },
+                { 0.25f, 0.25f }, { 0.75f, 0.25f }, { 0.25f, 0.75f }, { 0.75f, 0.75f }
+            };
+            for (size_t i = 0; !split && i < sizeof(probes) / sizeof(probes[0]); i++) {
+                float px = probes[i][0], py = probes[i][1];
+                float top = t00 + (t10 - t00) * px;
+                float bottom = t01 + (t11 - t01) * px;
+                float interpolated = top + (bottom - top) * py;
+                split = std::fabs(unwrap(map.evaluate(x0 + px * s, y0 + py * s), interpolated) - interpolated) > tolerance;
+            }
+        }
+        if (split) {
+            int half = size / 2;
+            subdivide(map, x, y, half, grid, min_size, tolerance, leaves);
+            subdivide(map, x + half, y, half, grid, min_size, tolerance, leaves);
+            subdivide(map, x, y + half, half, grid, min_size, tolerance, leaves);
+            subdivide(map, x + half, y + half, half, grid, min_size, tolerance, leaves);
+            return;
+        }
+    }
+    leaves.push_back(x);
+    leaves.push_back(y);
+    leaves.push_back(size);
+}
+
+const TimeMapMesh& TimeMapCache::getMesh(const TimeMap& map, int width, int height, float tolerance)
+{
+    Key key = { map.getId(), map.getVersion(), width, height };
+    lookups++;
+
+    Mesh* entry = NULL;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (meshes[i].key == key && meshes[i].tolerance == tolerance) {
+            meshes[i].last_used = lookups;
+            return meshes[i].mesh;
+        }
+        // same slot choice as getTable()
+        if (meshes[i].key.map_id == key.map_id) {
+            entry = &meshes[i];
+        }
+    }
+    if (!entry) {
+        if (meshes.size() < MAX_MESHES) {
+            meshes.push_back(Mesh());
+            entry = &meshes.back();
+        } else {
+            entry = &meshes[0];
+            for (size_t i = 1; i < meshes.size(); i++) {
+                if (meshes[i].last_used < entry->last_used) entry = &meshes[i];
+            }
+        }
+    }
+    TimeMapMesh& mesh = entry->mesh;
+
+    // finest cells are about 4 pixels across; no point in going below that
+    int depth = 2;
+    while (depth < 10 && (4 << depth) < (std::max)(width, height)) {
+        depth++;
+    }
+    int grid = 1 << depth;
+
+    std::vector<int> leaves;
+    subdivide(map, 0, 0, grid, grid, 1, tolerance, leaves);
+
+    mesh.positions.clear();
+    mesh.texcoords.clear();
+    mesh.indices.clear();
+
+    // corner vertices are shared between leaves; index by grid position
+    std::vector<int32_t> grid_vertex((size_t)(grid + 1) * (grid + 1), -1);
+    uint32_t vertex_count = 0;
+    const float inv_grid = 1.0f / grid;
+    for (size_t i = 0; i < leaves.size(); i += 3) {
+        int x = leaves[i], y = leaves[i + 1], size = leaves[i + 2];
+        const int corners[4][2] = { { x, y }, { x + size, y }, { x + size, y + size }, { x, y + size } };
+        for (int c = 0; c < 4; c++) {
+            int32_t& index = grid_vertex[(size_t)corners[c][1] * (grid + 1) + corners[c][0]];
+            if (index < 0) {
+                float px = corners[c][0] * inv_grid, py = corners[c][1] * inv_grid;
+                mesh.positions.push_back(px);
+                mesh.positions.push_back(py);
+                mesh.texcoords.push_back(px);
+                mesh.texcoords.push_back(py);
+                mesh.texcoords.push_back(map.evaluate(px, py));
+                index = vertex_count++;
+            }
+        }
+    }
+
+    // Each leaf becomes a fan around its centre. Walking its edges picks up the
+    // corners of smaller neighbours too, so there are no T-junctions (and no cracks).
+    std::vector<uint32_t> outline;
+    for (size_t i = 0; i < leaves.size(); i += 3) {
+        int x = leaves[i], y = leaves[i + 1], size = leaves[i + 2];
+        const int walk[4][4] = {
+            { x, y, 1, 0 }, { x + size, y, 0, 1 }, { x + size, y + size, -1, 0 }, { x, y + size, 0, -1 }
+        };
+        outline.clear();
+        for (int e = 0; e < 4; e++) {
+            int gx = walk[e][0], gy = walk[e][1];
+            for (int step = 0; step < size; step++, gx += walk[e][2], gy += walk[e][3]) {
+                int32_t index = grid_vertex[(size_t)gy * (grid + 1) + gx];
+                if (index >= 0) {
+                    outline.push_back((uint32_t)index);
+                }
+            }
+        }
+
+        float cx = (x + size * 0.5f) * inv_grid, cy = (y + size * 0.5f) * inv_grid;
+        mesh.positions.push_back(cx);
+        mesh.positions.push_back(cy);
+        mesh.texcoords.push_back(cx);
+        mesh.texcoords.push_back(cy);
+        mesh.texcoords.push_back(map.evaluate(cx, cy));
+        uint32_t centre = vertex_count++;
+
+        // a fan straddling a seam in time (the spiral's) gets its own copies of
+        // the corners across it, unwrapped so GL interpolates the short way round
+        float tc = mesh.texcoords[centre * 3 + 2];
+        for (size_t v = 0; v < outline.size(); v++) {
+            const uint32_t corner = outline[v];
+            float t = mesh.texcoords[corner * 3 + 2];
+            float unwrapped = unwrap(t, tc);
+            if (unwrapped != t) {
+                float px = mesh.positions[corner * 2], py = mesh.positions[corner * 2 + 1];
+                mesh.positions.push_back(px);
+                mesh.positions.push_back(py);
+                mesh.texcoords.push_back(px);
+                mesh.texcoords.push_back(py);
+                mesh.texcoords.push_back(unwrapped);
+                outline[v] = vertex_count++;
+            }
+        }
+        for (size_t v = 0; v < outline.size(); v++) {
+            mesh.indices.push_back(centre);
+            mesh.indices.push_back(outline[v]);
+            mesh.indices.push_back(outline[(v + 1) % outline.size()]);
+        }
+    }
+
+    entry->key = key;
+    entry->tolerance = tolerance;
+    entry->last_used = lookups;
+    return mesh;
+}
+
+} // namespace
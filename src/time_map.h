@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+namespace slitscan {
+
+// A time map decides which moment of the history is shown at each output position.
+// evaluate() takes normalized output coordinates (x to the right, y down, both in
+// [0, 1]) and returns a time coordinate relative to the newest layer, in units of
+// the whole history: 0 is the newest frame and -1 wraps around to it again, so
+// the useful range is (-1, 0]. The renderers add the scrolling newest offset.
+class TimeMap
+{
+public:
+    TimeMap();
+    virtual ~TimeMap() {}
+
+    virtual const char* getName() const = 0;
+    virtual float evaluate(float x, float y) const = 0;
+
+    // Create a map from a command line style description: "radial", "linear[:angle]",
+    // "spiral[:turns]" or "image:path.pgm". Returns NULL if it can't be parsed or loaded.
+    static TimeMap* create(const std::string& spec);
+
+    // Unique per instance, so caches never confuse a deleted map with a new one
+    uint32_t getId() const { return id; }
+    // Bumped by every parameter change; cached tables/meshes compare against it
+    uint32_t getVersion() const { return version; }
+
+protected:
+    void invalidate() { version++; }
+
+private:
+    uint32_t id;
+    uint32_t version;
+};
+
+// Time follows one axis, rotated by angle (degrees) around the centre.
+// At angle 0 this is the classic top-to-bottom map of the old drawRect().
+class LinearTimeMap : public TimeMap
+{
+public:
+    explicit LinearTimeMap(float angle = 0) : angle(angle) {}
+
+    const char* getName() const { return "linear"; }
+    float evaluate(float x, float y) const;
+
+    float getAngle() const { return angle; }
+    void setAngle(float val) { angle = val; invalidate(); }
+
+private:
+    float angle;
+};
+
+// Time follows squared distance from a centre point, newest in the middle
+// (the old drawRectCircularTime()).
+class RadialTimeMap : public TimeMap
+{
+public:
+    RadialTimeMap(float cx = 0.5f, float cy = 0.5f, float scale = 1) : cx(cx), cy(cy), scale(scale) {}
+
+    const char* getName() const { return "radial"; }
+    float evaluate(float x, float y) const;
+
+    void setCenter(float x, float y) { cx = x; cy = y; invalidate(); }
+    float getScale() const { return scale; }
+    void setScale(float val) { scale = val; invalidate(); }
+
+private:
+    float cx, cy;
+    float scale;
+};
+
+// Time winds around the centre: one full history per revolution plus turns per unit radius.
+class SpiralTimeMap : public TimeMap
+{
+public:
+    explicit SpiralTimeMap(float turns = 2) : turns(turns) {}
+
+    const char* getName() const { return "spiral"; }
+    float evaluate(float x, float y) const;
+
+    float getTurns() const { return turns; }
+    void setTurns(float val) { turns = val; invalidate(); }
+
+private:
+    float turns;
+};
+
+// Time offsets painted as a grayscale image: black is the newest frame and the
+// brightest level is depth history lengths in the past. The image is sampled
+// bilinearly, so it can be any size; TimeMapCache resamples it once per output
+// resolution.
+class ImageTimeMap : public TimeMap
+{
+public:
+    // levels: width*height samples in [0, max_level], rows top to bottom
+    ImageTimeMap(const uint16_t* levels, int width, int height, int max_level);
+
+    // Binary PGM (P5), 8 or 16 bits per sample, at most 8192 pixels per side.
+    // Returns NULL on failure.
+    static ImageTimeMap* loadPGM(const std::string& path);
+
+    const char* getName() const { return "image"; }
+    float evaluate(float x, float y) const;
+
+    float getDepth() const { return depth; }
+    void setDepth(float val) { depth = val; invalidate(); }
+
+private:
+    std::vector<float> levels;  // normalized to [0, 1]
+    int width;
+    int height;
+    float depth;
+};
+
+// Mesh for the GL path: positions are normalized to [0, 1] and scaled by the
+// caller, texcoords are (x, y, time) ready for the 3D history texture.
+struct TimeMapMesh
+{
+    std::vector<float> positions;   // x, y
+    std::vector<float> texcoords;   // s, t, r
+    std::vector<uint32_t> indices;  // GL_TRIANGLES
+};
+
+// Evaluates a TimeMap once per output resolution and keeps the result until the
+// map, its parameters or the resolution change. Tables and meshes for the last few
+// maps are kept around so switching back and forth between maps is only a lookup.
+class TimeMapCache
+{
+public:
+    static const size_t MAX_TABLES = 4;
+    static const size_t MAX_MESHES = 4;
+
+    TimeMapCache();
+
+    // Per-pixel time table, width*height floats sampled at pixel centres
+    const float* getTable(const TimeMap& map, int width, int height);
+    // Adaptively tessellated mesh for an output of width x height pixels: quads are
+    // split until linear interpolation of the time coordinate stays within
+    // tolerance (in history lengths), or they get down to a few pixels across.
+    const TimeMapMesh& getMesh(const TimeMap& map, int width, int height, float tolerance);
+
+    // Identifies the contents of the table last returned by getTable(); changes
+    // whenever a different or rebuilt table is returned, so uploads can be skipped otherwise
+    uint32_t getTableGeneration() const { return table_generation; }
+
+private:
+    struct Key {
+        uint32_t map_id;
+        uint32_t version;
+        int width;
+        int height;
+        bool operator==(const Key& other) const {
+            return map_id == other.map_id && version == other.version && width == other.width && height == other.height;
+        }
+    };
+
+    struct Table {
+        Key key;
+        uint32_t generation;
+        uint64_t last_used;
+        std::vector<float> values;
+    };
+
+    std::vector<Table> tables;
+    uint32_t table_generation;
+    uint32_t next_generation;
+    uint64_t lookups;
+
+    struct Mesh {
+        Key key;
+        float tolerance;
+        uint64_t last_used;
+        TimeMapMesh mesh;
+    };
+
+    void subdivide(const TimeMap& map, int x, int y, int size, int grid, int min_size, float tolerance,
+                   std::vector<int>& leaves);
+
+    std::vector<Mesh> meshes;   // reserved up front, so returned references stay valid
+};
+
+} // namespace
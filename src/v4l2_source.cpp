@@ -0,0 +1,302 @@
+#include "v4l2_source.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <linux/videodev2.h>
+#endif
+
+namespace slitscan {
+
+// enough that the driver always has somewhere to put the next frame while we
+// hold one and convert another; more only adds latency
+static const int NUM_BUFFERS = 4;
+
+static double steady_now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+V4L2Source::V4L2Source() :
+    fd(-1),
+    width(0),
+    height(0),
+    row_bytes(0),
+    frame_rate(0),
+    dequeued(-1),
+    streaming(false),
+    last_sequence(0),
+    frame_timestamp(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+V4L2Source::~V4L2Source()
+{
+    close();
+}
+
+#ifdef __linux__
+
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+bool V4L2Source::open(const std::string& device, int req_width, int req_height, int fps)
+{
+    close();
+    fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0 ||
+        !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        close();
+        return false;
+    }
+
+    // YUYV is what every UVC camera (and vivid) offers uncompressed, and what the
+    // rest of the pipeline consumes. The driver may adjust the size.
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = req_width;
+    fmt.fmt.pix.height = req_height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+        close();
+        return false;
+    }
+    width = fmt.fmt.pix.width;
+    height = fmt.fmt.pix.height;
+    row_bytes = fmt.fmt.pix.bytesperline ? fmt.fmt.pix.bytesperline : width * 2;
+
+    // frame rate is only a request; not every driver supports setting it
+    v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = fps;
+    xioctl(fd, VIDIOC_S_PARM, &parm);
+    frame_rate = fps;
+    if (xioctl(fd, VIDIOC_G_PARM, &parm) == 0 && parm.parm.capture.timeperframe.numerator) {
+        frame_rate = parm.parm.capture.timeperframe.denominator / (double)parm.parm.capture.timeperframe.numerator;
+    }
+
+    if (!mapBuffers()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool V4L2Source::mapBuffers()
+{
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = NUM_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < req.count; i++) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            return false;
+        }
+        Buffer b;
+        b.length = buf.length;
+        b.start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+        if (b.start == MAP_FAILED) {
+            return false;
+        }
+        buffers.push_back(b);
+    }
+    return true;
+}
+
+void V4L2Source::unmapBuffers()
+{
+    for (size_t i = 0; i < buffers.size(); i++) {
+        munmap(buffers[i].start, buffers[i].length);
+    }
+    buffers.clear();
+    if (fd >= 0) {
+        v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.count = 0;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        xioctl(fd, VIDIOC_REQBUFS, &req);
+    }
+}
+
+void V4L2Source::close()
+{
+    stop();
+    unmapBuffers();
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool V4L2Source::start()
+{
+    if (streaming) {
+        return true;
+    }
+    if (fd < 0) {
+        return false;
+    }
+    for (size_t i = 0; i < buffers.size(); i++) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = (uint32_t)i;
+        if (xioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+            return false;
+        }
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd, VIDIOC_STREAMON, &type) < 0) {
+        return false;
+    }
+    streaming = true;
+    dequeued = -1;
+    stats.frames = 0;
+    return true;
+}
+
+void V4L2Source::stop()
+{
+    if (!streaming) {
+        return;
+    }
+    // STREAMOFF also returns every buffer, including one we might still hold
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd, VIDIOC_STREAMOFF, &type);
+    streaming = false;
+    dequeued = -1;
+}
+
+const uint8_t* V4L2Source::acquireFrame()
+{
+    if (!streaming) {
+        return NULL;
+    }
+    releaseFrame();
+
+    v4l2_buffer buf;
+    for (;;) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_DQBUF, &buf) == 0) {
+            break;
+        }
+        if (errno != EAGAIN) {
+            return NULL;
+        }
+        // block like the PS3 Eye's getFrame(), but give up after a second so a
+        // stalled camera doesn't hang the app
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int r = select(fd + 1, &fds, NULL, NULL, &timeout);
+        if (r == 0 || (r < 0 && errno != EINTR)) {
+            return NULL;
+        }
+    }
+    if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+        // corrupted frame: hand the buffer straight back
+        xioctl(fd, VIDIOC_QBUF, &buf);
+        return NULL;
+    }
+    dequeued = buf.index;
+
+    double now = steady_now();
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        // CLOCK_MONOTONIC, the same clock as std::chrono::steady_clock
+        frame_timestamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec * 1e-6;
+    } else {
+        frame_timestamp = now;
+    }
+    if (stats.frames > 0 && buf.sequence > last_sequence + 1) {
+        stats.dropped += buf.sequence - last_sequence - 1;
+    }
+    last_sequence = buf.sequence;
+    stats.frames++;
+    stats.latency_ms += ((now - frame_timestamp) * 1000 - stats.latency_ms) / (stats.frames < 100 ? stats.frames : 100);
+
+    return (const uint8_t*)buffers[dequeued].start;
+}
+
+void V4L2Source::releaseFrame()
+{
+    if (dequeued < 0) {
+        return;
+    }
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = dequeued;
+    xioctl(fd, VIDIOC_QBUF, &buf);
+    dequeued = -1;
+}
+
+#else
+
+bool V4L2Source::open(const std::string&, int, int, int) { return false; }
+bool V4L2Source::mapBuffers() { return false; }
+void V4L2Source::unmapBuffers() {}
+void V4L2Source::close() {}
+bool V4L2Source::start() { return false; }
+void V4L2Source::stop() {}
+const uint8_t* V4L2Source::acquireFrame() { return NULL; }
+void V4L2Source::releaseFrame() {}
+
+#endif
+
+uint8_t* V4L2Source::getFrame()
+{
+    const uint8_t* frame = acquireFrame();
+    if (!frame) {
+        return NULL;
+    }
+    uint8_t* copy = (uint8_t*)malloc(row_bytes * height);
+    memcpy(copy, frame, row_bytes * height);
+    releaseFrame();
+    stats.copies++;
+    return copy;
+}
+
+} // namespace
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+
+namespace slitscan {
+
+// FrameSource for Linux webcams through Video4Linux2 streaming I/O. The driver
+// DMAs frames into buffers we mmap once at start(), so acquireFrame() hands out
+// the driver's YUYV buffer directly and the only pass over the pixels is the
+// caller's RGBA conversion. getFrame() still works, at the cost of one copy.
+// Only available on Linux; elsewhere open() always fails.
+class V4L2Source : public FrameSource
+{
+public:
+    struct Stats {
+        uint64_t frames;
+        uint64_t dropped;           // sequence number gaps: frames the driver had no free buffer for
+        uint64_t copies;            // frames served through getFrame() rather than acquireFrame()
+        double latency_ms;          // running average of capture timestamp to dequeue
+    };
+
+    V4L2Source();
+    ~V4L2Source();
+
+    // Opens the device and negotiates YUYV at (or near) the requested size and rate
+    bool open(const std::string& device, int width, int height, int fps);
+    void close();
+
+    bool start();
+    void stop();
+    uint8_t* getFrame();
+    const uint8_t* acquireFrame();
+    void releaseFrame();
+    double getFrameTimestamp() const { return frame_timestamp; }
+    // the driver counts from 0, the other sources from 1
+    uint64_t getFrameSequence() const { return stats.frames ? last_sequence + 1ULL : 0; }
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    uint32_t getRowBytes() const { return row_bytes; }
+    double getFrameRate() const { return frame_rate; }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    V4L2Source(const V4L2Source&);
+    void operator=(const V4L2Source&);
+
+    struct Buffer {
+        void* start;
+        size_t length;
+    };
+
+    bool mapBuffers();
+    void unmapBuffers();
+
+    int fd;
+    uint32_t width, height, row_bytes;
+    double frame_rate;
+    std::vector<Buffer> buffers;
+    int dequeued;               // index of the buffer handed out by acquireFrame(), or -1
+    bool streaming;
+    uint32_t last_sequence;
+    double frame_timestamp;
+    Stats stats;
+};
+
+} // namespace
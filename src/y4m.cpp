@@ -0,0 +1,347 @@
+#include "y4m.h"
+#include "yuv.h"
+#include "raw_stream.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+
+namespace slitscan {
+
+static void chroma_shift(VideoFormat::PixelFormat format, int& shift_x, int& shift_y)
+{
+    shift_x = format == VideoFormat::YUV420P || format == VideoFormat::YUV422P ? 1 : 0;
+    shift_y = format == VideoFormat::YUV420P ? 1 : 0;
+}
+
+size_t VideoFormat::getFrameSize() const
+{
+    size_t luma = (size_t)width * height;
+    if (pixel_format == YUYV) {
+        return luma * 2;
+    }
+    if (pixel_format == MONO) {
+        return luma;
+    }
+    int shift_x, shift_y;
+    chroma_shift(pixel_format, shift_x, shift_y);
+    size_t chroma = (size_t)((width + (1 << shift_x) - 1) >> shift_x) * ((height + (1 << shift_y) - 1) >> shift_y);
+    return luma + 2 * chroma;
+}
+
+bool VideoFormat::parseY4MHeader(const std::string& line)
+{
+    std::istringstream tokens(line);
+    std::string token;
+    if (!(tokens >> token) || token != "YUV4MPEG2") {
+        return false;
+    }
+
+    // defaults per the format description: 4:2:0 with JPEG chroma siting
+    pixel_format = YUV420P;
+    width = height = 0;
+    while (tokens >> token) {
+        const char* value = token.c_str() + 1;
+        switch (token[0]) {
+            case 'W':
+                width = atoi(value);
+                break;
+            case 'H':
+                height = atoi(value);
+                break;
+            case 'F':
+                if (sscanf(value, "%d:%d", &fps_num, &fps_den) != 2 || fps_num <= 0 || fps_den <= 0) {
+                    return false;
+                }
+                break;
+            case 'C':
+                // only the 8 bit 420 variants, which differ in chroma siting alone
+                if (strcmp(value, "420") == 0 || strcmp(value, "420jpeg") == 0 ||
+                    strcmp(value, "420paldv") == 0 || strcmp(value, "420mpeg2") == 0) {
+                    pixel_format = YUV420P;
+                } else if (strcmp(value, "422") == 0) {
+                    pixel_format = YUV422P;
+                } else if (strcmp(value, "444") == 0) {
+                    pixel_format = YUV444P;
+                } else if (strcmp(value, "mono") == 0) {
+                    pixel_format = MONO;
+                } else {
+                    return false; // alpha and high bit depth variants
+                }
+                break;
+            default:
+                // interlacing, aspect ratio and X extensions don't matter here
+                break;
+        }
+    }
+    return width > 0 && height > 0;
+}
+
+std::string VideoFormat::toY4MHeader() const
+{
+    static const char* chroma[] = { "420jpeg", "422", "444", "mono" };
+    std::ostringstream header;
+    header << "YUV4MPEG2 W" << width << " H" << height << " F" << fps_num << ":" << fps_den
+           << " Ip A1:1 C" << chroma[pixel_format == YUYV ? YUV422P : pixel_format] << "\n";
+    return header.str();
+}
+
+void VideoFormat::toRGBA(const uint8_t* frame, uint8_t* rgba) const
+{
+    if (pixel_format == YUYV) {
+        yuv422_to_rgba(frame, width * 2, rgba, width, height);
+        return;
+    }
+    if (pixel_format == MONO) {
+        yuv_planar_to_rgba(frame, width, NULL, NULL, 0, 0, 0, rgba, width, height);
+        return;
+    }
+    int shift_x, shift_y;
+    chroma_shift(pixel_format, shift_x, shift_y);
+    int uv_stride = (width + (1 << shift_x) - 1) >> shift_x;
+    size_t uv_size = (size_t)uv_stride * ((height + (1 << shift_y) - 1) >> shift_y);
+    const uint8_t* u = frame + (size_t)width * height;
+    yuv_planar_to_rgba(frame, width, u, u + uv_size, uv_stride, shift_x, shift_y, rgba, width, height);
+}
+
+bool VideoFormat::toYUYV(const uint8_t* frame, uint8_t* yuyv) const
+{
+    if (width % 2) {
+        return false;
+    }
+    if (pixel_format == YUYV) {
+        memcpy(yuyv, frame, getFrameSize());
+        return true;
+    }
+    int shift_x = 0, shift_y = 0;
+    chroma_shift(pixel_format, shift_x, shift_y);
+    int uv_stride = (width + (1 << shift_x) - 1) >> shift_x;
+    size_t uv_size = (size_t)uv_stride * ((height + (1 << shift_y) - 1) >> shift_y);
+    const uint8_t* u_plane = frame + (size_t)width * height;
+    const uint8_t* v_plane = u_plane + uv_size;
+
+    for (int j = 0; j < height; j++) {
+        const uint8_t* y = frame + (size_t)width * j;
+        const uint8_t* u = u_plane + (size_t)uv_stride * (j >> shift_y);
+        const uint8_t* v = v_plane + (size_t)uv_stride * (j >> shift_y);
+        uint8_t* out = yuyv + (size_t)width * 2 * j;
+        for (int i = 0; i < width; i += 2, out += 4) {
+            out[0] = y[i];
+            out[1] = pixel_format == MONO ? 128 : u[i >> shift_x];
+            out[2] = y[i + 1];
+            out[3] = pixel_format == MONO ? 128 : v[i >> shift_x];
+        }
+    }
+    return true;
+}
+
+static bool read_line(FILE* file, std::string& line)
+{
+    line.clear();
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n') {
+        line += (char)c;
+    }
+    return c == '\n';
+}
+
+Y4MReader::Y4MReader() :
+    file(NULL),
+    raw(false),
+    raw_stream(false),
+    record_padding(0)
+{
+}
+
+Y4MReader::~Y4MReader()
+{
+    close();
+}
+
+bool Y4MReader::open(const std::string& path)
+{
+    close();
+    file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    raw = false;
+    raw_stream = false;
+
+    // both formats start with at least 8 bytes before any newline
+    char magic[sizeof(RAW_STREAM_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic)) {
+        close();
+        return false;
+    }
+    if (memcmp(magic, RAW_STREAM_MAGIC, sizeof(magic)) == 0) {
+        RawStreamHeader stream;
+        memcpy(stream.magic, magic, sizeof(magic));
+        if (fread((char*)&stream + sizeof(magic), 1, sizeof(stream) - sizeof(magic), file) != sizeof(stream) - sizeof(magic)) {
+            close();
+            return false;
+        }
+        format.width = stream.width;
+        format.height = stream.height;
+        format.fps_num = stream.fps_num;
+        format.fps_den = stream.fps_den ? stream.fps_den : 1;
+        format.pixel_format = VideoFormat::YUYV;
+        if (stream.width % 2 || stream.row_bytes != stream.width * 2 || stream.header_size < sizeof(stream) ||
+            stream.record_size < sizeof(RawStreamRecord) + format.getFrameSize()) {
+            close();
+            return false;
+        }
+        // skip the rest of the header page; works on pipes too
+        std::vector<uint8_t> skip(stream.header_size - sizeof(stream));
+        if (!skip.empty() && fread(&skip[0], 1, skip.size(), file) != skip.size()) {
+            close();
+            return false;
+        }
+        raw_stream = true;
+        record_padding = stream.record_size - sizeof(RawStreamRecord) - format.getFrameSize();
+        return true;
+    }
+
+    std::string header;
+    if (!read_line(file, header) || !format.parseY4MHeader(std::string(magic, sizeof(magic)) + header)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool Y4MReader::openRaw(const std::string& path, int width, int height, int fps_num, int fps_den)
+{
+    close();
+    if (width % 2) {
+        return false;
+    }
+    file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    raw = true;
+    format.width = width;
+    format.height = height;
+    format.fps_num = fps_num;
+    format.fps_den = fps_den;
+    format.pixel_format = VideoFormat::YUYV;
+    return true;
+}
+
+void Y4MReader::close()
+{
+    if (file && file != stdin) {
+        fclose(file);
+    }
+    file = NULL;
+}
+
+bool Y4MReader::readFrame(std::vector<uint8_t>& frame)
+{
+    if (!file) {
+        return false;
+    }
+    if (raw_stream) {
+        RawStreamRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.magic != RAW_RECORD_MAGIC ||
+            record.payload_size != format.getFrameSize()) {
+            return false;
+        }
+        frame.resize(format.getFrameSize() + record_padding);
+        if (fread(&frame[0], 1, frame.size(), file) != frame.size()) {
+            return false;
+        }
+        frame.resize(format.getFrameSize());
+        return true;
+    }
+    if (!raw) {
+        // every frame starts with "FRAME", optionally followed by parameters we ignore
+        std::string line;
+        if (!read_line(file, line) || line.compare(0, 5, "FRAME") != 0) {
+            return false;
+        }
+    }
+    frame.resize(format.getFrameSize());
+    return fread(&frame[0], 1, frame.size(), file) == frame.size();
+}
+
+Y4MWriter::Y4MWriter() :
+    file(NULL),
+    raw_rgb(false),
+    width(0),
+    height(0)
+{
+}
+
+Y4MWriter::~Y4MWriter()
+{
+    close();
+}
+
+bool Y4MWriter::open(const std::string& path, int width, int height, int fps_num, int fps_den, bool raw_rgb)
+{
+    close();
+    file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    this->width = width;
+    this->height = height;
+    this->raw_rgb = raw_rgb;
+    if (!raw_rgb) {
+        VideoFormat format;
+        format.width = width;
+        format.height = height;
+        format.fps_num = fps_num;
+        format.fps_den = fps_den;
+        format.pixel_format = VideoFormat::YUV444P;
+        std::string header = format.toY4MHeader();
+        if (fwrite(header.data(), 1, header.size(), file) != header.size()) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Y4MWriter::close()
+{
+    bool ok = true;
+    if (file && file != stdout) {
+        ok = fclose(file) == 0;
+    } else if (file) {
+        ok = fflush(file) == 0 && !ferror(file);
+    }
+    file = NULL;
+    return ok;
+}
+
+bool Y4MWriter::writeFrame(const uint8_t* rgba, int stride)
+{
+    if (!file) {
+        return false;
+    }
+    size_t plane = (size_t)width * height;
+    if (raw_rgb) {
+        buffer.resize(plane * 3);
+        uint8_t* out = &buffer[0];
+        for (int j = 0; j < height; j++) {
+            const uint8_t* px = rgba + (ptrdiff_t)stride * j;
+            for (int i = 0; i < width; i++, px += 4, out += 3) {
+                out[0] = px[0];
+                out[1] = px[1];
+                out[2] = px[2];
+            }
+        }
+        return fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+    }
+
+    buffer.resize(plane * 3);
+    rgba_to_yuv444(rgba, stride, &buffer[0], &buffer[plane], &buffer[plane * 2], width, height);
+    static const char frame_header[] = "FRAME\n";
+    return fwrite(frame_header, 1, sizeof(frame_header) - 1, file) == sizeof(frame_header) - 1 &&
+           fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+}
+
+} // namespace
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace slitscan {
+
+// Raw video file formats understood by the offline tools and file capture source.
+// Y4M (YUV4MPEG2) carries its own header; raw YUYV needs size and rate from the caller.
+struct VideoFormat
+{
+    enum PixelFormat {
+        YUV420P,    // Y4M C420, C420jpeg, C420paldv, C420mpeg2
+        YUV422P,    // Y4M C422
+        YUV444P,    // Y4M C444
+        MONO,       // Y4M Cmono
+        YUYV        // packed 4:2:2, like the PS3 Eye
+    };
+
+    int width;
+    int height;
+    int fps_num;
+    int fps_den;
+    PixelFormat pixel_format;
+
+    VideoFormat() : width(0), height(0), fps_num(30), fps_den(1), pixel_format(YUV420P) {}
+
+    double getFrameRate() const { return fps_den ? fps_num / (double)fps_den : 0; }
+    size_t getFrameSize() const;
+
+    // Parse a "YUV4MPEG2 W.. H.. F..:.. C..." stream header line; false if unsupported
+    bool parseY4MHeader(const std::string& line);
+    std::string toY4MHeader() const;
+
+    // Convert one frame in this format to packed RGBA (width*4 bytes per row)
+    void toRGBA(const uint8_t* frame, uint8_t* rgba) const;
+    // Convert one frame in this format to packed YUYV (width*2 bytes per row).
+    // YUYV pairs up pixels, so odd widths are refused and nothing is written.
+    bool toYUYV(const uint8_t* frame, uint8_t* yuyv) const;
+};
+
+// Sequential reader for Y4M or raw YUYV files ("-" reads stdin)
+class Y4MReader
+{
+public:
+    Y4MReader();
+    ~Y4MReader();
+
+    // Y4M, or a raw stream recorded by RawStreamRecorder; raw YUYV needs an even width
+    bool open(const std::string& path);
+    bool openRaw(const std::string& path, int width, int height, int fps_num, int fps_den = 1);
+    void close();
+
+    const VideoFormat& getFormat() const { return format; }
+
+    // Reads the next frame in the file's own pixel format; false at end of file
+    bool readFrame(std::vector<uint8_t>& frame);
+
+private:
+    Y4MReader(const Y4MReader&);
+    void operator=(const Y4MReader&);
+
+    FILE* file;
+    bool raw;
+    bool raw_stream;
+    size_t record_padding;      // raw stream bytes to skip after each frame
+    VideoFormat format;
+};
+
+// Sequential writer for 4:4:4 Y4M or raw RGB24 files ("-" writes stdout)
+class Y4MWriter
+{
+public:
+    Y4MWriter();
+    ~Y4MWriter();
+
+    // raw_rgb writes headerless packed RGB instead of Y4M
+    bool open(const std::string& path, int width, int height, int fps_num, int fps_den, bool raw_rgb = false);
+    // false if anything failed to reach the file
+    bool close();
+
+    // rgba is packed RGBA with stride bytes per row (negative for bottom-up images)
+    bool writeFrame(const uint8_t* rgba, int stride);
+
+private:
+    Y4MWriter(const Y4MWriter&);
+    void operator=(const Y4MWriter&);
+
+    FILE* file;
+    bool raw_rgb;
+    int width;
+    int height;
+    std::vector<uint8_t> buffer;
+};
+
+} // namespace
@@ -0,0 +1,167 @@
+#include "yuv.h"
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SLITSCAN_SSE2 1
+#endif
+
+namespace slitscan {
+
+static const int ITUR_BT_601_CY = 1220542;
+static const int ITUR_BT_601_CUB = 2116026;
+static const int ITUR_BT_601_CUG = -409993;
+static const int ITUR_BT_601_CVG = -852492;
+static const int ITUR_BT_601_CVR = 1673527;
+static const int ITUR_BT_601_SHIFT = 20;
+
+#define _max(a, b) (((a) > (b)) ? (a) : (b))
+#define _saturate(v) static_cast<uint8_t>(static_cast<uint32_t>(v) <= 0xff ? v : v > 0 ? 0xff : 0)
+
+void yuv422_to_rgba(const uint8_t *yuv_src, const int stride, uint8_t *dst, const int width, const int height)
+{
+    const int bIdx = 2;
+    const int uIdx = 0;
+    const int yIdx = 0;
+    
+    const int uidx = 1 - yIdx + uIdx * 2;
+    const int vidx = (2 + uidx) % 4;
+    int j, i;
+    
+    for (j = 0; j < height; j++, yuv_src += stride)
+    {
+        uint8_t* row = dst + (width * 4) * j; // 4 channels
+        
+        for (i = 0; i < 2 * width; i += 4, row += 8)
+        {
+            int u = static_cast<int>(yuv_src[i + uidx]) - 128;
+            int v = static_cast<int>(yuv_src[i + vidx]) - 128;
+            
+            int ruv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVR * v;
+            int guv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVG * v + ITUR_BT_601_CUG * u;
+            int buv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CUB * u;
+            
+            int y00 = _max(0, static_cast<int>(yuv_src[i + yIdx]) - 16) * ITUR_BT_601_CY;
+            row[2 - bIdx] = _saturate((y00 + ruv) >> ITUR_BT_601_SHIFT);
+            row[1] = _saturate((y00 + guv) >> ITUR_BT_601_SHIFT);
+            row[bIdx] = _saturate((y00 + buv) >> ITUR_BT_601_SHIFT);
+            row[3] = (0xff);
+            
+            int y01 = _max(0, static_cast<int>(yuv_src[i + yIdx + 2]) - 16) * ITUR_BT_601_CY;
+            row[6 - bIdx] = _saturate((y01 + ruv) >> ITUR_BT_601_SHIFT);
+            row[5] = _saturate((y01 + guv) >> ITUR_BT_601_SHIFT);
+            row[4 + bIdx] = _saturate((y01 + buv) >> ITUR_BT_601_SHIFT);
+            row[7] = (0xff);
+        }
+    }
+}
+
+void yuv_planar_to_rgba(const uint8_t *y_src, int y_stride, const uint8_t *u_src, const uint8_t *v_src, int uv_stride,
+                        int shift_x, int shift_y, uint8_t *dst, int width, int height)
+{
+    for (int j = 0; j < height; j++, y_src += y_stride)
+    {
+        uint8_t* row = dst + (width * 4) * j;
+        const uint8_t* u_row = u_src ? u_src + uv_stride * (j >> shift_y) : NULL;
+        const uint8_t* v_row = v_src ? v_src + uv_stride * (j >> shift_y) : NULL;
+        
+        for (int i = 0; i < width; i++, row += 4)
+        {
+            // grayscale (mono) input has no chroma planes
+            int u = u_row ? static_cast<int>(u_row[i >> shift_x]) - 128 : 0;
+            int v = v_row ? static_cast<int>(v_row[i >> shift_x]) - 128 : 0;
+            
+            int ruv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVR * v;
+            int guv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CVG * v + ITUR_BT_601_CUG * u;
+            int buv = (1 << (ITUR_BT_601_SHIFT - 1)) + ITUR_BT_601_CUB * u;
+            
+            int y00 = _max(0, static_cast<int>(y_src[i]) - 16) * ITUR_BT_601_CY;
+            row[0] = _saturate((y00 + ruv) >> ITUR_BT_601_SHIFT);
+            row[1] = _saturate((y00 + guv) >> ITUR_BT_601_SHIFT);
+            row[2] = _saturate((y00 + buv) >> ITUR_BT_601_SHIFT);
+            row[3] = (0xff);
+        }
+    }
+}
+
+void yuyv_accumulate(const uint8_t *src, int stride, uint16_t *acc, int width, int height, bool first)
+{
+    const int row_bytes = width * 2;
+    for (int j = 0; j < height; j++, src += stride, acc += row_bytes)
+    {
+        int i = 0;
+#ifdef SLITSCAN_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= row_bytes; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            if (!first)
+            {
+                lo = _mm_add_epi16(lo, _mm_loadu_si128((const __m128i*)(acc + i)));
+                hi = _mm_add_epi16(hi, _mm_loadu_si128((const __m128i*)(acc + i + 8)));
+            }
+            _mm_storeu_si128((__m128i*)(acc + i), lo);
+            _mm_storeu_si128((__m128i*)(acc + i + 8), hi);
+        }
+#endif
+        for (; i < row_bytes; i++)
+        {
+            acc[i] = first ? src[i] : static_cast<uint16_t>(acc[i] + src[i]);
+        }
+    }
+}
+
+void yuyv_accumulate_average(const uint8_t *src, int stride, uint16_t *acc, int count, uint8_t *dst, int width, int height)
+{
+    // (sum + count / 2) / count as a multiply by a 16-bit reciprocal; rounding
+    // the reciprocal up keeps exact multiples of count exact, and the error
+    // stays under one for sums up to 256 * 255
+    const int row_bytes = width * 2;
+    const uint32_t reciprocal = (65536 + count - 1) / count;
+    const uint16_t half = static_cast<uint16_t>(count / 2);
+    for (int j = 0; j < height; j++, src += stride, acc += row_bytes, dst += row_bytes)
+    {
+        int i = 0;
+#ifdef SLITSCAN_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i r = _mm_set1_epi16(static_cast<short>(reciprocal));
+        const __m128i h = _mm_set1_epi16(static_cast<short>(half));
+        for (; i + 16 <= row_bytes; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_loadu_si128((const __m128i*)(acc + i)));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(v, zero), _mm_loadu_si128((const __m128i*)(acc + i + 8)));
+            lo = _mm_mulhi_epu16(_mm_add_epi16(lo, h), r);
+            hi = _mm_mulhi_epu16(_mm_add_epi16(hi, h), r);
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; i < row_bytes; i++)
+        {
+            uint32_t sum = static_cast<uint16_t>(acc[i] + src[i] + half);
+            uint32_t avg = (sum * reciprocal) >> 16;
+            dst[i] = static_cast<uint8_t>(avg > 0xff ? 0xff : avg);
+        }
+    }
+}
+
+void rgba_to_yuv444(const uint8_t *src, int stride, uint8_t *y_dst, uint8_t *u_dst, uint8_t *v_dst, int width, int height)
+{
+    // BT.601 studio swing, 8-bit fixed point; the inverse of the conversions above
+    for (int j = 0; j < height; j++, src += stride)
+    {
+        const uint8_t* px = src;
+        for (int i = 0; i < width; i++, px += 4)
+        {
+            int r = px[0], g = px[1], b = px[2];
+            *y_dst++ = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            *u_dst++ = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            *v_dst++ = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+} // namespace
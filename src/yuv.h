@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace slitscan {
+
+// Packed YUYV (YUV422, as delivered by the PS3 Eye) to RGBA, BT.601
+void yuv422_to_rgba(const uint8_t *yuv_src, const int stride, uint8_t *dst, const int width, const int height);
+
+// Planar YUV to RGBA. Chroma planes are subsampled by 1 << shift_x / 1 << shift_y
+// (1,1 for 4:2:0, 1,0 for 4:2:2, 0,0 for 4:4:4); pass NULL planes for grayscale.
+void yuv_planar_to_rgba(const uint8_t *y_src, int y_stride, const uint8_t *u_src, const uint8_t *v_src, int uv_stride,
+                        int shift_x, int shift_y, uint8_t *dst, int width, int height);
+
+// Temporal decimation: sums of YUYV frames kept in one 16-bit accumulator per
+// byte (width * 2 per row, packed). Averaging before conversion gives the same
+// result as averaging RGB (the conversion is linear) at half the bandwidth, and
+// only the average gets converted. Sums of up to 256 frames fit.
+//
+// Adds a frame to acc; first starts a new sum instead
+void yuyv_accumulate(const uint8_t *src, int stride, uint16_t *acc, int width, int height, bool first);
+// Adds the last frame of a sum of count frames (the first count - 1 already in
+// acc) and writes the rounded average to dst as YUYV (width * 2 bytes per row),
+// in the same pass. count in [2, 256]
+void yuyv_accumulate_average(const uint8_t *src, int stride, uint16_t *acc, int count, uint8_t *dst, int width, int height);
+
+// RGBA to planar YUV 4:4:4, BT.601
+void rgba_to_yuv444(const uint8_t *src, int stride, uint8_t *y_dst, uint8_t *u_dst, uint8_t *v_dst, int width, int height);
+
+} // namespace
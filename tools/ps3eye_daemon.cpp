@@ -0,0 +1,130 @@
+// Capture daemon: owns the PS3 Eye (only one process can claim its USB
+// interface) and publishes its raw YUYV frames into a shared memory ring, from
+// which any number of slit-scan processes read them in place
+// (--camera-ring in the app, ShmCameraSource in code, or shm_consumer).
+// Frames are dequeued from the driver straight into the ring slot, and readers
+// joining, leaving or lagging never affect capture.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <csignal>
+
+#include "ps3eye.h"
+#include "shm_ring.h"
+
+using namespace slitscan;
+
+// longest the main loop waits for a frame before looking at stop requests
+// and the camera's state again
+static const int FRAME_TIMEOUT_MS = 100;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: ps3eye_daemon [options]\n"
+        "options:\n"
+        "  --name NAME    shared memory ring to publish (default slitscan-camera)\n"
+        "  --size WxH     640x480 or 320x240 (default 640x480)\n"
+        "  --fps N        camera frame rate (default 60)\n"
+        "  --slots N      frames in the ring; more gives slow readers more time (default 4)\n"
+        "  --exposure N   0-255, disables auto gain\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string name = "slitscan-camera";
+    int width = 640, height = 480, fps = 60, slots = 4, exposure = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--name" && has_value) {
+            name = argv[++i];
+        } else if (arg == "--size" && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--fps" && has_value) {
+            fps = atoi(argv[++i]);
+        } else if (arg == "--slots" && has_value) {
+            slots = atoi(argv[++i]);
+        } else if (arg == "--exposure" && has_value) {
+            exposure = atoi(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    using namespace ps3eye;
+    std::vector<PS3EYECam::PS3EYERef> devices(PS3EYECam::getDevices());
+    if (devices.empty()) {
+        fprintf(stderr, "no PS3 Eye found\n");
+        return 1;
+    }
+    PS3EYECam::PS3EYERef eye = devices[0];
+    if (!eye->init(width, height, fps)) {
+        fprintf(stderr, "can't initialize the PS3 Eye\n");
+        return 1;
+    }
+    eye->start();
+    if (exposure >= 0) {
+        eye->setAutogain(false);
+        eye->setExposure(exposure);
+    } else {
+        eye->setAutogain(true);
+    }
+
+    ShmRingWriter ring;
+    if (!ring.create(name, eye->getWidth(), eye->getHeight(), eye->getRowBytes(), SHM_RING_YUYV, eye->getFrameRate(), slots)) {
+        fprintf(stderr, "can't create shared memory ring %s\n", name.c_str());
+        return 1;
+    }
+    fprintf(stderr, "publishing %ux%u at %d fps to %s\n", eye->getWidth(), eye->getHeight(), eye->getFrameRate(), name.c_str());
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    uint64_t frames = 0;
+    std::chrono::steady_clock::time_point next_report = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!stop_requested && eye->isStreaming()) {
+        // waits for the camera; readers are on older slots meanwhile. A stalled
+        // camera must not keep a signal from closing the ring below
+        if (!eye->getFrame(ring.beginFrame(), FRAME_TIMEOUT_MS)) {
+            PS3EYECam::Stats usb = eye->getStats();
+            if (usb.transfer_errors || usb.resubmit_failures) {
+                fprintf(stderr, "USB streaming stopped: %llu transfer errors, %llu resubmit failures\n",
+                        (unsigned long long)usb.transfer_errors, (unsigned long long)usb.resubmit_failures);
+                break;
+            }
+            continue;
+        }
+        // stamped with its first USB packet, so readers see the whole capture latency,
+        // and numbered like the USB thread's trace events
+        ring.commitFrame(eye->getFrameTimestamp(), eye->getFrameSequence());
+        frames++;
+
+        if (std::chrono::steady_clock::now() >= next_report) {
+            PS3EYECam::Stats usb = eye->getStats();
+            fprintf(stderr, "%llu frames, %.1f MB/s, %llu overwritten, %llu discarded (payloads: %llu bad header, %llu error, %llu no PTS, %llu wrong size)\n",
+                    (unsigned long long)frames, usb.bytes_per_second / 1e6, (unsigned long long)usb.frames_overwritten,
+                    (unsigned long long)usb.frames_discarded, (unsigned long long)usb.payloads_bad_header,
+                    (unsigned long long)usb.payloads_stream_error, (unsigned long long)usb.payloads_missing_pts,
+                    (unsigned long long)usb.payloads_size_mismatch);
+            next_report += std::chrono::seconds(5);
+        }
+    }
+
+    // readers see the ring closed and wait for the next daemon
+    ring.close();
+    eye->stop();
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Test consumer for the shared-memory frame rings published by the app
+// (--publish) and by ps3eye_daemon: attaches, reads frames in place and reports
+// rate, skipped and torn frames once a second. --delay simulates a slow
+// consumer, to check that it only ever hurts itself.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "shm_ring.h"
+#include "y4m.h"
+
+using namespace slitscan;
+
+typedef std::chrono::steady_clock Clock;
+
+static double now_seconds()
+{
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: shm_consumer [options] [name]\n"
+        "  name           shared memory ring (default slitscan-output)\n"
+        "options:\n"
+        "  --seconds N    run for N seconds (default: until the producer goes away)\n"
+        "  --delay MS     pretend each frame takes this long to process\n"
+        "  --all          read every frame still in the ring instead of only the newest\n"
+        "  --record FILE  write the frames read to a .y4m (4:4:4) file\n");
+}
+
+int main(int argc, char** argv)
+{
+    std::string name = "slitscan-output";
+    std::string record_path;
+    double seconds = 0;
+    int delay_ms = 0;
+    bool all = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--seconds" && has_value) {
+            seconds = atof(argv[++i]);
+        } else if (arg == "--delay" && has_value) {
+            delay_ms = atoi(argv[++i]);
+        } else if (arg == "--all") {
+            all = true;
+        } else if (arg == "--record" && has_value) {
+            record_path = argv[++i];
+        } else if (arg[0] != '-') {
+            name = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    ShmRingReader ring;
+    if (!ring.open(name)) {
+        fprintf(stderr, "can't attach to ring %s\n", name.c_str());
+        return 1;
+    }
+    const ShmRingHeader& header = ring.getHeader();
+    bool yuyv = header.pixel_format == SHM_RING_YUYV;
+    fprintf(stderr, "attached to %s: %ux%u %s, %u slots, %.2f fps\n", name.c_str(), header.width, header.height,
+            yuyv ? "YUYV" : "RGBA", header.slot_count, header.fps_milli / 1000.0);
+
+    bool recording = !record_path.empty();
+    Y4MWriter writer;
+    VideoFormat yuyv_format;
+    std::vector<uint8_t> rgba;
+    if (recording) {
+        if (!writer.open(record_path, header.width, header.height, header.fps_milli ? header.fps_milli : 30000, 1000)) {
+            fprintf(stderr, "can't write %s\n", record_path.c_str());
+            return 1;
+        }
+        yuyv_format.width = header.width;
+        yuyv_format.height = header.height;
+        yuyv_format.pixel_format = VideoFormat::YUYV;
+        rgba.resize((size_t)header.width * header.height * 4);
+    }
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point next_report = start + std::chrono::seconds(1);
+    uint64_t last_read = 0;
+    double latency_sum = 0;
+    uint64_t latency_count = 0;
+    while (seconds <= 0 || std::chrono::duration<double>(Clock::now() - start).count() < seconds) {
+        ShmFrameInfo info;
+        const uint8_t* frame = ring.acquireFrame(&info, 100, !all);
+        if (frame) {
+            if (recording) {
+                if (yuyv) {
+                    yuyv_format.toRGBA(frame, &rgba[0]);
+                } else {
+                    for (uint32_t y = 0; y < header.height; y++) {
+                        memcpy(&rgba[(size_t)y * header.width * 4], frame + (size_t)y * header.stride, header.width * 4);
+                    }
+                }
+            }
+            if (delay_ms > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+            }
+            if (ring.releaseFrame()) {
+                if (recording) {
+                    writer.writeFrame(&rgba[0], header.width * 4);
+                }
+                if (info.timestamp > 0) {
+                    latency_sum += now_seconds() - info.timestamp;
+                    latency_count++;
+                }
+            }
+        } else if (ring.isClosed()) {
+            fprintf(stderr, "producer went away\n");
+            break;
+        }
+
+        if (Clock::now() >= next_report) {
+            const ShmRingReader::Stats& stats = ring.getStats();
+            fprintf(stderr, "%llu fps, %llu read, %llu skipped, %llu torn, %.2f ms since capture\n",
+                    (unsigned long long)(stats.frames_read - last_read), (unsigned long long)stats.frames_read,
+                    (unsigned long long)stats.frames_skipped, (unsigned long long)stats.frames_torn,
+                    latency_count ? latency_sum / latency_count * 1000 : 0.0);
+            last_read = stats.frames_read;
+            latency_sum = 0;
+            latency_count = 0;
+            next_report += std::chrono::seconds(1);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,630 @@
+// Micro-benchmarks for the capture and render hot paths, on synthetic data:
+// UVC payload parsing, the driver's frame queue under contention, YUYV to
+// RGBA conversion, time map evaluation, history sampling and compression.
+// Each benchmark is repeated and the median reported; --json saves the
+// results and --baseline compares the fastest samples against a saved run,
+// failing on regressions.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <functional>
+
+#include "frame_assembler.h"
+#include "uvc_generator.h"
+#include "yuv.h"
+#include "frame_decimator.h"
+#include "change_detector.h"
+#include "time_map.h"
+#include "frame_history.h"
+#include "temporal_pyramid.h"
+#include "tiered_history.h"
+#include "tile_codec.h"
+#include "cpu_renderer.h"
+
+using namespace slitscan;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result
+{
+    std::string name;
+    double ns_per_op;       // median over the samples
+    double min_ns_per_op;
+    double mb_per_s;        // 0 when the benchmark doesn't process a byte stream
+    uint64_t ops;           // per sample
+};
+
+struct Options
+{
+    double sample_seconds = 0.25;
+    int samples = 5;
+    std::string filter;
+};
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Runs body(n) with n grown until one call takes sample_seconds, then takes
+// samples at that n. body performs n operations of bytes_per_op bytes each.
+static Result run(const Options& options, const std::string& name, double bytes_per_op,
+                  const std::function<void(uint64_t)>& body)
+{
+    uint64_t n = 1;
+    for (;;) {
+        Clock::time_point start = Clock::now();
+        body(n);
+        double elapsed = seconds_since(start);
+        if (elapsed >= options.sample_seconds / 4 || n >= (1ull << 40)) {
+            n = (std::max)((uint64_t)1, (uint64_t)(n * options.sample_seconds / (std::max)(elapsed, 1e-9)));
+            break;
+        }
+        n *= elapsed < options.sample_seconds / 100 ? 10 : 2;
+    }
+
+    std::vector<double> ns;
+    for (int i = 0; i < options.samples; i++) {
+        Clock::time_point start = Clock::now();
+        body(n);
+        ns.push_back(seconds_since(start) * 1e9 / n);
+    }
+    std::sort(ns.begin(), ns.end());
+
+    Result result;
+    result.name = name;
+    result.ns_per_op = ns[ns.size() / 2];
+    result.min_ns_per_op = ns[0];
+    result.mb_per_s = bytes_per_op ? bytes_per_op / result.ns_per_op * 1e3 : 0;
+    result.ops = n;
+    fprintf(stderr, "%-28s %14.1f ns/op %10.1f MB/s\n", name.c_str(), result.ns_per_op, result.mb_per_s);
+    return result;
+}
+
+static bool selected(const Options& options, const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+static void bench_pkt_scan(const Options& options, std::vector<Result>& results, const char* name, int w, int h)
+{
+    if (!selected(options, name)) {
+        return;
+    }
+    uint32_t frame_size = w * h * 2;
+    // a few distinct frames so consecutive frames differ in FID and PTS
+    const int NUM_FRAMES = 8;
+    UvcGenerator generator(frame_size);
+    UvcTransfers frames[NUM_FRAMES];
+    for (int i = 0; i < NUM_FRAMES; i++) {
+        generator.appendFrame(frames[i]);
+    }
+
+    ps3eye::FrameQueue queue(frame_size);
+    ps3eye::FrameAssembler assembler;
+    assembler.start(&queue, frame_size);
+    uint64_t scanned = 0;
+    results.push_back(run(options, name, (double)frames[0].data.size(), [&] (uint64_t n) {
+        // nobody dequeues: once the queue is full the driver keeps overwriting the newest frame
+        for (uint64_t i = 0; i < n; i++) {
+            const UvcTransfers& frame = frames[scanned++ % NUM_FRAMES];
+            const uint8_t* data = frame.data.data();
+            for (size_t t = 0; t < frame.lengths.size(); t++) {
+                assembler.pkt_scan(data, frame.lengths[t]);
+                data += frame.lengths[t];
+            }
+        }
+    }));
+    if (assembler.get_stats().frames_completed != scanned) {
+        // the benchmark would be timing the discard path
+        fprintf(stderr, "%s: assembled %llu of %llu frames\n", name,
+                (unsigned long long)assembler.get_stats().frames_completed, (unsigned long long)scanned);
+        exit(1);
+    }
+}
+
+static void bench_frame_queue(const Options& options, std::vector<Result>& results)
+{
+    const char* name = "frame_queue_contended";
+    if (!selected(options, name)) {
+        return;
+    }
+    // the producer side is the USB thread, which enqueues as fast as it can
+    // here, so the consumer always contends with it for the lock
+    uint32_t frame_size = 640 * 480 * 2;
+    ps3eye::FrameQueue queue(frame_size);
+    std::vector<uint8_t> frame(frame_size);
+    results.push_back(run(options, name, frame_size, [&] (uint64_t n) {
+        std::atomic<bool> done(false);
+        std::thread producer([&] () {
+            while (!done.load(std::memory_order_relaxed)) {
+                queue.Enqueue(0, 0);
+            }
+        });
+        for (uint64_t i = 0; i < n; i++) {
+            queue.Dequeue(frame.data());
+        }
+        done = true;
+        producer.join();
+    }));
+}
+
+static void bench_yuv(const Options& options, std::vector<Result>& results, const char* name, int w, int h)
+{
+    if (!selected(options, name)) {
+        return;
+    }
+    std::vector<uint8_t> yuyv(w * h * 2), rgba(w * h * 4);
+    for (size_t i = 0; i < yuyv.size(); i++) {
+        yuyv[i] = (uint8_t)(i * 7);
+    }
+    results.push_back(run(options, name, yuyv.size(), [&] (uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            yuv422_to_rgba(yuyv.data(), w * 2, rgba.data(), w, h);
+        }
+    }));
+}
+
+// one op is one camera frame, so this compares directly with yuv422_to_rgba
+static void bench_decimate(const Options& options, std::vector<Result>& results, const char* name, int w, int h, int factor)
+{
+    if (!selected(options, name)) {
+        return;
+    }
+    std::vector<uint8_t> yuyv(w * h * 2), rgba(w * h * 4);
+    for (size_t i = 0; i < yuyv.size(); i++) {
+        yuyv[i] = (uint8_t)(i * 7);
+    }
+    FrameDecimator decimator(w, h, factor);
+    results.push_back(run(options, name, yuyv.size(), [&] (uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            const uint8_t* average = decimator.addFrame(yuyv.data(), w * 2);
+            if (average) {
+                yuv422_to_rgba(average, decimator.getRowBytes(), rgba.data(), w, h);
+            }
+        }
+    }));
+}
+
+// the change gate's worst case: noise just under the threshold everywhere,
+// so every tile is compared in full and nothing is converted
+static void bench_change_detect(const Options& options, std::vector<Result>& results, const char* name, int w, int h)
+{
+    if (!selected(options, name)) {
+        return;
+    }
+    std::vector<uint8_t> frames[2] = { std::vector<uint8_t>(w * h * 2), std::vector<uint8_t>(w * h * 2) };
+    for (size_t i = 0; i < frames[0].size(); i++) {
+        frames[0][i] = (uint8_t)(i * 7);
+        frames[1][i] = (uint8_t)(i * 7 + (i & 1));
+    }
+    ChangeDetector detector(w, h, 2);
+    detector.update(frames[0].data(), w * 2);
+    results.push_back(run(options, name, frames[0].size(), [&] (uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            detector.update(frames[i & 1].data(), w * 2);
+        }
+    }));
+}
+
+static void bench_time_map(const Options& options, std::vector<Result>& results, const std::string& spec)
+{
+    std::string name = "time_map_" + spec;
+    if (!selected(options, name)) {
+        return;
+    }
+    std::unique_ptr<TimeMap> map(TimeMap::create(spec));
+    const int w = 640, h = 480;
+    std::vector<float> table(w * h);
+    // the same per-pixel evaluation TimeMapCache::getTable() does on a miss
+    results.push_back(run(options, name, 0, [&] (uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            float* out = table.data();
+            for (int row = 0; row < h; row++) {
+                float y = (row + 0.5f) / h;
+                for (int col = 0; col < w; col++) {
+                    *out++ = map->evaluate((col + 0.5f) / w, y);
+                }
+            }
+        }
+    }));
+}
+
+static void bench_history(const Options& options, std::vector<Result>& results, std::unique_ptr<FrameHistory>& history,
+                          const char* name, CpuRenderer::Filter filter)
+{
+    if (!selected(options, name)) {
+        return;
+    }
+    const int w = 640, h = 480;
+    if (!history) {
+        // a full 256 frame history, like the app's
+        history.reset(new FrameHistory(w, h, 256));
+        std::vector<uint8_t> rgba(w * h * 4);
+        for (int f = 0; f < history->getFrames(); f++) {
+            for (size_t i = 0; i < rgba.size(); i++) {
+                rgba[i] = (uint8_t)(i + f * 5);
+            }
+            history->pushRGBA(rgba.data(), w * 4);
+        }
+    }
+    std::unique_ptr<TimeMap> map(TimeMap::create("spiral"));
+    TimeMapCache cache;
+    const float* table = cache.getTable(*map, w, h);
+    // one thread: this measures the sampling loop, not the thread pool
+    CpuRenderer renderer(1, filter);
+    std::vector<uint8_t> out(w * h * 4);
+    results.push_back(run(options, name, out.size(), [&] (uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            renderer.render(*history, table, history->getNewestOffset(), out.data(), w, h, w * 4);
+        }
+    }));
+}
+
+// a 64 frame history with 4 coarse levels, spanning 1024 frames: the cost of
+// keeping the levels up to date per pushed frame, and of sampling through them
+static void bench_pyramid(const Options& options, std::vector<Result>& results)
+{
+    if (!selected(options, "pyramid_update_vga") && !selected(options, "history_sample_pyramid")) {
+        return;
+    }
+    const int w = 640, h = 480, frames = 64;
+    FrameHistory history(w, h, frames);
+    TemporalPyramid pyramid(w, h, frames, 4);
+    std::vector<uint8_t> rgba(w * h * 4);
+    for (size_t i = 0; i < rgba.size(); i++) {
+        rgba[i] = (uint8_t)(i * 7);
+    }
+    for (int f = 0; f < pyramid.getLayout().getSpan(); f++) {
+        history.pushRGBA(rgba.data(), w * 4);
+        pyramid.update(history);
+    }
+    if (selected(options, "pyramid_update_vga")) {
+        // the push is left out, only the averaging is measured
+        results.push_back(run(options, "pyramid_update_vga", history.getLayerSize(), [&] (uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                history.setLayerIndex((history.getLayerIndex() + 1) % frames);
+                pyramid.update(history);
+            }
+        }));
+    }
+    if (selected(options, "history_sample_pyramid")) {
+        std::unique_ptr<TimeMap> map(TimeMap::create("spiral"));
+        TimeMapCache cache;
+        const float* table = cache.getTable(*map, w, h);
+        CpuRenderer renderer(1, CpuRenderer::FILTER_TRILINEAR);
+        std::vector<uint8_t> out(w * h * 4);
+        results.push_back(run(options, "history_sample_pyramid", out.size(), [&] (uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                renderer.renderPyramid(history, pyramid, table, history.getNewestOffset(), out.data(), w, h, w * 4);
+            }
+        }));
+    }
+}
+
+// camera-like layers for the codec: a gradient with a little sensor noise,
+// drifting a texel per frame
+static void fill_noisy_layer(std::vector<uint8_t>& rgb, int w, int h, int frame, uint32_t& seed)
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            for (int c = 0; c < 3; c++) {
+                seed = seed * 1103515245u + 12345u;
+                int noise = (int)((seed >> 16) % 5) - 2;
+                int value = ((x + frame) * (c + 1) / 3 + y / 2) % 200 + 20 + noise;
+                rgb[((size_t)y * w + x) * 3 + c] = (uint8_t)value;
+            }
+        }
+    }
+}
+
+// cold history: compressing and decompressing a VGA layer in TieredHistory's
+// tiles, and sampling a history that is cold but for its newest layers
+static void bench_tiered(const Options& options, std::vector<Result>& results)
+{
+    const int w = 640, h = 480, tile = TieredHistory::TILE_SIZE;
+    uint32_t seed = 1;
+    std::vector<uint8_t> layers[2] = { std::vector<uint8_t>(w * h * 3), std::vector<uint8_t>(w * h * 3) };
+    fill_noisy_layer(layers[0], w, h, 0, seed);
+    fill_noisy_layer(layers[1], w, h, 1, seed);
+    std::vector<uint8_t> encoded;
+    std::vector<size_t> offsets;
+    for (int y = 0; y < h; y += tile) {
+        for (int x = 0; x < w; x += tile) {
+            offsets.push_back(encoded.size());
+            tile_encode(&layers[0][(y * w + x) * 3], &layers[1][(y * w + x) * 3], w * 3, tile, tile, encoded);
+        }
+    }
+    offsets.push_back(encoded.size());
+
+    if (selected(options, "tile_encode_vga")) {
+        fprintf(stderr, "tile_encode_vga: %.2fx smaller\n", layers[0].size() / (double)encoded.size());
+        std::vector<uint8_t> out;
+        results.push_back(run(options, "tile_encode_vga", layers[0].size(), [&] (uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                out.clear();
+                for (int y = 0; y < h; y += tile) {
+                    for (int x = 0; x < w; x += tile) {
+                        tile_encode(&layers[0][(y * w + x) * 3], &layers[1][(y * w + x) * 3], w * 3, tile, tile, out);
+                    }
+                }
+            }
+        }));
+    }
+    if (selected(options, "tile_decode_vga")) {
+        std::vector<uint8_t> out(layers[0].size());
+        results.push_back(run(options, "tile_decode_vga", out.size(), [&] (uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                size_t t = 0;
+                for (int y = 0; y < h; y += tile) {
+                    for (int x = 0; x < w; x += tile, t++) {
+                        size_t at = (y * w + x) * 3;
+                        tile_decode(&encoded[offsets[t]], offsets[t + 1] - offsets[t], &layers[1][at], w * 3,
+                                    &out[at], w * 3, tile, tile);
+                    }
+                }
+            }
+        }));
+    }
+    if (selected(options, "history_sample_tiered")) {
+        // 256 frames like bench_history's, all but the newest 16 compressed
+        TieredHistory history(w, h, 256, 16);
+        for (int f = 0; f < history.getFrames(); f++) {
+            fill_noisy_layer(layers[0], w, h, f, seed);
+            history.pushRGB(layers[0].data(), w * 3);
+        }
+        history.flush();
+        std::unique_ptr<TimeMap> map(TimeMap::create("spiral"));
+        TimeMapCache cache;
+        const float* table = cache.getTable(*map, w, h);
+        CpuRenderer renderer(1, CpuRenderer::FILTER_TRILINEAR);
+        std::vector<uint8_t> out(w * h * 4);
+        results.push_back(run(options, "history_sample_tiered", out.size(), [&] (uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                renderer.renderTiered(history, table, history.getNewestOffset(), out.data(), w, h, w * 4);
+            }
+        }));
+        TieredHistory::Stats stats = history.getStats();
+        fprintf(stderr, "history_sample_tiered: %d cold layers, %.1f MB -> %.1f MB, %.1f%% cache hits\n",
+                stats.cold_layers, stats.cold_layers * (double)w * h * 3 / 1e6, stats.cold_bytes / 1e6,
+                100.0 * stats.cache_hits / (stats.cache_hits + stats.cache_misses));
+    }
+}
+
+static bool write_json(const std::string& path, const std::vector<Result>& results)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"mb_per_s\": %.3f, \"ops\": %llu}%s\n",
+                r.name.c_str(), r.ns_per_op, r.min_ns_per_op, r.mb_per_s, (unsigned long long)r.ops,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// Value of "key" in a flat JSON object's text: the string without its quotes,
+// or the number as written. Enough for the files write_json() writes, however
+// they have been reformatted since.
+static bool json_field(const std::string& object, const char* key, std::string& value)
+{
+    size_t at = object.find("\"" + std::string(key) + "\"");
+    if (at == std::string::npos) {
+        return false;
+    }
+    at = object.find_first_not_of(" \t\r\n", at + strlen(key) + 2);
+    if (at == std::string::npos || object[at] != ':') {
+        return false;
+    }
+    at = object.find_first_not_of(" \t\r\n", at + 1);
+    if (at == std::string::npos) {
+        return false;
+    }
+    size_t end;
+    if (object[at] == '"') {
+        at++;
+        end = object.find('"', at);
+    } else {
+        end = object.find_first_of(",} \t\r\n", at);
+    }
+    if (end == std::string::npos || end == at) {
+        return false;
+    }
+    value = object.substr(at, end - at);
+    return true;
+}
+
+// Reads the benchmarks of a file written by --json: every innermost object
+// with a name, ns_per_op and min_ns_per_op. False, with a message, if the file
+// can't be read or an entry lacks one of them.
+static bool read_baseline(const std::string& path, std::vector<Result>& baseline)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        fprintf(stderr, "can't read %s\n", path.c_str());
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(file);
+
+    size_t end = 0;
+    for (;;) {
+        size_t begin = text.find('{', end);
+        if (begin == std::string::npos) {
+            break;
+        }
+        end = text.find_first_of("{}", begin + 1);
+        if (end == std::string::npos) {
+            break;
+        }
+        if (text[end] == '{') {
+            end = begin + 1;    // not innermost: look inside
+            continue;
+        }
+        std::string object = text.substr(begin, end - begin + 1);
+        std::string name, ns, min_ns;
+        if (!json_field(object, "name", name)) {
+            continue;           // not a benchmark
+        }
+        if (!json_field(object, "ns_per_op", ns) || !json_field(object, "min_ns_per_op", min_ns)) {
+            fprintf(stderr, "%s: %s has no ns_per_op or min_ns_per_op\n", path.c_str(), name.c_str());
+            return false;
+        }
+        Result r = Result();
+        r.name = name;
+        r.ns_per_op = atof(ns.c_str());
+        r.min_ns_per_op = atof(min_ns.c_str());
+        baseline.push_back(r);
+    }
+    return true;
+}
+
+// Prints the change against baseline; returns the number of regressions,
+// counting benchmarks the baseline doesn't have. Compares the fastest samples:
+// noise only ever makes a run slower, so the minimum moves far less than the median.
+static int compare(const std::vector<Result>& results, const std::vector<Result>& baseline, double threshold)
+{
+    int regressions = 0;
+    fprintf(stderr, "\n%-28s %14s %14s %9s\n", "benchmark", "baseline min", "current min", "change");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        const Result* base = NULL;
+        for (size_t j = 0; j < baseline.size(); j++) {
+            if (baseline[j].name == r.name) {
+                base = &baseline[j];
+            }
+        }
+        if (!base) {
+            fprintf(stderr, "%-28s %14s %14.1f %9s\n", r.name.c_str(), "-", r.min_ns_per_op, "  missing");
+            regressions++;
+            continue;
+        }
+        double change = (r.min_ns_per_op / base->min_ns_per_op - 1) * 100;
+        const char* verdict = "";
+        if (change > threshold) {
+            verdict = "  slower";
+            regressions++;
+        } else if (change < -threshold) {
+            verdict = "  faster";
+        }
+        fprintf(stderr, "%-28s %14.1f %14.1f %+8.1f%%%s\n", r.name.c_str(), base->min_ns_per_op, r.min_ns_per_op,
+                change, verdict);
+    }
+    return regressions;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: slitscan_bench [options]\n"
+        "options:\n"
+        "  --json FILE       write the results as JSON\n"
+        "  --baseline FILE   compare the fastest samples with a run saved by --json; exits 1\n"
+        "                    on a regression or a benchmark the baseline doesn't have\n"
+        "  --threshold PCT   change that counts as faster/slower (default 25)\n"
+        "  --filter TEXT     only run benchmarks whose name contains TEXT\n"
+        "  --time S          seconds per sample (default 0.25)\n"
+        "  --samples N       samples per benchmark, the median is reported (default 5)\n"
+        "  --list            list the benchmarks\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::string json_path, baseline_path;
+    double threshold = 25;
+    bool list = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) {
+            json_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--threshold" && has_value) {
+            threshold = atof(argv[++i]);
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--time" && has_value) {
+            options.sample_seconds = atof(argv[++i]);
+        } else if (arg == "--samples" && has_value) {
+            options.samples = (std::max)(1, atoi(argv[++i]));
+        } else if (arg == "--list") {
+            list = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    static const char* names[] = {
+        "pkt_scan_vga", "pkt_scan_qvga", "frame_queue_contended", "yuv422_to_rgba_vga", "yuv422_to_rgba_qvga",
+        "decimate_4_vga", "decimate_16_vga", "change_detect_vga",
+        "time_map_linear", "time_map_radial", "time_map_spiral", "history_sample_nearest", "history_sample_trilinear",
+        "pyramid_update_vga", "history_sample_pyramid", "tile_encode_vga", "tile_decode_vga", "history_sample_tiered"
+    };
+    if (list) {
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            printf("%s\n", names[i]);
+        }
+        return 0;
+    }
+
+    std::vector<Result> baseline;
+    if (!baseline_path.empty()) {
+        if (!read_baseline(baseline_path, baseline)) {
+            return 1;
+        }
+        // an empty comparison would pass any run
+        if (baseline.empty()) {
+            fprintf(stderr, "no benchmarks in %s\n", baseline_path.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    bench_pkt_scan(options, results, "pkt_scan_vga", 640, 480);
+    bench_pkt_scan(options, results, "pkt_scan_qvga", 320, 240);
+    bench_frame_queue(options, results);
+    bench_yuv(options, results, "yuv422_to_rgba_vga", 640, 480);
+    bench_yuv(options, results, "yuv422_to_rgba_qvga", 320, 240);
+    bench_decimate(options, results, "decimate_4_vga", 640, 480, 4);
+    bench_decimate(options, results, "decimate_16_vga", 640, 480, 16);
+    bench_change_detect(options, results, "change_detect_vga", 640, 480);
+    bench_time_map(options, results, "linear");
+    bench_time_map(options, results, "radial");
+    bench_time_map(options, results, "spiral");
+    std::unique_ptr<FrameHistory> history;     // shared by both filters
+    bench_history(options, results, history, "history_sample_nearest", CpuRenderer::FILTER_NEAREST);
+    bench_history(options, results, history, "history_sample_trilinear", CpuRenderer::FILTER_TRILINEAR);
+    history.reset();
+    bench_pyramid(options, results);
+    bench_tiered(options, results);
+
+    if (!json_path.empty() && !write_json(json_path, results)) {
+        fprintf(stderr, "can't write %s\n", json_path.c_str());
+        return 1;
+    }
+    if (!baseline.empty() && compare(results, baseline, threshold) > 0) {
+        return 1;
+    }
+    return 0;
+}
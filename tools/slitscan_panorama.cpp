@@ -0,0 +1,175 @@
+// Photo-finish panoramas: appends one column of every frame of a video to an
+// endless panorama, written as tiles plus a zoom pyramid by PanoramaWriter
+// (like the app's --panorama), or stitches one pyramid level of such a
+// panorama back into a single image for previewing.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "panorama_writer.h"
+#include "y4m.h"
+
+using namespace slitscan;
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: slitscan_panorama [options] <input> <directory>\n"
+        "       slitscan_panorama --preview LEVEL <directory> <output.ppm>\n"
+        "  input          .y4m or .slitraw file, or headerless YUYV with --raw; '-' reads stdin\n"
+        "  directory      where the tiles go, created if needed\n"
+        "options:\n"
+        "  --raw WxH      input is raw YUYV of this size\n"
+        "  --fps N        frame rate of raw input (default 30)\n"
+        "  --column N     frame column to take (default: the centre)\n"
+        "  --tile N       tile width in columns (default 256)\n"
+        "  --preview L    stitch pyramid level L (0 is full size) into one PPM\n");
+}
+
+static bool parse_size(const char* arg, int& w, int& h)
+{
+    return sscanf(arg, "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+}
+
+// Reads the tile_width x height RGB pixels of a tile written by PanoramaWriter
+static bool read_tile(const std::string& path, int width, int height, uint8_t* pixels)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    int w = 0, h = 0, max = 0;
+    bool ok = fscanf(file, "P6 %d %d %d", &w, &h, &max) == 3 && fgetc(file) != EOF &&
+              w == width && h == height && max == 255 &&
+              fread(pixels, 1, (size_t)w * h * 3, file) == (size_t)w * h * 3;
+    fclose(file);
+    return ok;
+}
+
+static int preview(int level, const std::string& directory, const std::string& out_path)
+{
+    unsigned long long columns = 0;
+    int height = 0, tile_width = 0, levels = 0;
+    FILE* index = fopen(PanoramaWriter::getIndexPath(directory).c_str(), "r");
+    if (!index || fscanf(index, "columns %llu height %d tile_width %d levels %d",
+                         &columns, &height, &tile_width, &levels) != 4) {
+        fprintf(stderr, "no panorama in %s\n", directory.c_str());
+        if (index) {
+            fclose(index);
+        }
+        return 1;
+    }
+    fclose(index);
+    if (level < 0 || level >= levels) {
+        fprintf(stderr, "the panorama has levels 0 to %d\n", levels - 1);
+        return 1;
+    }
+
+    // level L halves both dimensions L times; missing tiles stay black
+    int tile_height = height >> level;
+    uint64_t width = (columns + (1ull << level) - 1) >> level;
+    uint64_t tiles = (width + tile_width - 1) / tile_width;
+    if (width == 0 || width * tile_height * 3 > (1ull << 31)) {
+        fprintf(stderr, "level %d is %llu x %d, pick a higher level\n", level, (unsigned long long)width, tile_height);
+        return 1;
+    }
+    std::vector<uint8_t> image((size_t)width * tile_height * 3);
+    std::vector<uint8_t> tile((size_t)tile_width * tile_height * 3);
+    int missing = 0;
+    for (uint64_t t = 0; t < tiles; t++) {
+        if (!read_tile(PanoramaWriter::getTilePath(directory, level, t), tile_width, tile_height, tile.data())) {
+            missing++;
+            continue;
+        }
+        size_t x = (size_t)t * tile_width;
+        size_t span = (size_t)(std::min)((uint64_t)tile_width, width - x) * 3;
+        for (int y = 0; y < tile_height; y++) {
+            memcpy(&image[((size_t)y * width + x) * 3], &tile[(size_t)y * tile_width * 3], span);
+        }
+    }
+
+    FILE* out = fopen(out_path.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "can't write %s\n", out_path.c_str());
+        return 1;
+    }
+    fprintf(out, "P6\n%llu %d\n255\n", (unsigned long long)width, tile_height);
+    fwrite(image.data(), 1, image.size(), out);
+    fclose(out);
+    fprintf(stderr, "level %d: %llu x %d from %llu tiles (%d missing)\n", level,
+            (unsigned long long)width, tile_height, (unsigned long long)tiles, missing);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int raw_w = 0, raw_h = 0, raw_fps = 30;
+    int column = -1, tile_width = PanoramaWriter::DEFAULT_TILE_WIDTH, preview_level = -1;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--raw" && has_value && parse_size(argv[i + 1], raw_w, raw_h)) {
+            i++;
+        } else if (arg == "--fps" && has_value) {
+            raw_fps = atoi(argv[++i]);
+        } else if (arg == "--column" && has_value) {
+            column = atoi(argv[++i]);
+        } else if (arg == "--tile" && has_value) {
+            tile_width = atoi(argv[++i]);
+        } else if (arg == "--preview" && has_value) {
+            preview_level = atoi(argv[++i]);
+        } else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            usage();
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2 || tile_width < 2 || raw_fps <= 0) {
+        usage();
+        return 1;
+    }
+    if (preview_level >= 0) {
+        return preview(preview_level, paths[0], paths[1]);
+    }
+
+    Y4MReader reader;
+    bool opened = raw_w ? reader.openRaw(paths[0], raw_w, raw_h, raw_fps) : reader.open(paths[0]);
+    if (!opened) {
+        fprintf(stderr, "can't read %s\n", paths[0].c_str());
+        return 1;
+    }
+    const VideoFormat& format = reader.getFormat();
+    if (column < 0 || column >= format.width) {
+        column = format.width / 2;
+    }
+
+    mkdir(paths[1].c_str(), 0755);
+    PanoramaWriter writer;
+    if (!writer.open(paths[1], format.height, tile_width)) {
+        fprintf(stderr, "can't write to %s\n", paths[1].c_str());
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> raw, rgba((size_t)format.width * format.height * 4);
+    while (reader.readFrame(raw)) {
+        format.toRGBA(&raw[0], &rgba[0]);
+        writer.appendColumnRGBA(&rgba[0], format.width * 4, column);
+    }
+    writer.close();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PanoramaWriter::Stats stats = writer.getStats();
+    fprintf(stderr, "%llu columns in %.2f s: %llu tiles in %d levels, %.1f MB, %llu tiles dropped, writer busy %.2f s\n",
+            (unsigned long long)stats.columns, elapsed, (unsigned long long)stats.tiles_written, writer.getLevels(),
+            stats.bytes_written / 1e6, (unsigned long long)stats.tiles_dropped, stats.write_seconds);
+    return 0;
+}
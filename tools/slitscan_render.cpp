@@ -0,0 +1,304 @@
+// Offline slit-scan renderer: reads a Y4M, raw YUYV or raw stream video, pushes
+// every frame through the same history and time-map code as the live app, and writes the
+// slit-scan frames as fast as the CPU allows. Decoding, rendering and encoding
+// run on separate threads connected by small bounded queues.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+#include "frame_history.h"
+#include "strip_history.h"
+#include "cpu_renderer.h"
+#include "time_map.h"
+#include "y4m.h"
+#include "yuv.h"
+#include "frame_decimator.h"
+#include "temporal_pyramid.h"
+#include "tiered_history.h"
+#include "bounded_queue.h"
+
+using namespace slitscan;
+
+typedef std::vector<uint8_t> Buffer;
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: slitscan_render [options] <input> <output>\n"
+        "  input          .y4m or .slitraw file, or headerless YUYV with --raw; '-' reads stdin\n"
+        "  output         .y4m (4:4:4) or .rgb (raw RGB24); '-' writes Y4M to stdout\n"
+        "options:\n"
+        "  --raw WxH      input is raw YUYV of this size\n"
+        "  --fps N        frame rate of raw input (default 30)\n"
+        "  --size WxH     output size (default: input size)\n"
+        "  --map SPEC     radial | linear[:angle] | spiral[:turns] | image:file.pgm (default radial)\n"
+        "  --frames N     history length in frames (default 256)\n"
+        "  --decimate N   average every N input frames into one history frame (default 1)\n"
+        "  --pyramid N    add N coarser history levels, each averaging pairs of the one below:\n"
+        "                 the map then spans 2^N times the history, blurrier further back\n"
+        "  --cold-after N keep only the newest N history frames as they are and compress older\n"
+        "                 ones losslessly, decoding them again as the map needs them\n"
+        "  --slit S[:N]   keep only row or column N (default: the centre) of each frame: the\n"
+        "                 classic slit-scan, with history for thousands of frames in a few MB\n"
+        "  --filter F     nearest | trilinear (default trilinear)\n"
+        "  --threads N    render threads (default: all cores)\n"
+        "  --skip N       don't write the first N frames, e.g. while the history fills up\n"
+        "  --queue N      frames buffered between stages (default 4)\n");
+}
+
+static bool parse_size(const char* arg, int& w, int& h)
+{
+    return sscanf(arg, "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+}
+
+int main(int argc, char** argv)
+{
+    int raw_w = 0, raw_h = 0, raw_fps = 30;
+    int out_w = 0, out_h = 0;
+    int frames = 256, threads = 0, skip = 0, queue_size = 4, decimation = 1, pyramid_levels = 0, cold_after = 0;
+    std::string map_spec = "radial";
+    std::string slit_spec;
+    CpuRenderer::Filter filter = CpuRenderer::FILTER_TRILINEAR;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--raw" && has_value && parse_size(argv[i + 1], raw_w, raw_h)) {
+            i++;
+        } else if (arg == "--fps" && has_value) {
+            raw_fps = atoi(argv[++i]);
+        } else if (arg == "--size" && has_value && parse_size(argv[i + 1], out_w, out_h)) {
+            i++;
+        } else if (arg == "--map" && has_value) {
+            map_spec = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            frames = atoi(argv[++i]);
+        } else if (arg == "--decimate" && has_value) {
+            decimation = atoi(argv[++i]);
+        } else if (arg == "--pyramid" && has_value) {
+            pyramid_levels = atoi(argv[++i]);
+        } else if (arg == "--cold-after" && has_value) {
+            cold_after = atoi(argv[++i]);
+        } else if (arg == "--slit" && has_value) {
+            slit_spec = argv[++i];
+        } else if (arg == "--filter" && has_value) {
+            filter = strcmp(argv[++i], "nearest") == 0 ? CpuRenderer::FILTER_NEAREST : CpuRenderer::FILTER_TRILINEAR;
+        } else if (arg == "--threads" && has_value) {
+            threads = atoi(argv[++i]);
+        } else if (arg == "--skip" && has_value) {
+            skip = atoi(argv[++i]);
+        } else if (arg == "--queue" && has_value) {
+            queue_size = atoi(argv[++i]);
+        } else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            usage();
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2 || frames < 2 || queue_size < 1 || raw_fps <= 0 ||
+        decimation < 1 || decimation > FrameDecimator::MAX_FACTOR ||
+        pyramid_levels < 0 || pyramid_levels > PyramidLayout::MAX_LEVELS || cold_after < 0 ||
+        (cold_after && (pyramid_levels || !slit_spec.empty()))) {
+        usage();
+        return 1;
+    }
+
+    Y4MReader reader;
+    bool opened = raw_w ? reader.openRaw(paths[0], raw_w, raw_h, raw_fps) : reader.open(paths[0]);
+    if (!opened) {
+        fprintf(stderr, "can't read %s\n", paths[0].c_str());
+        return 1;
+    }
+    const VideoFormat& format = reader.getFormat();
+    if (decimation > 1 && format.width % 2) {
+        // the decimator averages in YUYV, like the app
+        fprintf(stderr, "--decimate needs an even input width, %s is %d pixels wide\n", paths[0].c_str(), format.width);
+        return 1;
+    }
+    if (!out_w) {
+        out_w = format.width;
+        out_h = format.height;
+    }
+
+    std::unique_ptr<TimeMap> time_map(TimeMap::create(map_spec));
+    if (!time_map) {
+        fprintf(stderr, "bad time map %s\n", map_spec.c_str());
+        return 1;
+    }
+
+    bool raw_out = paths[1].size() > 4 && paths[1].compare(paths[1].size() - 4, 4, ".rgb") == 0;
+    Y4MWriter writer;
+    if (!writer.open(paths[1], out_w, out_h, format.fps_num, format.fps_den * decimation, raw_out)) {
+        fprintf(stderr, "can't write %s\n", paths[1].c_str());
+        return 1;
+    }
+
+    // either every pixel of every frame, or just the slit
+    std::unique_ptr<FrameHistory> full_history;
+    std::unique_ptr<StripHistory> strip_history;
+    std::unique_ptr<TieredHistory> tiered_history;
+    if (cold_after) {
+        tiered_history.reset(new TieredHistory(format.width, format.height, frames, cold_after));
+    } else if (slit_spec.empty()) {
+        full_history.reset(new FrameHistory(format.width, format.height, frames));
+    } else {
+        size_t colon = slit_spec.find(':');
+        std::string slit = slit_spec.substr(0, colon);
+        int position = colon == std::string::npos ? -1 : atoi(slit_spec.c_str() + colon + 1);
+        if (slit != "row" && slit != "column") {
+            fprintf(stderr, "bad slit %s\n", slit_spec.c_str());
+            return 1;
+        }
+        strip_history.reset(new StripHistory(format.width, format.height, frames,
+                                             slit == "row" ? StripHistory::SLIT_ROW : StripHistory::SLIT_COLUMN, position));
+    }
+    const FrameHistory* history = strip_history ? &strip_history->getHistory() : full_history.get();
+    const size_t layer_size = history ? history->getLayerSize() : (size_t)format.width * format.height * 3;
+    fprintf(stderr, "history: %d frames, %.1f MB%s\n", frames, layer_size * (double)frames / 1e6,
+            tiered_history ? " before compression" : "");
+    std::unique_ptr<TemporalPyramid> pyramid;
+    if (pyramid_levels) {
+        pyramid.reset(new TemporalPyramid(history->getWidth(), history->getHeight(), frames, pyramid_levels));
+        fprintf(stderr, "pyramid: %d levels spanning %d frames, %.1f MB more\n", pyramid_levels,
+                pyramid->getLayout().getSpan(), pyramid->getMemoryUsage() / 1e6);
+    }
+    CpuRenderer renderer(threads, filter);
+    TimeMapCache cache;
+    const float* time_table = cache.getTable(*time_map, out_w, out_h);
+
+    // free lists bound the memory in flight; buffers cycle between them and the work queues
+    const size_t in_size = (size_t)format.width * format.height * 4;
+    const size_t out_size = (size_t)out_w * out_h * 4;
+    BoundedQueue<Buffer> free_in(queue_size + 1), decoded(queue_size);
+    BoundedQueue<Buffer> free_out(queue_size + 1), rendered(queue_size);
+    for (int i = 0; i < queue_size + 1; i++) {
+        free_in.push(Buffer(in_size));
+        free_out.push(Buffer(out_size));
+    }
+
+    double decode_busy = 0, encode_busy = 0, render_busy = 0;
+    Clock::time_point start = Clock::now();
+
+    // decimating, the decoder averages the frames (in YUYV, like the app) and
+    // only passes on every Nth
+    std::unique_ptr<FrameDecimator> decimator;
+    if (decimation > 1) {
+        decimator.reset(new FrameDecimator(format.width, format.height, decimation));
+    }
+
+    std::thread decode_thread([&] () {
+        Buffer raw, yuyv, rgba;
+        for (;;) {
+            if (!free_in.pop(rgba)) {
+                break;
+            }
+            Clock::time_point t = Clock::now();
+            bool more = true;
+            while ((more = reader.readFrame(raw))) {
+                if (!decimator) {
+                    format.toRGBA(&raw[0], &rgba[0]);
+                    break;
+                }
+                yuyv.resize((size_t)format.width * format.height * 2);
+                format.toYUYV(&raw[0], &yuyv[0]);
+                const uint8_t* average = decimator->addFrame(&yuyv[0], format.width * 2);
+                if (average) {
+                    yuv422_to_rgba(average, decimator->getRowBytes(), &rgba[0], format.width, format.height);
+                    break;
+                }
+            }
+            if (!more) {
+                break;
+            }
+            decode_busy += seconds_since(t);
+            decoded.push(std::move(rgba));
+        }
+        decoded.close();
+    });
+
+    bool write_failed = false;
+    std::thread encode_thread([&] () {
+        Buffer rgba;
+        while (rendered.pop(rgba)) {
+            Clock::time_point t = Clock::now();
+            if (!write_failed && !writer.writeFrame(&rgba[0], out_w * 4)) {
+                write_failed = true;
+            }
+            encode_busy += seconds_since(t);
+            free_out.push(std::move(rgba));
+        }
+    });
+
+    int count = 0;
+    Buffer in, out;
+    while (decoded.pop(in)) {
+        Clock::time_point t = Clock::now();
+        if (tiered_history) {
+            tiered_history->pushRGBA(&in[0], format.width * 4);
+        } else if (strip_history) {
+            strip_history->pushRGBA(&in[0], format.width * 4);
+        } else {
+            full_history->pushRGBA(&in[0], format.width * 4);
+        }
+        if (pyramid) {
+            pyramid->update(*history);
+        }
+        free_in.push(std::move(in));
+        if (count++ >= skip) {
+            free_out.pop(out);
+            if (tiered_history) {
+                renderer.renderTiered(*tiered_history, time_table, tiered_history->getNewestOffset(), &out[0], out_w, out_h, out_w * 4);
+            } else if (pyramid) {
+                renderer.renderPyramid(*history, *pyramid, time_table, history->getNewestOffset(), &out[0], out_w, out_h, out_w * 4);
+            } else {
+                renderer.render(*history, time_table, history->getNewestOffset(), &out[0], out_w, out_h, out_w * 4);
+            }
+            render_busy += seconds_since(t);
+            rendered.push(std::move(out));
+        } else {
+            render_busy += seconds_since(t);
+        }
+    }
+    free_in.close();
+    rendered.close();
+    decode_thread.join();
+    encode_thread.join();
+    if (!writer.close() || write_failed) {
+        fprintf(stderr, "writing %s failed\n", paths[1].c_str());
+        return 1;
+    }
+
+    double elapsed = seconds_since(start);
+    double fps = count / elapsed;
+    fprintf(stderr, "%d frames in %.2f s: %.1f fps, %.2fx real time, %.1f output MP/s\n",
+            count, elapsed, fps, fps * decimation / format.getFrameRate(),
+            (count - (std::min)(count, skip)) * (double)out_w * out_h / elapsed / 1e6);
+    fprintf(stderr, "busy: decode %.2f s, render %.2f s (%d threads), encode %.2f s\n",
+            decode_busy, render_busy, renderer.getThreadCount(), encode_busy);
+    if (tiered_history) {
+        TieredHistory::Stats stats = tiered_history->getStats();
+        fprintf(stderr, "cold history: %d layers in %.1f MB (%.2fx smaller), %.2f s compressing, %d hot layers,"
+                " %llu groups left uncompressed, %llu tiles decoded, %.1f%% cache hits\n",
+                stats.cold_layers, stats.cold_bytes / 1e6,
+                stats.cold_bytes ? stats.cold_layers * layer_size / (double)stats.cold_bytes : 0.0,
+                stats.compress_seconds, stats.hot_layers, (unsigned long long)stats.groups_skipped,
+                (unsigned long long)stats.tiles_decoded,
+                100.0 * stats.cache_hits / (std::max)((uint64_t)1, stats.cache_hits + stats.cache_misses));
+    }
+    return 0;
+}
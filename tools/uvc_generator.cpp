@@ -0,0 +1,144 @@
+#include "uvc_generator.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace slitscan {
+
+// bmHeaderInfo bits, as in the driver
+static const uint8_t UVC_FID = 1 << 0;
+static const uint8_t UVC_EOF = 1 << 1;
+static const uint8_t UVC_PTS = 1 << 2;
+static const uint8_t UVC_ERR = 1 << 6;
+
+// payloads of junk an oversize frame carries before its EOF
+static const int OVERSIZE_PAYLOADS = 4;
+
+static const char* fault_names[NUM_UVC_FAULTS] = {
+    "none",
+    "fid",
+    "pts",
+    "error",
+    "short",
+    "oversize"
+};
+
+UvcGenerator::UvcGenerator(uint32_t frame_size) :
+    frame_size(frame_size),
+    frames(0),
+    pts(1),
+    fid(0),
+    transfer_fill(0),
+    pixels(frame_size)
+{
+}
+
+const char* UvcGenerator::getFaultName(UvcFault fault)
+{
+    return fault_names[fault];
+}
+
+UvcFault UvcGenerator::findFault(const char* name)
+{
+    for (int i = 0; i < NUM_UVC_FAULTS; i++) {
+        if (strcmp(name, fault_names[i]) == 0) {
+            return (UvcFault)i;
+        }
+    }
+    return NUM_UVC_FAULTS;
+}
+
+static inline uint8_t pattern(uint32_t i, uint64_t sequence)
+{
+    return (uint8_t)(i * 13 + (i >> 8) + sequence * 101);
+}
+
+void UvcGenerator::fillFrame(uint8_t* frame, uint32_t frame_size, uint64_t sequence)
+{
+    uint32_t header = (std::min)(frame_size, (uint32_t)sizeof(sequence));
+    for (uint32_t i = 0; i < header; i++) {
+        frame[i] = (uint8_t)(sequence >> (i * 8));
+    }
+    for (uint32_t i = header; i < frame_size; i++) {
+        frame[i] = pattern(i, sequence);
+    }
+}
+
+bool UvcGenerator::checkFrame(const uint8_t* frame, uint32_t frame_size, uint64_t* sequence)
+{
+    uint32_t header = (std::min)(frame_size, (uint32_t)sizeof(*sequence));
+    *sequence = 0;
+    for (uint32_t i = 0; i < header; i++) {
+        *sequence |= (uint64_t)frame[i] << (i * 8);
+    }
+    for (uint32_t i = header; i < frame_size; i++) {
+        if (frame[i] != pattern(i, *sequence)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UvcGenerator::appendPayload(UvcTransfers& out, uint8_t flags, const uint8_t* data, uint32_t len)
+{
+    uint32_t size = HEADER_SIZE + len;
+    if (transfer_fill == 0 || transfer_fill + size > TRANSFER_SIZE) {
+        out.lengths.push_back(0);
+        transfer_fill = 0;
+    }
+    size_t offset = out.data.size();
+    out.data.resize(offset + size);
+    uint8_t* payload = &out.data[offset];
+    memset(payload, 0, HEADER_SIZE);
+    payload[0] = HEADER_SIZE;
+    payload[1] = flags | UVC_PTS | (fid ? UVC_FID : 0);
+    payload[2] = pts & 0xff;
+    payload[3] = (pts >> 8) & 0xff;
+    payload[4] = (pts >> 16) & 0xff;
+    payload[5] = (pts >> 24) & 0xff;
+    memcpy(payload + HEADER_SIZE, data, len);
+    out.lengths.back() += size;
+    transfer_fill += size;
+    if (size < PAYLOAD_SIZE || (flags & UVC_EOF)) {
+        // a short packet ends the transfer; the bridge also ends it at a frame's end
+        transfer_fill = 0;
+    }
+}
+
+void UvcGenerator::appendFrame(UvcTransfers& out, UvcFault fault)
+{
+    fillFrame(pixels.data(), frame_size, frames);
+
+    const uint32_t data_per_payload = PAYLOAD_SIZE - HEADER_SIZE;
+    const uint32_t payloads = (frame_size + data_per_payload - 1) / data_per_payload;
+    for (uint32_t p = 0; p < payloads; p++) {
+        uint32_t offset = p * data_per_payload;
+        uint32_t len = (std::min)(data_per_payload, frame_size - offset);
+        bool last = p + 1 == payloads;
+        uint8_t flags = last ? UVC_EOF : 0;
+        if (p == payloads / 2) {
+            if (fault == UVC_FAULT_FID_TOGGLE) {
+                fid ^= 1;
+            } else if (fault == UVC_FAULT_PTS_CHANGE) {
+                pts++;
+            } else if (fault == UVC_FAULT_ERROR) {
+                flags |= UVC_ERR;
+            } else if (fault == UVC_FAULT_SHORT_EOF) {
+                appendPayload(out, UVC_EOF, &pixels[offset], len);
+                break;
+            }
+        }
+        if (last && fault == UVC_FAULT_OVERSIZE) {
+            for (int i = 0; i < OVERSIZE_PAYLOADS; i++) {
+                appendPayload(out, 0, &pixels[0], (std::min)(data_per_payload, frame_size));
+            }
+        }
+        appendPayload(out, flags, &pixels[offset], len);
+    }
+
+    frames++;
+    pts++;
+    fid ^= 1;
+}
+
+} // namespace
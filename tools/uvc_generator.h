@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace slitscan {
+
+// Bulk transfers as the OV534 bridge delivers them, back to back in one
+// buffer: data holds the transfers, lengths the size of each one
+struct UvcTransfers
+{
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> lengths;
+
+    void clear() { data.clear(); lengths.clear(); }
+};
+
+// Ways a frame can go wrong on the wire; each is applied from the middle of the frame
+enum UvcFault {
+    UVC_FAULT_NONE,
+    UVC_FAULT_FID_TOGGLE,   // FID flips, as if a new frame started without the EOF
+    UVC_FAULT_PTS_CHANGE,   // same with the PTS
+    UVC_FAULT_ERROR,        // one payload has UVC_STREAM_ERR set
+    UVC_FAULT_SHORT_EOF,    // EOF comes early, the rest of the frame is missing
+    UVC_FAULT_OVERSIZE,     // a few payloads too many before the EOF
+    NUM_UVC_FAULTS
+};
+
+// Synthesizes the PS3 Eye's bulk stream: every frame is split into payloads of
+// up to 2048 bytes, each with a 12 byte UVC header carrying FID, PTS and (on the
+// last one) EOF, packed into transfers of up to 16384 bytes. A frame's short
+// last payload ends its transfer, like a short packet does on the wire.
+//
+// Frames start with their 64 bit sequence number followed by a pattern derived
+// from it, so checkFrame() can tell an intact frame from a torn or stale one.
+class UvcGenerator
+{
+public:
+    static const uint32_t HEADER_SIZE = 12;
+    static const uint32_t PAYLOAD_SIZE = 2048;
+    static const uint32_t TRANSFER_SIZE = 16384;
+
+    explicit UvcGenerator(uint32_t frame_size);
+
+    // Appends the transfers of the next frame
+    void appendFrame(UvcTransfers& out, UvcFault fault = UVC_FAULT_NONE);
+
+    // True if frame is exactly what appendFrame() generated for *sequence
+    // (which is read from the frame either way)
+    static bool checkFrame(const uint8_t* frame, uint32_t frame_size, uint64_t* sequence);
+    static const char* getFaultName(UvcFault fault);
+    // Fault by name, NUM_UVC_FAULTS if there is none
+    static UvcFault findFault(const char* name);
+
+    uint32_t getFrameSize() const { return frame_size; }
+    uint64_t getFramesGenerated() const { return frames; }
+
+private:
+    static void fillFrame(uint8_t* frame, uint32_t frame_size, uint64_t sequence);
+    void appendPayload(UvcTransfers& out, uint8_t flags, const uint8_t* data, uint32_t len);
+
+    uint32_t frame_size;
+    uint64_t frames;
+    uint32_t pts;
+    uint8_t fid;
+    uint32_t transfer_fill;     // bytes in the last transfer of out, 0 to start a new one
+    std::vector<uint8_t> pixels;
+};
+
+} // namespace
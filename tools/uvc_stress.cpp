@@ -0,0 +1,211 @@
+// Stress test for the driver's frame assembly: feeds FrameAssembler::pkt_scan
+// a synthetic OV534 bulk stream, at rates the sensor can't produce, with a
+// chosen share of deliberately broken frames (see UvcFault). Every frame the
+// driver queues is checked against what was generated, and the run reports
+// how many came out intact, how many were queued corrupted, how many were
+// dropped, and the parser's CPU time per megabyte of USB data.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <time.h>
+
+#include "frame_assembler.h"
+#include "uvc_generator.h"
+
+using namespace slitscan;
+
+typedef std::chrono::steady_clock Clock;
+
+// Frames are generated up front and replayed; sequence numbers repeat every CYCLE
+static const int CYCLE = 64;
+
+static uint64_t thread_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: uvc_stress [options]\n"
+        "options:\n"
+        "  --size WxH       frame size (default 640x480)\n"
+        "  --fps N          frames per second to feed, 0 for as fast as possible (default 0)\n"
+        "  --seconds S      run time (default 5)\n"
+        "  --fault-rate P   share of broken frames, 0-1, at least one of each fault if\n"
+        "                   above 0 (default 0.1)\n"
+        "  --faults LIST    comma separated: fid,pts,error,short,oversize (default all)\n"
+        "  --seed N         random seed for the fault pattern (default 1)\n");
+}
+
+struct FaultCounts
+{
+    uint64_t generated;
+    uint64_t intact;
+    uint64_t corrupted;     // queued by the driver, but not what was sent
+};
+
+// Frames that never came out; a frame split in two can come out twice, as
+// two corrupted ones, so this can't go below 0
+static uint64_t dropped(const FaultCounts& c)
+{
+    uint64_t queued = c.intact + c.corrupted;
+    return c.generated > queued ? c.generated - queued : 0;
+}
+
+int main(int argc, char** argv)
+{
+    int width = 640, height = 480;
+    double fps = 0, seconds = 5, fault_rate = 0.1;
+    unsigned seed = 1;
+    std::vector<UvcFault> faults;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--size" && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--fps" && has_value) {
+            fps = atof(argv[++i]);
+        } else if (arg == "--seconds" && has_value) {
+            seconds = atof(argv[++i]);
+        } else if (arg == "--fault-rate" && has_value) {
+            fault_rate = atof(argv[++i]);
+        } else if (arg == "--faults" && has_value) {
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) {
+                    end = list.size();
+                }
+                UvcFault fault = UvcGenerator::findFault(list.substr(start, end - start).c_str());
+                if (fault == NUM_UVC_FAULTS || fault == UVC_FAULT_NONE) {
+                    usage();
+                    return 1;
+                }
+                faults.push_back(fault);
+                start = end + 1;
+            }
+        } else if (arg == "--seed" && has_value) {
+            seed = atoi(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (faults.empty()) {
+        for (int f = UVC_FAULT_NONE + 1; f < NUM_UVC_FAULTS; f++) {
+            faults.push_back((UvcFault)f);
+        }
+    }
+
+    uint32_t frame_size = width * height * 2;
+    UvcGenerator generator(frame_size);
+    std::vector<UvcTransfers> frames(CYCLE);
+    // fault_rate of the cycle is broken, at random places, taking turns over
+    // the selected faults so each of them shows up however short the cycle
+    int faulty = (int)(fault_rate * CYCLE + 0.5);
+    if (fault_rate > 0 && faulty < (int)faults.size()) {
+        faulty = (int)faults.size();
+    }
+    faulty = faulty < CYCLE ? faulty : CYCLE;
+    std::vector<UvcFault> frame_faults(CYCLE, UVC_FAULT_NONE);
+    for (int i = 0; i < faulty; i++) {
+        frame_faults[i] = faults[i % faults.size()];
+    }
+    std::mt19937 rng(seed);
+    std::shuffle(frame_faults.begin(), frame_faults.end(), rng);
+    for (int i = 0; i < CYCLE; i++) {
+        generator.appendFrame(frames[i], frame_faults[i]);
+    }
+
+    ps3eye::FrameQueue queue(frame_size);
+    ps3eye::FrameAssembler assembler;
+    assembler.start(&queue, frame_size);
+    std::vector<uint8_t> frame(frame_size);
+
+    FaultCounts counts[NUM_UVC_FAULTS];
+    memset(counts, 0, sizeof(counts));
+    uint64_t fed = 0, dequeued = 0, parse_ns = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    while (Clock::now() < end) {
+        if (fps > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(fed / fps)));
+        }
+        int index = fed % CYCLE;
+        const UvcTransfers& transfers = frames[index];
+        counts[frame_faults[index]].generated++;
+        const uint8_t* data = transfers.data.data();
+        uint64_t cpu_start = thread_cpu_ns();
+        for (size_t t = 0; t < transfers.lengths.size(); t++) {
+            assembler.pkt_scan(data, transfers.lengths[t]);
+            data += transfers.lengths[t];
+        }
+        parse_ns += thread_cpu_ns() - cpu_start;
+
+        // take the frame out right away, like a consumer that always keeps
+        // up; the queue only holds one, so a second one would be overwritten
+        uint64_t completed = assembler.get_stats().frames_completed;
+        if (completed != dequeued) {
+            dequeued = completed;
+            queue.Dequeue(frame.data());
+            uint64_t sequence = 0;
+            bool intact = UvcGenerator::checkFrame(frame.data(), frame_size, &sequence);
+            FaultCounts& c = counts[frame_faults[sequence % CYCLE]];
+            if (intact) {
+                c.intact++;
+            } else {
+                c.corrupted++;
+            }
+        }
+        fed++;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const ps3eye::FrameAssemblerStats& stats = assembler.get_stats();
+    double megabytes = stats.bytes_scanned / 1e6;
+    printf("%dx%d, %llu frames in %.2f s (%.0f fps), %.1f MB/s of USB data\n", width, height,
+           (unsigned long long)fed, elapsed, fed / elapsed, megabytes / elapsed);
+    printf("parser: %.1f us CPU per MB, %.1f us per frame\n",
+           megabytes ? parse_ns / 1e3 / megabytes : 0, fed ? parse_ns / 1e3 / fed : 0);
+    printf("\n%-10s %10s %10s %10s %10s\n", "frames", "generated", "intact", "corrupted", "dropped");
+    FaultCounts total;
+    memset(&total, 0, sizeof(total));
+    for (int f = 0; f < NUM_UVC_FAULTS; f++) {
+        const FaultCounts& c = counts[f];
+        if (!c.generated) {
+            continue;
+        }
+        printf("%-10s %10llu %10llu %10llu %10llu\n", UvcGenerator::getFaultName((UvcFault)f),
+               (unsigned long long)c.generated, (unsigned long long)c.intact, (unsigned long long)c.corrupted,
+               (unsigned long long)dropped(c));
+        total.generated += c.generated;
+        total.intact += c.intact;
+        total.corrupted += c.corrupted;
+    }
+    printf("%-10s %10llu %10llu %10llu %10llu\n", "total", (unsigned long long)total.generated,
+           (unsigned long long)total.intact, (unsigned long long)total.corrupted,
+           (unsigned long long)dropped(total));
+    printf("\nassembler: %llu queued (%llu without EOF, %llu overwritten), %llu discarded\n",
+           (unsigned long long)stats.frames_completed, (unsigned long long)stats.frames_incomplete,
+           (unsigned long long)stats.frames_overwritten, (unsigned long long)stats.frames_discarded);
+    printf("payloads discarded: %llu bad header, %llu error bit, %llu no PTS, %llu wrong size\n",
+           (unsigned long long)stats.payloads_bad_header, (unsigned long long)stats.payloads_stream_error,
+           (unsigned long long)stats.payloads_missing_pts, (unsigned long long)stats.payloads_size_mismatch);
+
+    // clean frames have to survive whatever came before them
+    return counts[UVC_FAULT_NONE].intact == counts[UVC_FAULT_NONE].generated ? 0 : 1;
+}